@@ -19,6 +19,7 @@
 
 #include <asm/cacheflush.h>
 #include <linux/list.h>
+#include <linux/log2.h>
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/rtmutex.h>
@@ -318,6 +319,197 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 	return vma ? -ENOMEM : -ESRCH;
 }
 
+static void binder_free_buf_locked(struct binder_alloc *alloc,
+				   struct binder_buffer *buffer);
+
+static int binder_alloc_cache_bucket(size_t size)
+{
+	return ilog2(size) - BINDER_ALLOC_CACHE_MIN_SHIFT;
+}
+
+static struct binder_buffer *binder_alloc_cache_take(struct binder_alloc *alloc,
+						     int bucket, size_t size)
+{
+	struct binder_alloc_cache *cache = &alloc->cache;
+	struct binder_buffer *buffer;
+	size_t buffer_size;
+	int i;
+
+	for (i = 0; i < cache->count[bucket]; i++) {
+		buffer = cache->buffers[bucket][i];
+		buffer_size = binder_alloc_buffer_size(alloc, buffer);
+		if (buffer_size < size)
+			continue;
+
+		cache->buffers[bucket][i] =
+			cache->buffers[bucket][--cache->count[bucket]];
+		cache->bytes -= buffer_size;
+		return buffer;
+	}
+	return NULL;
+}
+
+/*
+ * Serve a small sync allocation from the cache. Buckets hold buffers of
+ * [1 << n, 1 << (n + 1)) bytes, so the bucket of @size is searched for a
+ * large enough buffer and failing that, any buffer of the next one fits.
+ */
+static struct binder_buffer *binder_alloc_cache_get(struct binder_alloc *alloc,
+						    size_t data_size,
+						    size_t offsets_size,
+						    size_t extra_buffers_size)
+{
+	const size_t max_size = (size_t)1 << BINDER_ALLOC_CACHE_MAX_SHIFT;
+	struct binder_alloc_cache *cache = &alloc->cache;
+	struct binder_buffer *buffer;
+	size_t size;
+	int bucket;
+
+	/* Checked one by one first so that the sum cannot overflow */
+	if (data_size >= max_size || offsets_size >= max_size ||
+	    extra_buffers_size >= max_size)
+		return NULL;
+
+	size = ALIGN(data_size, sizeof(void *)) +
+		ALIGN(offsets_size, sizeof(void *)) +
+		ALIGN(extra_buffers_size, sizeof(void *));
+	size = max(size, sizeof(void *));
+	if (size >= max_size)
+		return NULL;
+
+	bucket = binder_alloc_cache_bucket(size);
+
+	spin_lock(&cache->lock);
+	buffer = binder_alloc_cache_take(alloc, bucket, size);
+	if (!buffer && bucket + 1 < BINDER_ALLOC_CACHE_BUCKETS)
+		buffer = binder_alloc_cache_take(alloc, bucket + 1, size);
+	if (buffer)
+		cache->hits++;
+	else
+		cache->misses++;
+	spin_unlock(&cache->lock);
+
+	if (!buffer)
+		return NULL;
+
+	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
+		     "%d: binder_alloc_buf size %zd got cached %pK\n",
+		      alloc->pid, size, buffer);
+	/* Same state binder_alloc_new_buf_locked() leaves a buffer in */
+	buffer->allow_user_free = 0;
+	buffer->async_transaction = 0;
+	buffer->data_size = data_size;
+	buffer->offsets_size = offsets_size;
+	buffer->extra_buffers_size = extra_buffers_size;
+	return buffer;
+}
+
+/*
+ * Park a freed sync buffer in the cache instead of returning it to
+ * free_buffers. Returns %false if the buffer was not cached.
+ */
+static bool binder_alloc_cache_put(struct binder_alloc *alloc,
+				   struct binder_buffer *buffer)
+{
+	struct binder_alloc_cache *cache = &alloc->cache;
+	size_t buffer_size;
+	bool cached = false;
+	int bucket;
+
+	if (buffer->async_transaction || READ_ONCE(cache->disabled) ||
+	    !READ_ONCE(alloc->vma))
+		return false;
+
+	/*
+	 * This runs without alloc->mutex. The buffers list may change around
+	 * an allocated buffer, but its successor can neither be removed nor
+	 * moved, so the size is stable.
+	 */
+	buffer_size = binder_alloc_buffer_size(alloc, buffer);
+	if (buffer_size >= (size_t)1 << BINDER_ALLOC_CACHE_MAX_SHIFT)
+		return false;
+
+	BUG_ON(buffer->free);
+	BUG_ON(buffer->transaction != NULL);
+
+	bucket = binder_alloc_cache_bucket(buffer_size);
+
+	/*
+	 * A cached buffer stays in allocated_buffers. Don't let a stale
+	 * BC_FREE_BUFFER free it a second time while it sits in the cache.
+	 */
+	buffer->allow_user_free = 0;
+
+	spin_lock(&cache->lock);
+	if (cache->count[bucket] < BINDER_ALLOC_CACHE_DEPTH &&
+	    cache->bytes + buffer_size <= alloc->buffer_size / 64) {
+		cache->buffers[bucket][cache->count[bucket]++] = buffer;
+		cache->bytes += buffer_size;
+		cached = true;
+	}
+	spin_unlock(&cache->lock);
+
+	if (cached)
+		binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
+			     "%d: binder_free_buf %pK size %zd cached\n",
+			      alloc->pid, buffer, buffer_size);
+	return cached;
+}
+
+/*
+ * Return every cached buffer to free_buffers. Called with alloc->mutex
+ * held, returns %true if there was anything to drain.
+ */
+static bool binder_alloc_cache_drain_locked(struct binder_alloc *alloc)
+{
+	struct binder_buffer *buffers[BINDER_ALLOC_CACHE_BUCKETS *
+				      BINDER_ALLOC_CACHE_DEPTH];
+	struct binder_alloc_cache *cache = &alloc->cache;
+	int bucket, i, nr = 0;
+
+	spin_lock(&cache->lock);
+	for (bucket = 0; bucket < BINDER_ALLOC_CACHE_BUCKETS; bucket++) {
+		for (i = 0; i < cache->count[bucket]; i++)
+			buffers[nr++] = cache->buffers[bucket][i];
+		cache->count[bucket] = 0;
+	}
+	cache->bytes = 0;
+	spin_unlock(&cache->lock);
+
+	for (i = 0; i < nr; i++)
+		binder_free_buf_locked(alloc, buffers[i]);
+
+	return nr > 0;
+}
+
+/**
+ * binder_alloc_cache_drain() - release all cached buffers
+ * @alloc:	binder_alloc for this proc
+ */
+void binder_alloc_cache_drain(struct binder_alloc *alloc)
+{
+	mutex_lock(&alloc->mutex);
+	binder_alloc_cache_drain_locked(alloc);
+	mutex_unlock(&alloc->mutex);
+}
+
+static bool binder_alloc_cache_contains(struct binder_alloc *alloc,
+					struct binder_buffer *buffer)
+{
+	struct binder_alloc_cache *cache = &alloc->cache;
+	bool found = false;
+	int bucket, i;
+
+	spin_lock(&cache->lock);
+	for (bucket = 0; bucket < BINDER_ALLOC_CACHE_BUCKETS; bucket++)
+		for (i = 0; i < cache->count[bucket]; i++)
+			if (cache->buffers[bucket][i] == buffer)
+				found = true;
+	spin_unlock(&cache->lock);
+
+	return found;
+}
+
 static struct binder_buffer *binder_alloc_new_buf_locked(
 				struct binder_alloc *alloc,
 				size_t data_size,
@@ -367,6 +559,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	/* Pad 0-size buffers so they get assigned unique addresses */
 	size = max(size, sizeof(void *));
 
+retry:
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(!buffer->free);
@@ -382,6 +575,10 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 			break;
 		}
 	}
+	if (best_fit == NULL && binder_alloc_cache_drain_locked(alloc)) {
+		n = alloc->free_buffers.rb_node;
+		goto retry;
+	}
 	if (best_fit == NULL) {
 		size_t allocated_buffers = 0;
 		size_t largest_alloc_size = 0;
@@ -488,7 +685,8 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
  * Allocate a new buffer given the requested sizes. Returns
  * the kernel version of the buffer pointer. The size allocated
  * is the sum of the three given sizes (each rounded up to
- * pointer-sized boundary)
+ * pointer-sized boundary). Small sync buffers are served from
+ * the cache of recently freed ones when possible.
  *
  * Return:	The allocated buffer or %NULL if error
  */
@@ -500,6 +698,13 @@ struct binder_buffer *binder_alloc_new_buf(struct binder_alloc *alloc,
 {
 	struct binder_buffer *buffer;
 
+	if (!is_async && READ_ONCE(alloc->vma)) {
+		buffer = binder_alloc_cache_get(alloc, data_size, offsets_size,
+						extra_buffers_size);
+		if (buffer)
+			return buffer;
+	}
+
 	mutex_lock(&alloc->mutex);
 	buffer = binder_alloc_new_buf_locked(alloc, data_size, offsets_size,
 					     extra_buffers_size, is_async);
@@ -632,6 +837,9 @@ static void binder_free_buf_locked(struct binder_alloc *alloc,
 void binder_alloc_free_buf(struct binder_alloc *alloc,
 			    struct binder_buffer *buffer)
 {
+	if (binder_alloc_cache_put(alloc, buffer))
+		return;
+
 	mutex_lock(&alloc->mutex);
 	binder_free_buf_locked(alloc, buffer);
 	mutex_unlock(&alloc->mutex);
@@ -721,6 +929,7 @@ void binder_alloc_deferred_release(struct binder_alloc *alloc)
 
 	buffers = 0;
 	mutex_lock(&alloc->mutex);
+	binder_alloc_cache_drain_locked(alloc);
 	while ((n = rb_first(&alloc->allocated_buffers))) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 
@@ -794,12 +1003,15 @@ static void print_binder_buffer(struct seq_file *m, const char *prefix,
 void binder_alloc_print_allocated(struct seq_file *m,
 				  struct binder_alloc *alloc)
 {
+	struct binder_buffer *buffer;
 	struct rb_node *n;
 
 	mutex_lock(&alloc->mutex);
-	for (n = rb_first(&alloc->allocated_buffers); n != NULL; n = rb_next(n))
-		print_binder_buffer(m, "  buffer",
-				    rb_entry(n, struct binder_buffer, rb_node));
+	for (n = rb_first(&alloc->allocated_buffers); n != NULL; n = rb_next(n)) {
+		buffer = rb_entry(n, struct binder_buffer, rb_node);
+		if (!binder_alloc_cache_contains(alloc, buffer))
+			print_binder_buffer(m, "  buffer", buffer);
+	}
 	mutex_unlock(&alloc->mutex);
 }
 
@@ -830,6 +1042,8 @@ void binder_alloc_print_pages(struct seq_file *m,
 	mutex_unlock(&alloc->mutex);
 	seq_printf(m, "  pages: %d:%d:%d\n", active, lru, free);
 	seq_printf(m, "  pages high watermark: %zu\n", alloc->pages_high);
+	seq_printf(m, "  buffer cache: %zu bytes hits %lu misses %lu\n",
+		   alloc->cache.bytes, alloc->cache.hits, alloc->cache.misses);
 }
 
 /**
@@ -842,10 +1056,15 @@ int binder_alloc_get_allocated_count(struct binder_alloc *alloc)
 {
 	struct rb_node *n;
 	int count = 0;
+	int bucket;
 
 	mutex_lock(&alloc->mutex);
 	for (n = rb_first(&alloc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
+	spin_lock(&alloc->cache.lock);
+	for (bucket = 0; bucket < BINDER_ALLOC_CACHE_BUCKETS; bucket++)
+		count -= alloc->cache.count[bucket];
+	spin_unlock(&alloc->cache.lock);
 	mutex_unlock(&alloc->mutex);
 	return count;
 }
@@ -971,6 +1190,7 @@ void binder_alloc_init(struct binder_alloc *alloc)
 {
 	alloc->pid = current->group_leader->pid;
 	mutex_init(&alloc->mutex);
+	spin_lock_init(&alloc->cache.lock);
 	INIT_LIST_HEAD(&alloc->buffers);
 }
 
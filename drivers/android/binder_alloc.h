@@ -21,6 +21,7 @@
 #include <linux/rtmutex.h>
 #include <linux/vmalloc.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/list_lru.h>
 
 #ifdef CONFIG_ANDROID_BINDER_IPC_32BIT
@@ -79,6 +80,41 @@ struct binder_lru_page {
 	struct binder_alloc *alloc;
 };
 
+/*
+ * Freed sync buffers smaller than 1 << BINDER_ALLOC_CACHE_MAX_SHIFT are
+ * cached per power of two size bucket, BINDER_ALLOC_CACHE_DEPTH deep.
+ */
+#define BINDER_ALLOC_CACHE_MIN_SHIFT	3
+#define BINDER_ALLOC_CACHE_MAX_SHIFT	11
+#define BINDER_ALLOC_CACHE_BUCKETS	\
+	(BINDER_ALLOC_CACHE_MAX_SHIFT - BINDER_ALLOC_CACHE_MIN_SHIFT)
+#define BINDER_ALLOC_CACHE_DEPTH	2
+
+/**
+ * struct binder_alloc_cache - recently freed small buffers
+ * @lock:      protects the cache, nests inside binder_alloc->mutex
+ * @buffers:   cached buffers by size bucket
+ * @count:     number of buffers in each bucket
+ * @bytes:     total size of the cached buffers
+ * @disabled:  %true to stop caching freed buffers
+ * @hits:      allocations served from the cache
+ * @misses:    small sync allocations the cache could not serve
+ *
+ * Cached buffers stay in allocated_buffers with their pages mapped and
+ * off the lru, so handing one out again needs neither alloc->mutex nor
+ * a walk of free_buffers.
+ */
+struct binder_alloc_cache {
+	spinlock_t lock;
+	struct binder_buffer *buffers[BINDER_ALLOC_CACHE_BUCKETS]
+				     [BINDER_ALLOC_CACHE_DEPTH];
+	u8 count[BINDER_ALLOC_CACHE_BUCKETS];
+	size_t bytes;
+	bool disabled;
+	unsigned long hits;
+	unsigned long misses;
+};
+
 /**
  * struct binder_alloc - per-binder proc state for binder allocator
  * @vma:                vm_area_struct passed to mmap_handler
@@ -97,6 +133,7 @@ struct binder_lru_page {
  * @buffer_size:        size of address space specified via mmap
  * @pid:                pid for associated binder_proc (invariant after init)
  * @pages_high:         high watermark of offset in @pages
+ * @cache:              recently freed small buffers
  *
  * Bookkeeping structure for per-proc address space management for binder
  * buffers. It is normally initialized during binder_init() and binder_mmap()
@@ -117,6 +154,7 @@ struct binder_alloc {
 	uint32_t buffer_free;
 	int pid;
 	size_t pages_high;
+	struct binder_alloc_cache cache;
 };
 
 #ifdef CONFIG_ANDROID_BINDER_IPC_SELFTEST
@@ -140,6 +178,7 @@ binder_alloc_prepare_to_free(struct binder_alloc *alloc,
 			     uintptr_t user_ptr);
 extern void binder_alloc_free_buf(struct binder_alloc *alloc,
 				  struct binder_buffer *buffer);
+extern void binder_alloc_cache_drain(struct binder_alloc *alloc);
 extern int binder_alloc_mmap_handler(struct binder_alloc *alloc,
 				     struct vm_area_struct *vma);
 extern void binder_alloc_deferred_release(struct binder_alloc *alloc);
@@ -19,11 +19,15 @@
 
 #include <linux/mm_types.h>
 #include <linux/err.h>
+#include <linux/ktime.h>
 #include "binder_alloc.h"
 
 #define BUFFER_NUM 5
 #define BUFFER_MIN_SIZE (PAGE_SIZE / 8)
 
+#define BENCH_ITERATIONS 10000
+#define BENCH_BATCH 4
+
 static bool binder_selftest_run = true;
 static int binder_selftest_failures;
 static DEFINE_MUTEX(binder_selftest_lock);
@@ -280,6 +284,124 @@ static void binder_selftest_alloc_offset(struct binder_alloc *alloc,
 	}
 }
 
+/**
+ * binder_selftest_cache() - Test reuse of cached buffers.
+ * @alloc: Pointer to alloc struct.
+ *
+ * Free a small buffer the way a transaction would leave it, check that
+ * the next allocation of that size gets the same buffer back from the
+ * cache, in the state of a freshly allocated one, and that draining
+ * empties the cache.
+ */
+static void binder_selftest_cache(struct binder_alloc *alloc)
+{
+	struct binder_buffer *buffer, *reused;
+	unsigned long hits;
+
+	alloc->cache.disabled = false;
+	binder_alloc_cache_drain(alloc);
+
+	buffer = binder_alloc_new_buf(alloc, 64, 0, 0, 0);
+	if (IS_ERR(buffer)) {
+		pr_err("cache test alloc failed\n");
+		binder_selftest_failures++;
+		return;
+	}
+	buffer->allow_user_free = 1;
+	binder_alloc_free_buf(alloc, buffer);
+	if (!alloc->cache.bytes) {
+		pr_err("freed buffer was not cached\n");
+		binder_selftest_failures++;
+		return;
+	}
+	if (buffer->allow_user_free) {
+		pr_err("cached buffer can still be freed by user space\n");
+		binder_selftest_failures++;
+	}
+
+	hits = alloc->cache.hits;
+	reused = binder_alloc_new_buf(alloc, 48, 0, 0, 0);
+	if (IS_ERR(reused)) {
+		pr_err("cache test realloc failed\n");
+		binder_selftest_failures++;
+		return;
+	}
+	if (reused != buffer || alloc->cache.hits != hits + 1) {
+		pr_err("allocation was not served from the cache\n");
+		binder_selftest_failures++;
+	}
+	if (reused->free || reused->allow_user_free ||
+	    reused->async_transaction || reused->data_size != 48) {
+		pr_err("cached buffer was not reset for reuse\n");
+		binder_selftest_failures++;
+	}
+	binder_alloc_free_buf(alloc, reused);
+
+	binder_alloc_cache_drain(alloc);
+	if (alloc->cache.bytes) {
+		pr_err("cache not empty after drain\n");
+		binder_selftest_failures++;
+	}
+}
+
+/*
+ * Time BENCH_ITERATIONS rounds of allocating and freeing BENCH_BATCH
+ * buffers of @size. Returns the average ns per alloc/free pair, or 0
+ * if an allocation failed.
+ */
+static u64 binder_selftest_bench_size(struct binder_alloc *alloc, size_t size)
+{
+	struct binder_buffer *buffers[BENCH_BATCH];
+	u64 start, elapsed;
+	int i, j;
+
+	start = ktime_get_ns();
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		for (j = 0; j < BENCH_BATCH; j++) {
+			buffers[j] = binder_alloc_new_buf(alloc, size, 0, 0, 0);
+			if (IS_ERR(buffers[j])) {
+				pr_err("bench alloc of size %zu failed\n", size);
+				binder_selftest_failures++;
+				while (j--)
+					binder_alloc_free_buf(alloc, buffers[j]);
+				return 0;
+			}
+		}
+		for (j = 0; j < BENCH_BATCH; j++)
+			binder_alloc_free_buf(alloc, buffers[j]);
+	}
+	elapsed = ktime_get_ns() - start;
+
+	return div_u64(elapsed, BENCH_ITERATIONS * BENCH_BATCH);
+}
+
+/**
+ * binder_selftest_bench() - Measure alloc/free throughput.
+ * @alloc: Pointer to alloc struct.
+ *
+ * Report the cost of an alloc/free pair for a range of buffer sizes,
+ * with and without the cache of freed small buffers.
+ */
+static void binder_selftest_bench(struct binder_alloc *alloc)
+{
+	static const size_t sizes[] = { 8, 64, 256, 1000, 2040, 4096, 16384 };
+	u64 uncached, cached;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		alloc->cache.disabled = true;
+		binder_alloc_cache_drain(alloc);
+		uncached = binder_selftest_bench_size(alloc, sizes[i]);
+
+		alloc->cache.disabled = false;
+		cached = binder_selftest_bench_size(alloc, sizes[i]);
+		binder_alloc_cache_drain(alloc);
+
+		pr_info("size %zu: %llu ns uncached, %llu ns cached per alloc/free\n",
+			sizes[i], uncached, cached);
+	}
+}
+
 /**
  * binder_selftest_alloc() - Test alloc and free of buffer pages.
  * @alloc: Pointer to alloc struct.
@@ -287,7 +409,9 @@ static void binder_selftest_alloc_offset(struct binder_alloc *alloc,
  * Allocate BUFFER_NUM buffers to cover all page alignment cases,
  * then free them in all orders possible. Check that pages are
  * correctly allocated, put onto lru when buffers are freed, and
- * are freed when binder_alloc_free_page is called.
+ * are freed when binder_alloc_free_page is called. The buffer
+ * cache is disabled while doing so. Then check reuse of cached
+ * buffers and benchmark alloc/free.
  */
 void binder_selftest_alloc(struct binder_alloc *alloc)
 {
@@ -299,7 +423,12 @@ void binder_selftest_alloc(struct binder_alloc *alloc)
 	if (!binder_selftest_run || !alloc->vma)
 		goto done;
 	pr_info("STARTED\n");
+	alloc->cache.disabled = true;
+	binder_alloc_cache_drain(alloc);
 	binder_selftest_alloc_offset(alloc, end_offset, 0);
+	binder_selftest_cache(alloc);
+	binder_selftest_bench(alloc);
+	alloc->cache.disabled = false;
 	binder_selftest_run = false;
 	if (binder_selftest_failures > 0)
 		pr_info("%d tests FAILED\n", binder_selftest_failures);
@@ -16,24 +16,72 @@
 #include <linux/cpufreq.h>
 #include <linux/cpufreq_times.h>
 #include <linux/cputime.h>
+#include <linux/hash.h>
 #include <linux/hashtable.h>
 #include <linux/init.h>
+#include <linux/percpu.h>
 #include <linux/proc_fs.h>
 #include <linux/sched.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/threads.h>
+#include <linux/workqueue.h>
+#include <uapi/linux/cpufreq_times.h>
 
 #define UID_HASH_BITS 10
 
 static DECLARE_HASHTABLE(uid_hash_table, UID_HASH_BITS);
 
-/* task->time_in_state */
-static  __cacheline_aligned_in_smp DEFINE_SPINLOCK(task_time_in_state_lock);
+/*
+ * task->time_in_state, hashed by task. Only the tick on the task's own CPU
+ * and readers of its proc file take the lock of a given task.
+ */
+#define TASK_LOCK_BITS 6
+
+static struct {
+	spinlock_t lock;
+} ____cacheline_aligned_in_smp task_time_in_state_locks[1 << TASK_LOCK_BITS] = {
+	[0 ... (1 << TASK_LOCK_BITS) - 1] = {
+		.lock = __SPIN_LOCK_UNLOCKED(task_time_in_state_locks.lock)
+	}
+};
+
+static spinlock_t *task_time_in_state_lock(struct task_struct *p)
+{
+	return &task_time_in_state_locks[hash_ptr(p, TASK_LOCK_BITS)].lock;
+}
+
 /* uid_hash_table */
 static __cacheline_aligned_in_smp DEFINE_SPINLOCK(uid_lock);
 
+/*
+ * Per-UID times are not charged from the tick directly. Each CPU logs its
+ * ticks in a small buffer, merging consecutive ticks of the same UID and
+ * state, and the buffer is folded into uid_hash_table under uid_lock from
+ * a work item once it fills up, or before anybody reads the UID stats.
+ */
+#define UID_SAMPLES		64
+#define UID_SAMPLES_FLUSH	48
+
+struct uid_sample {
+	uid_t uid;
+	unsigned int state;
+	unsigned short active;	/* index in concurrent_times->active */
+	unsigned short policy;	/* index in concurrent_times->policy */
+	cputime_t time;
+};
+
+struct uid_samples {
+	spinlock_t lock;
+	unsigned int nr;
+	int cpu;
+	struct work_struct flush_work;
+	struct uid_sample samples[UID_SAMPLES];
+};
+
+static DEFINE_PER_CPU(struct uid_samples, uid_samples);
+
 struct concurrent_times {
 	atomic64_t active[NR_CPUS];
 	atomic64_t policy[NR_CPUS];
@@ -53,12 +101,14 @@ struct uid_entry {
  * @offset: start of these freqs' stats in task time_in_state array
  * @max_state: number of entries in freq_table
  * @last_index: index in freq_table of last frequency switched to
+ * @related_cpus: CPUs of the policy these freqs belong to
  * @freq_table: list of available frequencies
  */
 struct cpu_freqs {
 	unsigned int offset;
 	unsigned int max_state;
 	unsigned int last_index;
+	struct cpumask related_cpus;
 	unsigned int freq_table[0];
 };
 
@@ -139,6 +189,93 @@ static struct uid_entry *find_or_register_uid_locked(uid_t uid)
 	return uid_entry;
 }
 
+/* Caller must hold the samples lock */
+static void uid_samples_fold_locked(struct uid_samples *us)
+{
+	struct uid_entry *uid_entry;
+	unsigned int i;
+
+	if (!us->nr)
+		return;
+
+	spin_lock(&uid_lock);
+	for (i = 0; i < us->nr; i++) {
+		struct uid_sample *sample = &us->samples[i];
+
+		uid_entry = find_or_register_uid_locked(sample->uid);
+		if (!uid_entry)
+			continue;
+
+		if (sample->state < uid_entry->max_state)
+			uid_entry->time_in_state[sample->state] += sample->time;
+		atomic64_add(sample->time,
+			&uid_entry->concurrent_times->active[sample->active]);
+		atomic64_add(sample->time,
+			&uid_entry->concurrent_times->policy[sample->policy]);
+	}
+	spin_unlock(&uid_lock);
+
+	us->nr = 0;
+}
+
+static void uid_samples_fold(struct uid_samples *us)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&us->lock, flags);
+	uid_samples_fold_locked(us);
+	spin_unlock_irqrestore(&us->lock, flags);
+}
+
+static void uid_samples_flush_work(struct work_struct *work)
+{
+	uid_samples_fold(container_of(work, struct uid_samples, flush_work));
+}
+
+/* Brings uid_hash_table up to date with the ticks of all CPUs */
+static void uid_samples_fold_all(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		uid_samples_fold(&per_cpu(uid_samples, cpu));
+}
+
+/* Called from the tick with interrupts disabled */
+static void uid_samples_add(uid_t uid, unsigned int state,
+			    unsigned int active, unsigned int policy,
+			    cputime_t time)
+{
+	struct uid_samples *us = this_cpu_ptr(&uid_samples);
+	struct uid_sample *sample;
+
+	spin_lock(&us->lock);
+	if (us->nr) {
+		sample = &us->samples[us->nr - 1];
+		if (sample->uid == uid && sample->state == state &&
+		    sample->active == active && sample->policy == policy) {
+			sample->time += time;
+			goto unlock;
+		}
+	}
+
+	/* The flush work fell behind, fold in place */
+	if (us->nr == UID_SAMPLES)
+		uid_samples_fold_locked(us);
+
+	sample = &us->samples[us->nr++];
+	sample->uid = uid;
+	sample->state = state;
+	sample->active = active;
+	sample->policy = policy;
+	sample->time = time;
+
+	if (us->nr == UID_SAMPLES_FLUSH)
+		queue_work_on(us->cpu, system_wq, &us->flush_work);
+unlock:
+	spin_unlock(&us->lock);
+}
+
 static int single_uid_time_in_state_show(struct seq_file *m, void *ptr)
 {
 	struct uid_entry *uid_entry;
@@ -229,6 +366,59 @@ static int uid_time_in_state_seq_show(struct seq_file *m, void *v)
 	return 0;
 }
 
+static int uid_time_in_state_bin_seq_show(struct seq_file *m, void *v)
+{
+	struct uid_entry *uid_entry;
+	struct cpu_freqs *freqs, *last_freqs = NULL;
+	unsigned int nr_states = READ_ONCE(next_offset);
+	int i, cpu;
+
+	if (v == uid_hash_table) {
+		struct cpufreq_times_uid_header hdr = {
+			.magic = CPUFREQ_TIMES_UID_MAGIC,
+			.version = CPUFREQ_TIMES_UID_VERSION,
+			.nr_states = nr_states,
+		};
+		unsigned int n = 0;
+
+		seq_write(m, &hdr, sizeof(hdr));
+		for_each_possible_cpu(cpu) {
+			freqs = all_freqs[cpu];
+			if (!freqs || freqs == last_freqs)
+				continue;
+			last_freqs = freqs;
+			for (i = 0; i < freqs->max_state && n < nr_states;
+			     i++, n++) {
+				u32 freq = freqs->freq_table[i];
+
+				seq_write(m, &freq, sizeof(freq));
+			}
+		}
+	}
+
+	rcu_read_lock();
+
+	hlist_for_each_entry_rcu(uid_entry, (struct hlist_head *)v, hash) {
+		struct cpufreq_times_uid_record rec = {
+			.uid = uid_entry->uid,
+		};
+
+		if (!uid_entry->max_state)
+			continue;
+
+		seq_write(m, &rec, sizeof(rec));
+		for (i = 0; i < nr_states; i++) {
+			u64 time = i < uid_entry->max_state ?
+				cputime_to_clock_t(uid_entry->time_in_state[i]) : 0;
+
+			seq_write(m, &time, sizeof(time));
+		}
+	}
+
+	rcu_read_unlock();
+	return 0;
+}
+
 static int concurrent_time_seq_show(struct seq_file *m, void *v,
 	atomic64_t *(*get_times)(struct concurrent_times *))
 {
@@ -311,11 +501,12 @@ static int concurrent_policy_time_seq_show(struct seq_file *m, void *v)
 
 void cpufreq_task_times_init(struct task_struct *p)
 {
+	spinlock_t *lock = task_time_in_state_lock(p);
 	unsigned long flags;
 
-	spin_lock_irqsave(&task_time_in_state_lock, flags);
+	spin_lock_irqsave(lock, flags);
 	p->time_in_state = NULL;
-	spin_unlock_irqrestore(&task_time_in_state_lock, flags);
+	spin_unlock_irqrestore(lock, flags);
 	p->max_state = 0;
 }
 
@@ -330,13 +521,13 @@ void cpufreq_task_times_alloc(struct task_struct *p)
 	if (!temp)
 		return;
 
-	spin_lock_irqsave(&task_time_in_state_lock, flags);
+	spin_lock_irqsave(task_time_in_state_lock(p), flags);
 	p->time_in_state = temp;
-	spin_unlock_irqrestore(&task_time_in_state_lock, flags);
+	spin_unlock_irqrestore(task_time_in_state_lock(p), flags);
 	p->max_state = max_state;
 }
 
-/* Caller must hold task_time_in_state_lock */
+/* Caller must hold task_time_in_state_lock(p) */
 static int cpufreq_task_times_realloc_locked(struct task_struct *p)
 {
 	void *temp;
@@ -360,10 +551,10 @@ void cpufreq_task_times_exit(struct task_struct *p)
 	if (!p->time_in_state)
 		return;
 
-	spin_lock_irqsave(&task_time_in_state_lock, flags);
+	spin_lock_irqsave(task_time_in_state_lock(p), flags);
 	temp = p->time_in_state;
 	p->time_in_state = NULL;
-	spin_unlock_irqrestore(&task_time_in_state_lock, flags);
+	spin_unlock_irqrestore(task_time_in_state_lock(p), flags);
 	kfree(temp);
 }
 
@@ -376,7 +567,7 @@ int proc_time_in_state_show(struct seq_file *m, struct pid_namespace *ns,
 	struct cpu_freqs *freqs;
 	struct cpu_freqs *last_freqs = NULL;
 
-	spin_lock_irqsave(&task_time_in_state_lock, flags);
+	spin_lock_irqsave(task_time_in_state_lock(p), flags);
 	for_each_possible_cpu(cpu) {
 		freqs = all_freqs[cpu];
 		if (!freqs || freqs == last_freqs)
@@ -393,7 +584,7 @@ int proc_time_in_state_show(struct seq_file *m, struct pid_namespace *ns,
 				   (unsigned long)cputime_to_clock_t(cputime));
 		}
 	}
-	spin_unlock_irqrestore(&task_time_in_state_lock, flags);
+	spin_unlock_irqrestore(task_time_in_state_lock(p), flags);
 	return 0;
 }
 
@@ -403,10 +594,7 @@ void cpufreq_acct_update_power(struct task_struct *p, cputime_t cputime)
 	unsigned int state;
 	unsigned int active_cpu_cnt = 0;
 	unsigned int policy_cpu_cnt = 0;
-	unsigned int policy_first_cpu;
-	struct uid_entry *uid_entry;
 	struct cpu_freqs *freqs = all_freqs[task_cpu(p)];
-	struct cpufreq_policy *policy;
 	uid_t uid = from_kuid_munged(current_user_ns(), task_uid(p));
 	int cpu = 0;
 
@@ -415,53 +603,25 @@ void cpufreq_acct_update_power(struct task_struct *p, cputime_t cputime)
 
 	state = freqs->offset + READ_ONCE(freqs->last_index);
 
-	spin_lock_irqsave(&task_time_in_state_lock, flags);
+	spin_lock_irqsave(task_time_in_state_lock(p), flags);
 	if ((state < p->max_state || !cpufreq_task_times_realloc_locked(p)) &&
 	    p->time_in_state)
 		p->time_in_state[state] += cputime;
-	spin_unlock_irqrestore(&task_time_in_state_lock, flags);
-
-	spin_lock_irqsave(&uid_lock, flags);
-	uid_entry = find_or_register_uid_locked(uid);
-	if (uid_entry && state < uid_entry->max_state)
-		uid_entry->time_in_state[state] += cputime;
-	spin_unlock_irqrestore(&uid_lock, flags);
-
-	rcu_read_lock();
-	uid_entry = find_uid_entry_rcu(uid);
-	if (!uid_entry) {
-		rcu_read_unlock();
-		return;
-	}
+	spin_unlock_irqrestore(task_time_in_state_lock(p), flags);
 
 	for_each_possible_cpu(cpu)
 		if (!idle_cpu(cpu))
 			++active_cpu_cnt;
 
-	atomic64_add(cputime,
-		     &uid_entry->concurrent_times->active[active_cpu_cnt - 1]);
-
-	policy = cpufreq_cpu_get(task_cpu(p));
-	if (!policy) {
-		/*
-		 * This CPU may have just come up and not have a cpufreq policy
-		 * yet.
-		 */
-		rcu_read_unlock();
-		return;
-	}
-
-	for_each_cpu(cpu, policy->related_cpus)
+	for_each_cpu(cpu, &freqs->related_cpus)
 		if (!idle_cpu(cpu))
 			++policy_cpu_cnt;
 
-	policy_first_cpu = cpumask_first(policy->related_cpus);
-	cpufreq_cpu_put(policy);
-
-	atomic64_add(cputime,
-		     &uid_entry->concurrent_times->policy[policy_first_cpu +
-							  policy_cpu_cnt - 1]);
-	rcu_read_unlock();
+	local_irq_save(flags);
+	uid_samples_add(uid, state, active_cpu_cnt - 1,
+			cpumask_first(&freqs->related_cpus) + policy_cpu_cnt - 1,
+			cputime);
+	local_irq_restore(flags);
 }
 
 static int cpufreq_times_get_index(struct cpu_freqs *freqs, unsigned int freq)
@@ -507,6 +667,7 @@ void cpufreq_times_create_policy(struct cpufreq_policy *policy)
 	if (index >= 0)
 		WRITE_ONCE(freqs->last_index, index);
 
+	cpumask_copy(&freqs->related_cpus, policy->related_cpus);
 	freqs->offset = next_offset;
 	WRITE_ONCE(next_offset, freqs->offset + count);
 	for_each_cpu(cpu, policy->related_cpus)
@@ -527,6 +688,9 @@ void cpufreq_task_times_remove_uids(uid_t uid_start, uid_t uid_end)
 	struct hlist_node *tmp;
 	unsigned long flags;
 
+	/* Don't let pending ticks bring the removed UIDs back */
+	uid_samples_fold_all();
+
 	spin_lock_irqsave(&uid_lock, flags);
 
 	for (; uid_start <= uid_end; uid_start++) {
@@ -564,11 +728,13 @@ static const struct seq_operations uid_time_in_state_seq_ops = {
 
 static int uid_time_in_state_open(struct inode *inode, struct file *file)
 {
+	uid_samples_fold_all();
 	return seq_open(file, &uid_time_in_state_seq_ops);
 }
 
 int single_uid_time_in_state_open(struct inode *inode, struct file *file)
 {
+	uid_samples_fold_all();
 	return single_open(file, single_uid_time_in_state_show,
 			&(inode->i_uid));
 }
@@ -580,6 +746,26 @@ static const struct file_operations uid_time_in_state_fops = {
 	.release	= seq_release,
 };
 
+static const struct seq_operations uid_time_in_state_bin_seq_ops = {
+	.start = uid_seq_start,
+	.next = uid_seq_next,
+	.stop = uid_seq_stop,
+	.show = uid_time_in_state_bin_seq_show,
+};
+
+static int uid_time_in_state_bin_open(struct inode *inode, struct file *file)
+{
+	uid_samples_fold_all();
+	return seq_open(file, &uid_time_in_state_bin_seq_ops);
+}
+
+static const struct file_operations uid_time_in_state_bin_fops = {
+	.open		= uid_time_in_state_bin_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
 static const struct seq_operations concurrent_active_time_seq_ops = {
 	.start = uid_seq_start,
 	.next = uid_seq_next,
@@ -589,6 +775,7 @@ static const struct seq_operations concurrent_active_time_seq_ops = {
 
 static int concurrent_active_time_open(struct inode *inode, struct file *file)
 {
+	uid_samples_fold_all();
 	return seq_open(file, &concurrent_active_time_seq_ops);
 }
 
@@ -608,6 +795,7 @@ static const struct seq_operations concurrent_policy_time_seq_ops = {
 
 static int concurrent_policy_time_open(struct inode *inode, struct file *file)
 {
+	uid_samples_fold_all();
 	return seq_open(file, &concurrent_policy_time_seq_ops);
 }
 
@@ -620,9 +808,26 @@ static const struct file_operations concurrent_policy_time_fops = {
 
 static int __init cpufreq_times_init(void)
 {
+	int cpu;
+
+	/*
+	 * Nothing is sampled before the first policy is created, which is
+	 * well after this runs.
+	 */
+	for_each_possible_cpu(cpu) {
+		struct uid_samples *us = &per_cpu(uid_samples, cpu);
+
+		spin_lock_init(&us->lock);
+		us->cpu = cpu;
+		INIT_WORK(&us->flush_work, uid_samples_flush_work);
+	}
+
 	proc_create_data("uid_time_in_state", 0444, NULL,
 			 &uid_time_in_state_fops, NULL);
 
+	proc_create_data("uid_time_in_state_bin", 0444, NULL,
+			 &uid_time_in_state_bin_fops, NULL);
+
 	proc_create_data("uid_concurrent_active_time", 0444, NULL,
 			 &concurrent_active_time_fops, NULL);
 
@@ -0,0 +1,554 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2018-2019 Sultan Alsawaf <sultan@kerneltoast.com>.
+ *
+ * Input boost core. A single input handler and framebuffer notifier fan
+ * input and screen state events out to every registered consumer (CPU
+ * frequency, devfreq devices, schedtune). Each consumer boosts along its
+ * own curve: a peak level held after the last input event, followed by an
+ * optional stepped decay. All expiries share one hrtimer, programmed for
+ * the nearest deadline, and one RT thread applies the new levels.
+ */
+
+#define pr_fmt(fmt) "input_boost: " fmt
+
+#include <linux/debugfs.h>
+#include <linux/fb.h>
+#include <linux/hrtimer.h>
+#include <linux/input.h>
+#include <linux/input_boost.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/rculist.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+/* Number of boost transitions kept in the debugfs event log */
+#define IB_LOG_SIZE	256
+
+/* Available bits for boost state */
+enum {
+	SCREEN_OFF,
+	UPDATE_PENDING
+};
+
+struct ib_log_entry {
+	const char *name;
+	u64 ts;
+	u64 kick_ns;
+	unsigned int level;
+	bool max;
+};
+
+struct boost_core {
+	struct list_head consumers;
+	struct mutex consumers_lock;
+	spinlock_t lock;
+	struct hrtimer timer;
+	struct notifier_block fb_notif;
+	wait_queue_head_t boost_waitq;
+	unsigned long state;
+	u64 last_input_ns;
+
+	struct dentry *debugfs_root;
+	struct mutex log_lock;
+	struct ib_log_entry log[IB_LOG_SIZE];
+	unsigned int log_head;
+	unsigned int log_count;
+};
+
+static struct boost_core boost_core_g = {
+	.consumers = LIST_HEAD_INIT(boost_core_g.consumers),
+	.consumers_lock = __MUTEX_INITIALIZER(boost_core_g.consumers_lock),
+	.lock = __SPIN_LOCK_UNLOCKED(boost_core_g.lock),
+	.boost_waitq = __WAIT_QUEUE_HEAD_INITIALIZER(boost_core_g.boost_waitq),
+	.log_lock = __MUTEX_INITIALIZER(boost_core_g.log_lock)
+};
+
+static void input_boost_wake(struct boost_core *ib)
+{
+	set_bit(UPDATE_PENDING, &ib->state);
+	wake_up(&ib->boost_waitq);
+}
+
+static void __input_boost_kick(struct boost_core *ib,
+			       struct input_boost_consumer *c, u64 now)
+{
+	u32 hold_ms = READ_ONCE(c->curve.hold_ms);
+	unsigned long flags;
+	bool wake;
+
+	if (!hold_ms)
+		return;
+
+	spin_lock_irqsave(&ib->lock, flags);
+	c->kick_ns = now;
+	c->hold_until = now + (u64)hold_ms * NSEC_PER_MSEC;
+	/*
+	 * Moving the deadline of a boost already at its peak needs no wakeup,
+	 * the thread looks at the new deadline when the old one expires.
+	 */
+	wake = c->level != min_t(u32, READ_ONCE(c->curve.level),
+				 INPUT_BOOST_LEVEL_SCALE);
+	spin_unlock_irqrestore(&ib->lock, flags);
+
+	if (wake)
+		input_boost_wake(ib);
+}
+
+void input_boost_kick(struct input_boost_consumer *c)
+{
+	struct boost_core *ib = &boost_core_g;
+
+	if (test_bit(SCREEN_OFF, &ib->state))
+		return;
+
+	__input_boost_kick(ib, c, ktime_get_ns());
+}
+
+static void __input_boost_kick_max(struct boost_core *ib,
+				   struct input_boost_consumer *c,
+				   unsigned int duration_ms)
+{
+	u64 now = ktime_get_ns(), new_expires;
+	unsigned long flags;
+	bool wake = false;
+
+	new_expires = now + (u64)duration_ms * NSEC_PER_MSEC;
+
+	spin_lock_irqsave(&ib->lock, flags);
+	/* Skip this boost if there's a longer boost in effect */
+	if (new_expires > c->max_until) {
+		c->kick_ns = now;
+		c->max_until = new_expires;
+		wake = !c->max;
+	}
+	spin_unlock_irqrestore(&ib->lock, flags);
+
+	if (wake)
+		input_boost_wake(ib);
+}
+
+void input_boost_kick_max(struct input_boost_consumer *c,
+			  unsigned int duration_ms)
+{
+	struct boost_core *ib = &boost_core_g;
+
+	if (test_bit(SCREEN_OFF, &ib->state))
+		return;
+
+	__input_boost_kick_max(ib, c, duration_ms);
+}
+
+void input_boost_kick_wake(struct input_boost_consumer *c)
+{
+	struct boost_core *ib = &boost_core_g;
+	u32 wake_ms = READ_ONCE(c->curve.wake_ms);
+
+	if (!test_bit(SCREEN_OFF, &ib->state) || !wake_ms)
+		return;
+
+	__input_boost_kick_max(ib, c, wake_ms);
+}
+
+bool input_boost_within_input(unsigned long timeout_ms)
+{
+	struct boost_core *ib = &boost_core_g;
+
+	return ktime_get_ns() < READ_ONCE(ib->last_input_ns) +
+				(u64)timeout_ms * NSEC_PER_MSEC;
+}
+
+/*
+ * Returns the input boost level of @c at @now and lowers @next to the time
+ * that level changes. Called with the core lock held.
+ */
+static unsigned int input_boost_curve_level(struct input_boost_consumer *c,
+					    u64 now, u64 *next)
+{
+	const struct input_boost_curve *cv = &c->curve;
+	unsigned int peak = min_t(u32, READ_ONCE(cv->level),
+				  INPUT_BOOST_LEVEL_SCALE);
+	u64 decay_ns = (u64)READ_ONCE(cv->decay_ms) * NSEC_PER_MSEC;
+	u32 steps = max_t(u32, READ_ONCE(cv->decay_steps), 1);
+	u64 step_ns, step;
+
+	if (!c->hold_until)
+		return 0;
+
+	if (now < c->hold_until) {
+		*next = min(*next, c->hold_until);
+		return peak;
+	}
+
+	if (now >= c->hold_until + decay_ns)
+		return 0;
+
+	step_ns = div_u64(decay_ns, steps);
+	if (!step_ns) {
+		step_ns = decay_ns;
+		steps = 1;
+	}
+
+	/* Drop a notch at the start of each step, reaching zero at the end */
+	step = div64_u64(now - c->hold_until, step_ns);
+	if (step >= steps)
+		return 0;
+
+	*next = min(*next, c->hold_until + (step + 1) * step_ns);
+	return div_u64((u64)peak * (steps - step), steps + 1);
+}
+
+static void input_boost_log(struct boost_core *ib,
+			    struct input_boost_consumer *c, u64 kick_ns,
+			    unsigned int level, bool max)
+{
+	struct ib_log_entry *e;
+
+	mutex_lock(&ib->log_lock);
+	e = &ib->log[ib->log_head];
+	e->name = c->name;
+	e->ts = ktime_get_ns();
+	e->kick_ns = kick_ns;
+	e->level = level;
+	e->max = max;
+	ib->log_head = (ib->log_head + 1) % IB_LOG_SIZE;
+	if (ib->log_count < IB_LOG_SIZE)
+		ib->log_count++;
+	mutex_unlock(&ib->log_lock);
+}
+
+static void input_boost_update(struct boost_core *ib)
+{
+	struct input_boost_consumer *c;
+	u64 now, next = U64_MAX;
+
+	mutex_lock(&ib->consumers_lock);
+	now = ktime_get_ns();
+	list_for_each_entry(c, &ib->consumers, node) {
+		unsigned int level;
+		bool max, changed;
+		u64 kick_ns;
+
+		spin_lock_irq(&ib->lock);
+		level = input_boost_curve_level(c, now, &next);
+		max = now < c->max_until;
+		if (max)
+			next = min(next, c->max_until);
+		changed = level != c->level || max != c->max;
+		c->level = level;
+		c->max = max;
+		kick_ns = c->kick_ns;
+		spin_unlock_irq(&ib->lock);
+
+		if (!changed)
+			continue;
+
+		c->apply(c, level, max);
+		input_boost_log(ib, c, kick_ns, level, max);
+	}
+
+	if (next != U64_MAX)
+		hrtimer_start(&ib->timer, ns_to_ktime(next), HRTIMER_MODE_ABS);
+	mutex_unlock(&ib->consumers_lock);
+}
+
+static enum hrtimer_restart input_boost_timer_fn(struct hrtimer *timer)
+{
+	struct boost_core *ib = container_of(timer, typeof(*ib), timer);
+
+	input_boost_wake(ib);
+	return HRTIMER_NORESTART;
+}
+
+static int input_boost_thread(void *data)
+{
+	static const struct sched_param sched_max_rt_prio = {
+		.sched_priority = MAX_RT_PRIO - 1
+	};
+	struct boost_core *ib = data;
+
+	sched_setscheduler_nocheck(current, SCHED_FIFO, &sched_max_rt_prio);
+
+	while (1) {
+		bool should_stop = false;
+
+		wait_event(ib->boost_waitq,
+			test_bit(UPDATE_PENDING, &ib->state) ||
+			(should_stop = kthread_should_stop()));
+
+		if (should_stop)
+			break;
+
+		clear_bit(UPDATE_PENDING, &ib->state);
+		input_boost_update(ib);
+	}
+
+	return 0;
+}
+
+static int fb_notifier_cb(struct notifier_block *nb, unsigned long action,
+			  void *data)
+{
+	struct boost_core *ib = container_of(nb, typeof(*ib), fb_notif);
+	int *blank = ((struct fb_event *)data)->data;
+	struct input_boost_consumer *c;
+
+	/* Parse framebuffer blank events as soon as they occur */
+	if (action != FB_EARLY_EVENT_BLANK)
+		return NOTIFY_OK;
+
+	/* Boost when the screen turns on and unboost when it turns off */
+	mutex_lock(&ib->consumers_lock);
+	if (*blank == FB_BLANK_UNBLANK) {
+		list_for_each_entry(c, &ib->consumers, node)
+			input_boost_kick_wake(c);
+		clear_bit(SCREEN_OFF, &ib->state);
+	} else {
+		set_bit(SCREEN_OFF, &ib->state);
+		spin_lock_irq(&ib->lock);
+		list_for_each_entry(c, &ib->consumers, node) {
+			c->hold_until = 0;
+			c->max_until = 0;
+		}
+		spin_unlock_irq(&ib->lock);
+		input_boost_wake(ib);
+	}
+	mutex_unlock(&ib->consumers_lock);
+
+	return NOTIFY_OK;
+}
+
+static void input_boost_input_event(struct input_handle *handle,
+				    unsigned int type, unsigned int code,
+				    int value)
+{
+	struct boost_core *ib = handle->handler->private;
+	struct input_boost_consumer *c;
+	u64 now = ktime_get_ns();
+
+	WRITE_ONCE(ib->last_input_ns, now);
+
+	if (test_bit(SCREEN_OFF, &ib->state))
+		return;
+
+	/* Consumers are only ever added, never removed */
+	rcu_read_lock();
+	list_for_each_entry_rcu(c, &ib->consumers, node)
+		__input_boost_kick(ib, c, now);
+	rcu_read_unlock();
+}
+
+static int input_boost_input_connect(struct input_handler *handler,
+				     struct input_dev *dev,
+				     const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int ret;
+
+	handle = kzalloc(sizeof(*handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "input_boost_handle";
+
+	ret = input_register_handle(handle);
+	if (ret)
+		goto free_handle;
+
+	ret = input_open_device(handle);
+	if (ret)
+		goto unregister_handle;
+
+	return 0;
+
+unregister_handle:
+	input_unregister_handle(handle);
+free_handle:
+	kfree(handle);
+	return ret;
+}
+
+static void input_boost_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+static const struct input_device_id input_boost_ids[] = {
+	/* Multi-touch touchscreen */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+			BIT_MASK(ABS_MT_POSITION_X) |
+			BIT_MASK(ABS_MT_POSITION_Y) }
+	},
+	/* Touchpad */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_KEYBIT |
+			INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+		.absbit = { [BIT_WORD(ABS_X)] =
+			BIT_MASK(ABS_X) | BIT_MASK(ABS_Y) }
+	},
+	/* Keypad */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT,
+		.evbit = { BIT_MASK(EV_KEY) }
+	},
+	{ }
+};
+
+static struct input_handler input_boost_input_handler = {
+	.event		= input_boost_input_event,
+	.connect	= input_boost_input_connect,
+	.disconnect	= input_boost_input_disconnect,
+	.name		= "input_boost_handler",
+	.id_table	= input_boost_ids
+};
+
+static int input_boost_events_show(struct seq_file *m, void *v)
+{
+	struct boost_core *ib = m->private;
+	unsigned int i, idx;
+
+	seq_puts(m, "# time_us consumer level max kick_to_apply_us\n");
+
+	mutex_lock(&ib->log_lock);
+	idx = (ib->log_head + IB_LOG_SIZE - ib->log_count) % IB_LOG_SIZE;
+	for (i = 0; i < ib->log_count; i++) {
+		const struct ib_log_entry *e = &ib->log[idx];
+
+		seq_printf(m, "%llu %s %u %d %llu\n",
+			   div_u64(e->ts, NSEC_PER_USEC), e->name, e->level,
+			   e->max, div_u64(e->ts - e->kick_ns, NSEC_PER_USEC));
+		idx = (idx + 1) % IB_LOG_SIZE;
+	}
+	mutex_unlock(&ib->log_lock);
+
+	return 0;
+}
+
+static int input_boost_events_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, input_boost_events_show, inode->i_private);
+}
+
+static const struct file_operations input_boost_events_fops = {
+	.open		= input_boost_events_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void input_boost_debugfs_add(struct boost_core *ib,
+				    struct input_boost_consumer *c)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir(c->name, ib->debugfs_root);
+	if (IS_ERR_OR_NULL(dir))
+		return;
+
+	debugfs_create_u32("level", 0644, dir, &c->curve.level);
+	debugfs_create_u32("hold_ms", 0644, dir, &c->curve.hold_ms);
+	debugfs_create_u32("decay_ms", 0644, dir, &c->curve.decay_ms);
+	debugfs_create_u32("decay_steps", 0644, dir, &c->curve.decay_steps);
+	debugfs_create_u32("wake_ms", 0644, dir, &c->curve.wake_ms);
+}
+
+/**
+ * input_boost_register - start boosting a consumer on input
+ * @c: consumer with its name, apply callback and curve filled in
+ *
+ * Consumers may register from any initcall level, before or after the
+ * core itself is up, and stay registered for good.
+ */
+int input_boost_register(struct input_boost_consumer *c)
+{
+	struct boost_core *ib = &boost_core_g;
+
+	if (!c->name || !c->apply)
+		return -EINVAL;
+
+	mutex_lock(&ib->consumers_lock);
+	spin_lock_irq(&ib->lock);
+	list_add_tail_rcu(&c->node, &ib->consumers);
+	spin_unlock_irq(&ib->lock);
+	if (ib->debugfs_root)
+		input_boost_debugfs_add(ib, c);
+	mutex_unlock(&ib->consumers_lock);
+
+	return 0;
+}
+
+static void input_boost_debugfs_init(struct boost_core *ib)
+{
+	struct input_boost_consumer *c;
+	struct dentry *root;
+
+	root = debugfs_create_dir("input_boost", NULL);
+	if (IS_ERR_OR_NULL(root))
+		return;
+
+	debugfs_create_file("events", 0444, root, ib,
+			    &input_boost_events_fops);
+
+	mutex_lock(&ib->consumers_lock);
+	ib->debugfs_root = root;
+	list_for_each_entry(c, &ib->consumers, node)
+		input_boost_debugfs_add(ib, c);
+	mutex_unlock(&ib->consumers_lock);
+}
+
+static int __init input_boost_init(void)
+{
+	struct boost_core *ib = &boost_core_g;
+	struct task_struct *thread;
+	int ret;
+
+	hrtimer_init(&ib->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	ib->timer.function = input_boost_timer_fn;
+
+	thread = kthread_run(input_boost_thread, ib, "input_boostd");
+	if (IS_ERR(thread)) {
+		ret = PTR_ERR(thread);
+		pr_err("Failed to start boost thread, err: %d\n", ret);
+		return ret;
+	}
+
+	input_boost_input_handler.private = ib;
+	ret = input_register_handler(&input_boost_input_handler);
+	if (ret) {
+		pr_err("Failed to register input handler, err: %d\n", ret);
+		goto stop_kthread;
+	}
+
+	ib->fb_notif.notifier_call = fb_notifier_cb;
+	ib->fb_notif.priority = INT_MAX;
+	ret = fb_register_client(&ib->fb_notif);
+	if (ret) {
+		pr_err("Failed to register fb notifier, err: %d\n", ret);
+		goto unregister_handler;
+	}
+
+	input_boost_debugfs_init(ib);
+
+	/* Apply anything kicked by consumers that registered before us */
+	input_boost_wake(ib);
+
+	return 0;
+
+unregister_handler:
+	input_unregister_handler(&input_boost_input_handler);
+stop_kthread:
+	kthread_stop(thread);
+	return ret;
+}
+subsys_initcall(input_boost_init);
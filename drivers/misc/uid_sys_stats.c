@@ -28,6 +28,7 @@
 #include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
+#include <uapi/linux/uid_sys_stats.h>
 
 
 #define UID_HASH_BITS	10
@@ -37,6 +38,7 @@ static DEFINE_RT_MUTEX(uid_lock);
 static struct proc_dir_entry *cpu_parent;
 static struct proc_dir_entry *io_parent;
 static struct proc_dir_entry *proc_parent;
+static struct proc_dir_entry *stats_entry;
 
 struct io_stats {
 	u64 read_bytes;
@@ -329,7 +331,33 @@ static struct uid_entry *find_or_register_uid(uid_t uid)
 	return uid_entry;
 }
 
-static int uid_cputime_show(struct seq_file *m, void *v)
+static void add_uid_io_stats(struct uid_entry *uid_entry,
+			struct task_struct *task, int slot)
+{
+	struct io_stats *io_slot = &uid_entry->io[slot];
+
+	io_slot->read_bytes += task->ioac.read_bytes;
+	io_slot->write_bytes += compute_write_bytes(task);
+	io_slot->rchar += task->ioac.rchar;
+	io_slot->wchar += task->ioac.wchar;
+	io_slot->fsync += task->ioac.syscfs;
+
+	add_uid_tasks_io_stats(uid_entry, task, slot);
+}
+
+static u64 uid_cputime_to_us(cputime_t cputime)
+{
+	return (u64)jiffies_to_msecs(cputime_to_jiffies(cputime)) *
+		USEC_PER_MSEC;
+}
+
+/*
+ * Exited tasks are already folded into utime, stime and the dead io slot
+ * of their uid by process_notifier(), so only live tasks are walked here.
+ * Their cputime is recomputed into active_utime/active_stime and their io
+ * is turned into per-state deltas, for all uids in a single pass.
+ */
+static int update_stats_all_locked(void)
 {
 	struct uid_entry *uid_entry = NULL;
 	struct task_struct *task, *temp;
@@ -338,12 +366,14 @@ static int uid_cputime_show(struct seq_file *m, void *v)
 	cputime_t stime;
 	unsigned long bkt;
 	uid_t uid;
-
-	rt_mutex_lock(&uid_lock);
+	int ret = 0;
 
 	hash_for_each(hash_table, bkt, uid_entry, hash) {
 		uid_entry->active_stime = 0;
 		uid_entry->active_utime = 0;
+		memset(&uid_entry->io[UID_STATE_TOTAL_CURR], 0,
+			sizeof(struct io_stats));
+		set_io_uid_tasks_zero(uid_entry);
 	}
 
 	rcu_read_lock();
@@ -352,28 +382,54 @@ static int uid_cputime_show(struct seq_file *m, void *v)
 		if (!uid_entry || uid_entry->uid != uid)
 			uid_entry = find_or_register_uid(uid);
 		if (!uid_entry) {
-			rcu_read_unlock();
-			rt_mutex_unlock(&uid_lock);
-			pr_err("%s: failed to find the uid_entry for uid %d\n",
+			pr_err_ratelimited("%s: failed to find the uid_entry for uid %d\n",
 				__func__, uid);
-			return -ENOMEM;
+			ret = -ENOMEM;
+			continue;
 		}
 		task_cputime_adjusted(task, &utime, &stime);
 		uid_entry->active_utime += utime;
 		uid_entry->active_stime += stime;
+		add_uid_io_stats(uid_entry, task, UID_STATE_TOTAL_CURR);
 	} while_each_thread(temp, task);
 	rcu_read_unlock();
 
+	hash_for_each(hash_table, bkt, uid_entry, hash) {
+		compute_io_bucket_stats(&uid_entry->io[uid_entry->state],
+					&uid_entry->io[UID_STATE_TOTAL_CURR],
+					&uid_entry->io[UID_STATE_TOTAL_LAST],
+					&uid_entry->io[UID_STATE_DEAD_TASKS]);
+		compute_io_uid_tasks(uid_entry);
+	}
+
+	return ret;
+}
+
+static int uid_cputime_show(struct seq_file *m, void *v)
+{
+	struct uid_entry *uid_entry;
+	unsigned long bkt;
+	int ret;
+
+	rt_mutex_lock(&uid_lock);
+
+	ret = update_stats_all_locked();
+	if (ret) {
+		rt_mutex_unlock(&uid_lock);
+		return ret;
+	}
+
 	hash_for_each(hash_table, bkt, uid_entry, hash) {
 		cputime_t total_utime = uid_entry->utime +
 							uid_entry->active_utime;
 		cputime_t total_stime = uid_entry->stime +
 							uid_entry->active_stime;
-		seq_printf(m, "%d: %llu %llu\n", uid_entry->uid,
-			(unsigned long long)jiffies_to_msecs(
-				cputime_to_jiffies(total_utime)) * USEC_PER_MSEC,
-			(unsigned long long)jiffies_to_msecs(
-				cputime_to_jiffies(total_stime)) * USEC_PER_MSEC);
+
+		seq_put_decimal_ll(m, "", (int)uid_entry->uid);
+		seq_putc(m, ':');
+		seq_put_decimal_ull(m, " ", uid_cputime_to_us(total_utime));
+		seq_put_decimal_ull(m, " ", uid_cputime_to_us(total_stime));
+		seq_putc(m, '\n');
 	}
 
 	rt_mutex_unlock(&uid_lock);
@@ -451,54 +507,6 @@ static const struct file_operations uid_remove_fops = {
 };
 
 
-static void add_uid_io_stats(struct uid_entry *uid_entry,
-			struct task_struct *task, int slot)
-{
-	struct io_stats *io_slot = &uid_entry->io[slot];
-
-	io_slot->read_bytes += task->ioac.read_bytes;
-	io_slot->write_bytes += compute_write_bytes(task);
-	io_slot->rchar += task->ioac.rchar;
-	io_slot->wchar += task->ioac.wchar;
-	io_slot->fsync += task->ioac.syscfs;
-
-	add_uid_tasks_io_stats(uid_entry, task, slot);
-}
-
-static void update_io_stats_all_locked(void)
-{
-	struct uid_entry *uid_entry = NULL;
-	struct task_struct *task, *temp;
-	struct user_namespace *user_ns = current_user_ns();
-	unsigned long bkt;
-	uid_t uid;
-
-	hash_for_each(hash_table, bkt, uid_entry, hash) {
-		memset(&uid_entry->io[UID_STATE_TOTAL_CURR], 0,
-			sizeof(struct io_stats));
-		set_io_uid_tasks_zero(uid_entry);
-	}
-
-	rcu_read_lock();
-	do_each_thread(temp, task) {
-		uid = from_kuid_munged(user_ns, task_uid(task));
-		if (!uid_entry || uid_entry->uid != uid)
-			uid_entry = find_or_register_uid(uid);
-		if (!uid_entry)
-			continue;
-		add_uid_io_stats(uid_entry, task, UID_STATE_TOTAL_CURR);
-	} while_each_thread(temp, task);
-	rcu_read_unlock();
-
-	hash_for_each(hash_table, bkt, uid_entry, hash) {
-		compute_io_bucket_stats(&uid_entry->io[uid_entry->state],
-					&uid_entry->io[UID_STATE_TOTAL_CURR],
-					&uid_entry->io[UID_STATE_TOTAL_LAST],
-					&uid_entry->io[UID_STATE_DEAD_TASKS]);
-		compute_io_uid_tasks(uid_entry);
-	}
-}
-
 static void update_io_stats_uid_locked(struct uid_entry *uid_entry)
 {
 	struct task_struct *task, *temp;
@@ -531,21 +539,25 @@ static int uid_io_show(struct seq_file *m, void *v)
 
 	rt_mutex_lock(&uid_lock);
 
-	update_io_stats_all_locked();
+	/* A uid that could not be registered is only missing from the list */
+	update_stats_all_locked();
 
 	hash_for_each(hash_table, bkt, uid_entry, hash) {
-		seq_printf(m, "%d %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu\n",
-				uid_entry->uid,
-				uid_entry->io[UID_STATE_FOREGROUND].rchar,
-				uid_entry->io[UID_STATE_FOREGROUND].wchar,
-				uid_entry->io[UID_STATE_FOREGROUND].read_bytes,
-				uid_entry->io[UID_STATE_FOREGROUND].write_bytes,
-				uid_entry->io[UID_STATE_BACKGROUND].rchar,
-				uid_entry->io[UID_STATE_BACKGROUND].wchar,
-				uid_entry->io[UID_STATE_BACKGROUND].read_bytes,
-				uid_entry->io[UID_STATE_BACKGROUND].write_bytes,
-				uid_entry->io[UID_STATE_FOREGROUND].fsync,
-				uid_entry->io[UID_STATE_BACKGROUND].fsync);
+		struct io_stats *fg = &uid_entry->io[UID_STATE_FOREGROUND];
+		struct io_stats *bg = &uid_entry->io[UID_STATE_BACKGROUND];
+
+		seq_put_decimal_ll(m, "", (int)uid_entry->uid);
+		seq_put_decimal_ull(m, " ", fg->rchar);
+		seq_put_decimal_ull(m, " ", fg->wchar);
+		seq_put_decimal_ull(m, " ", fg->read_bytes);
+		seq_put_decimal_ull(m, " ", fg->write_bytes);
+		seq_put_decimal_ull(m, " ", bg->rchar);
+		seq_put_decimal_ull(m, " ", bg->wchar);
+		seq_put_decimal_ull(m, " ", bg->read_bytes);
+		seq_put_decimal_ull(m, " ", bg->write_bytes);
+		seq_put_decimal_ull(m, " ", fg->fsync);
+		seq_put_decimal_ull(m, " ", bg->fsync);
+		seq_putc(m, '\n');
 
 		show_io_uid_tasks(m, uid_entry);
 	}
@@ -566,6 +578,85 @@ static const struct file_operations uid_io_fops = {
 	.release	= single_release,
 };
 
+static void fill_io_record(struct uid_sys_stats_io *rec, struct io_stats *io)
+{
+	rec->rchar = io->rchar;
+	rec->wchar = io->wchar;
+	rec->read_bytes = io->read_bytes;
+	rec->write_bytes = io->write_bytes;
+	rec->fsync = io->fsync;
+}
+
+static int uid_stats_show(struct seq_file *m, void *v)
+{
+	struct uid_sys_stats_header hdr = {
+		.magic = UID_SYS_STATS_MAGIC,
+		.version = UID_SYS_STATS_VERSION,
+		.record_size = sizeof(struct uid_sys_stats_record),
+	};
+	struct uid_entry *uid_entry;
+	unsigned long bkt;
+	int ret;
+
+	rt_mutex_lock(&uid_lock);
+
+	ret = update_stats_all_locked();
+	if (ret) {
+		rt_mutex_unlock(&uid_lock);
+		return ret;
+	}
+
+	hash_for_each(hash_table, bkt, uid_entry, hash)
+		hdr.nr_records++;
+	seq_write(m, &hdr, sizeof(hdr));
+
+	hash_for_each(hash_table, bkt, uid_entry, hash) {
+		struct uid_sys_stats_record rec = {
+			.uid = uid_entry->uid,
+			.state = uid_entry->state,
+			.utime_us = uid_cputime_to_us(uid_entry->utime +
+						      uid_entry->active_utime),
+			.stime_us = uid_cputime_to_us(uid_entry->stime +
+						      uid_entry->active_stime),
+		};
+
+		fill_io_record(&rec.io[UID_SYS_STATS_FOREGROUND],
+			       &uid_entry->io[UID_STATE_FOREGROUND]);
+		fill_io_record(&rec.io[UID_SYS_STATS_BACKGROUND],
+			       &uid_entry->io[UID_STATE_BACKGROUND]);
+		seq_write(m, &rec, sizeof(rec));
+	}
+
+	rt_mutex_unlock(&uid_lock);
+	return 0;
+}
+
+static int uid_stats_open(struct inode *inode, struct file *file)
+{
+	struct uid_entry *uid_entry;
+	unsigned long bkt;
+	size_t size = sizeof(struct uid_sys_stats_header);
+
+	/*
+	 * seq_read() runs the whole walk again whenever the buffer turns out
+	 * to be too small, so size it for the current uids plus some slack.
+	 */
+	rt_mutex_lock(&uid_lock);
+	hash_for_each(hash_table, bkt, uid_entry, hash)
+		size += sizeof(struct uid_sys_stats_record);
+	rt_mutex_unlock(&uid_lock);
+	size += 64 * sizeof(struct uid_sys_stats_record);
+
+	return single_open_size(file, uid_stats_show, PDE_DATA(inode), size);
+}
+
+static const struct file_operations uid_stats_fops = {
+	.open		= uid_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int uid_procstat_open(struct inode *inode, struct file *file)
 {
 	return single_open(file, NULL, NULL);
@@ -692,6 +783,14 @@ static int __init proc_uid_sys_stats_init(void)
 	proc_create_data("set", 0222, proc_parent,
 		&uid_procstat_fops, NULL);
 
+	stats_entry = proc_create_data("uid_sys_stats", 0444, NULL,
+		&uid_stats_fops, NULL);
+	if (!stats_entry) {
+		pr_err("%s: failed to create uid_sys_stats proc entry\n",
+			__func__);
+		goto err;
+	}
+
 	profile_event_register(PROFILE_TASK_EXIT, &process_notifier_block);
 
 	return 0;
@@ -700,6 +799,7 @@ static int __init proc_uid_sys_stats_init(void)
 	remove_proc_subtree("uid_cputime", NULL);
 	remove_proc_subtree("uid_io", NULL);
 	remove_proc_subtree("uid_procstat", NULL);
+	remove_proc_entry("uid_sys_stats", NULL);
 	return -ENOMEM;
 }
 
@@ -21,11 +21,40 @@
 #include <linux/fs.h>
 #include <linux/list.h>
 #include <linux/init.h>
+#include <linux/jiffies.h>
+#include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/vmalloc.h>
+#include <linux/vmpressure.h>
 #include "ion_priv.h"
 
+/*
+ * Pools with refill enabled are topped up to refill_high_kb by a worker
+ * whenever they drop below refill_low_kb, so that allocations find zeroed
+ * pages instead of allocating and zeroing them on the spot. The worker
+ * only takes free memory and stays idle while vmpressure is at or above
+ * refill_max_pressure.
+ *
+ * The watermarks apply to every pool of every order, so refill is off
+ * until the platform sets them, typically from vendor init.
+ */
+static unsigned int refill_low_kb;
+module_param(refill_low_kb, uint, 0644);
+
+static unsigned int refill_high_kb;
+module_param(refill_high_kb, uint, 0644);
+
+static unsigned int refill_max_pressure = 40;
+module_param(refill_max_pressure, uint, 0644);
+
+/* How long a vmpressure report keeps the refill worker away */
+#define ION_POOL_PRESSURE_HOLD	HZ
+
+static struct workqueue_struct *ion_pool_refill_wq;
+static unsigned long last_pressure;
+static unsigned long last_pressure_jiffies;
+
 static void *ion_page_pool_alloc_pages(struct ion_page_pool *pool)
 {
 	struct page *page;
@@ -96,6 +125,22 @@ static struct page *ion_page_pool_remove(struct ion_page_pool *pool, bool high)
 	return page;
 }
 
+/* Number of items below which the refill worker is kicked */
+static int ion_page_pool_wmark(struct ion_page_pool *pool, unsigned int kb)
+{
+	return kb >> (PAGE_SHIFT - 10 + pool->order);
+}
+
+static void ion_page_pool_kick_refill(struct ion_page_pool *pool)
+{
+	if (!pool->refill || !ion_pool_refill_wq)
+		return;
+
+	if (pool->high_count + pool->low_count <
+	    ion_page_pool_wmark(pool, READ_ONCE(refill_low_kb)))
+		queue_work(ion_pool_refill_wq, &pool->refill_work);
+}
+
 void *ion_page_pool_alloc(struct ion_page_pool *pool, bool *from_pool)
 {
 	struct page *page = NULL;
@@ -111,9 +156,15 @@ void *ion_page_pool_alloc(struct ion_page_pool *pool, bool *from_pool)
 			page = ion_page_pool_remove(pool, false);
 		mutex_unlock(&pool->mutex);
 	}
+
+	ion_page_pool_kick_refill(pool);
+
 	if (!page) {
+		atomic_long_inc(&pool->misses);
 		page = ion_page_pool_alloc_pages(pool);
 		*from_pool = false;
+	} else {
+		atomic_long_inc(&pool->hits);
 	}
 	return page;
 }
@@ -197,10 +248,84 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 	return freed;
 }
 
+static bool ion_page_pool_under_pressure(void)
+{
+	if (time_after(jiffies, READ_ONCE(last_pressure_jiffies) +
+				ION_POOL_PRESSURE_HOLD))
+		return false;
+
+	return READ_ONCE(last_pressure) >= READ_ONCE(refill_max_pressure);
+}
+
+/* Allocate an item off the allocating path, zeroed and synced for dma */
+static struct page *ion_page_pool_refill_page(struct ion_page_pool *pool)
+{
+	gfp_t gfp_mask = pool->gfp_mask & ~(__GFP_ZERO | __GFP_RECLAIM);
+	struct page *page;
+
+	page = alloc_pages(gfp_mask | __GFP_NOWARN, pool->order);
+	if (!page)
+		return NULL;
+
+	if (msm_ion_heap_high_order_page_zero(pool->dev, page, pool->order)) {
+		__free_pages(page, pool->order);
+		return NULL;
+	}
+
+	ion_page_pool_alloc_set_cache_policy(pool, page);
+	mod_node_page_state(page_pgdat(page), NR_ION_HEAP,
+				1 << pool->order);
+
+	return page;
+}
+
+static void ion_page_pool_refill(struct work_struct *work)
+{
+	struct ion_page_pool *pool = container_of(work, struct ion_page_pool,
+						  refill_work);
+	int target = ion_page_pool_wmark(pool, READ_ONCE(refill_high_kb));
+
+	while (pool->high_count + pool->low_count < target) {
+		struct page *page;
+		u64 start, delta;
+
+		if (ion_page_pool_under_pressure()) {
+			pool->refill_backoffs++;
+			break;
+		}
+
+		start = sched_clock();
+		page = ion_page_pool_refill_page(pool);
+		if (!page)
+			break;
+		delta = sched_clock() - start;
+
+		ion_page_pool_add(pool, page);
+		pool->refilled++;
+		pool->refill_ns += delta;
+		if (delta > pool->refill_max_ns)
+			pool->refill_max_ns = delta;
+
+		cond_resched();
+	}
+}
+
+/**
+ * ion_page_pool_enable_refill - keep a pool stocked in the background
+ * @pool:		the pool
+ *
+ * Only for pools whose items are handed out as is, i.e. zeroed and with
+ * no other preparation needed before use.
+ */
+void ion_page_pool_enable_refill(struct ion_page_pool *pool)
+{
+	pool->refill = true;
+}
+
 struct ion_page_pool *ion_page_pool_create(struct device *dev, gfp_t gfp_mask,
 					   unsigned int order)
 {
-	struct ion_page_pool *pool = kmalloc(sizeof(*pool), GFP_KERNEL);
+	struct ion_page_pool *pool = kzalloc(sizeof(*pool), GFP_KERNEL);
 
 	if (!pool)
 		return NULL;
@@ -213,17 +338,41 @@ struct ion_page_pool *ion_page_pool_create(struct device *dev, gfp_t gfp_mask,
 	pool->order = order;
 	mutex_init(&pool->mutex);
 	plist_node_init(&pool->list, order);
+	INIT_WORK(&pool->refill_work, ion_page_pool_refill);
+	atomic_long_set(&pool->hits, 0);
+	atomic_long_set(&pool->misses, 0);
 
 	return pool;
 }
 
 void ion_page_pool_destroy(struct ion_page_pool *pool)
 {
+	cancel_work_sync(&pool->refill_work);
 	kfree(pool);
 }
 
+static int ion_page_pool_vmpressure(struct notifier_block *nb,
+				    unsigned long action, void *data)
+{
+	WRITE_ONCE(last_pressure, action);
+	WRITE_ONCE(last_pressure_jiffies, jiffies);
+
+	return 0;
+}
+
+static struct notifier_block ion_page_pool_vmpr_nb = {
+	.notifier_call = ion_page_pool_vmpressure,
+};
+
 static int __init ion_page_pool_init(void)
 {
+	ion_pool_refill_wq = alloc_workqueue("ion_pool_refill",
+					     WQ_UNBOUND | WQ_FREEZABLE, 0);
+	if (!ion_pool_refill_wq)
+		pr_err("%s: no refill workqueue, pools are filled on free only\n",
+		       __func__);
+
+	vmpressure_notifier_register(&ion_page_pool_vmpr_nb);
 	return 0;
 }
 device_initcall(ion_page_pool_init);
@@ -30,6 +30,7 @@
 #include <linux/sched.h>
 #include <linux/shrinker.h>
 #include <linux/types.h>
+#include <linux/workqueue.h>
 #ifdef CONFIG_ION_POOL_CACHE_POLICY
 #include <asm/cacheflush.h>
 #endif
@@ -461,6 +462,15 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
  * @gfp_mask:		gfp_mask to use from alloc
  * @order:		order of pages in the pool
  * @list:		plist node for list of pools
+ * @refill:		refill the pool in the background, see
+ *			ion_page_pool_enable_refill()
+ * @refill_work:	work item refilling the pool
+ * @hits:		allocations served from the pool
+ * @misses:		allocations that fell back to the page allocator
+ * @refilled:		items added by the refill work
+ * @refill_ns:		time spent allocating and zeroing refilled items
+ * @refill_max_ns:	longest time spent on a single refilled item
+ * @refill_backoffs:	refills abandoned because of memory pressure
  *
  * Allows you to keep a pool of pre allocated pages to use from your heap.
  * Keeping a pool of pages that is ready for dma, ie any cached mapping have
@@ -477,11 +487,20 @@ struct ion_page_pool {
 	gfp_t gfp_mask;
 	unsigned int order;
 	struct plist_node list;
+	bool refill;
+	struct work_struct refill_work;
+	atomic_long_t hits;
+	atomic_long_t misses;
+	unsigned long refilled;
+	u64 refill_ns;
+	u64 refill_max_ns;
+	unsigned long refill_backoffs;
 };
 
 struct ion_page_pool *ion_page_pool_create(struct device *dev, gfp_t gfp_mask,
 					   unsigned int order);
 void ion_page_pool_destroy(struct ion_page_pool *);
+void ion_page_pool_enable_refill(struct ion_page_pool *pool);
 void *ion_page_pool_alloc(struct ion_page_pool *a, bool *from_pool);
 void *ion_page_pool_alloc_pool_only(struct ion_page_pool *a);
 void ion_page_pool_free(struct ion_page_pool *a, struct page *b);
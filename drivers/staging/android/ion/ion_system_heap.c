@@ -683,6 +683,24 @@ static struct ion_heap_ops system_heap_ops = {
 	.shrink = ion_system_heap_shrink,
 };
 
+static void ion_system_heap_pool_stats_show(struct seq_file *s,
+					    struct ion_page_pool *pool,
+					    const char *name)
+{
+	u64 refill_avg_us = 0;
+
+	if (pool->refilled)
+		refill_avg_us = div64_u64(pool->refill_ns,
+					  pool->refilled * NSEC_PER_USEC);
+
+	seq_printf(s,
+		   "order %u %s pool: hits %ld misses %ld refilled %lu refill avg %llu us max %llu us backoffs %lu\n",
+		   pool->order, name, atomic_long_read(&pool->hits),
+		   atomic_long_read(&pool->misses), pool->refilled,
+		   refill_avg_us, div_u64(pool->refill_max_ns, NSEC_PER_USEC),
+		   pool->refill_backoffs);
+}
+
 static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 				      void *unused)
 {
@@ -771,6 +789,13 @@ static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 		seq_printf(s, "pool total (uncached + cached + secure) = %lu\n",
 			   uncached_total + cached_total + secure_total);
 		seq_puts(s, "--------------------------------------------\n");
+		for (i = 0; i < num_orders; i++) {
+			ion_system_heap_pool_stats_show(s,
+					sys_heap->uncached_pools[i], "uncached");
+			ion_system_heap_pool_stats_show(s,
+					sys_heap->cached_pools[i], "cached");
+		}
+		seq_puts(s, "--------------------------------------------\n");
 	} else {
 		pr_info("-------------------------------------------------\n");
 		pr_info("uncached pool = %lu cached pool = %lu secure pool = %lu\n",
@@ -796,12 +821,16 @@ static void ion_system_heap_destroy_pools(struct ion_page_pool **pools)
 /**
  * ion_system_heap_create_pools - Creates pools for all orders
  *
+ * With @refill the pools are topped up with zeroed pages in the
+ * background. Secure pools must not be, their pages need assigning.
+ *
  * If this fails you don't need to destroy any pools. It's all or
  * nothing. If it succeeds you'll eventually need to use
  * ion_system_heap_destroy_pools to destroy the pools.
  */
 static int ion_system_heap_create_pools(struct device *dev,
-					struct ion_page_pool **pools)
+					struct ion_page_pool **pools,
+					bool refill)
 {
 	int i;
 	for (i = 0; i < num_orders; i++) {
@@ -813,6 +842,8 @@ static int ion_system_heap_create_pools(struct device *dev,
 		pool = ion_page_pool_create(dev, gfp_flags, orders[i]);
 		if (!pool)
 			goto err_create_pool;
+		if (refill)
+			ion_page_pool_enable_refill(pool);
 		pools[i] = pool;
 	}
 	return 0;
@@ -854,15 +885,15 @@ struct ion_heap *ion_system_heap_create(struct ion_platform_heap *data)
 			if (!heap->secure_pools[i])
 				goto err_create_secure_pools;
 			if (ion_system_heap_create_pools(
-					dev, heap->secure_pools[i]))
+					dev, heap->secure_pools[i], false))
 				goto err_create_secure_pools;
 		}
 	}
 
-	if (ion_system_heap_create_pools(dev, heap->uncached_pools))
+	if (ion_system_heap_create_pools(dev, heap->uncached_pools, true))
 		goto err_create_uncached_pools;
 
-	if (ion_system_heap_create_pools(dev, heap->cached_pools))
+	if (ion_system_heap_create_pools(dev, heap->cached_pools, true))
 		goto err_create_cached_pools;
 
 	mutex_init(&heap->split_page_mutex);
@@ -49,6 +49,8 @@
 #include <linux/cpuset.h>
 #include <linux/vmpressure.h>
 #include <linux/freezer.h>
+#include <linux/ktime.h>
+#include <linux/adj_lru.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/almk.h>
@@ -628,14 +630,182 @@ static int get_free_ram(int *other_free, int *other_file,
 }
 #endif
 
-static unsigned long lowmem_scan(struct shrinker *s, struct shrink_control *sc)
+/*
+ * Walk all processes and select the one with the highest oom_score_adj,
+ * and the largest RSS among those. Returns -EAGAIN while an earlier
+ * victim is still dying, otherwise 0 with a reference on *selected.
+ */
+static int lowmem_select_walk(short min_score_adj,
+			      struct task_struct **selected,
+			      int *selected_tasksize,
+			      short *selected_oom_score_adj)
 {
 	struct task_struct *tsk;
+	int tasksize;
+
+	rcu_read_lock();
+	for_each_process(tsk) {
+		struct task_struct *p;
+		short oom_score_adj;
+
+		if (tsk->flags & PF_KTHREAD)
+			continue;
+
+		/* if task no longer has any memory ignore it */
+		if (test_task_flag(tsk, TIF_MM_RELEASED))
+			continue;
+
+		if (oom_reaper) {
+			p = find_lock_task_mm(tsk);
+			if (!p)
+				continue;
+
+			if (test_bit(MMF_OOM_VICTIM, &p->mm->flags)) {
+				if (test_bit(MMF_OOM_SKIP, &p->mm->flags)) {
+					task_unlock(p);
+					continue;
+				} else if (time_before_eq(jiffies,
+						lowmem_deathpending_timeout)) {
+					task_unlock(p);
+					rcu_read_unlock();
+					return -EAGAIN;
+				}
+			}
+		} else {
+			if (time_before_eq(jiffies,
+					   lowmem_deathpending_timeout))
+				if (test_task_lmk_waiting(tsk)) {
+					rcu_read_unlock();
+					return -EAGAIN;
+				}
+
+			p = find_lock_task_mm(tsk);
+			if (!p)
+				continue;
+		}
+
+		oom_score_adj = p->signal->oom_score_adj;
+		if (oom_score_adj < min_score_adj) {
+			task_unlock(p);
+			continue;
+		}
+		tasksize = get_mm_rss(p->mm);
+		task_unlock(p);
+		if (tasksize <= 0)
+			continue;
+		if (*selected) {
+			if (oom_score_adj < *selected_oom_score_adj)
+				continue;
+			if (oom_score_adj == *selected_oom_score_adj &&
+			    tasksize <= *selected_tasksize)
+				continue;
+		}
+		*selected = p;
+		*selected_tasksize = tasksize;
+		*selected_oom_score_adj = oom_score_adj;
+		lowmem_print(3, "select '%s' (%d), adj %hd, size %d, to kill\n",
+			     p->comm, p->pid, oom_score_adj, tasksize);
+	}
+	if (*selected)
+		get_task_struct(*selected);
+	rcu_read_unlock();
+
+	return 0;
+}
+
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER_ADJ_LRU
+/* Select victims from the oom_score_adj LRU instead of walking all tasks */
+static bool use_adj_lru = true;
+module_param_named(use_adj_lru, use_adj_lru, bool, 0644);
+
+static bool lowmem_victim_pending;
+
+/*
+ * Called by adj_lru_select() under its lock. Earlier victims are passed
+ * over, and one killed less than a second ago aborts the scan the same
+ * way the task list walk does.
+ */
+static bool lowmem_skip_task(struct task_struct *p)
+{
+	if (test_task_flag(p, TIF_MM_RELEASED))
+		return true;
+
+	if (oom_reaper) {
+		struct task_struct *t;
+		bool reaped;
+
+		t = find_lock_task_mm(p);
+		if (!t)
+			return true;
+		if (!test_bit(MMF_OOM_VICTIM, &t->mm->flags)) {
+			task_unlock(t);
+			return false;
+		}
+		reaped = test_bit(MMF_OOM_SKIP, &t->mm->flags);
+		task_unlock(t);
+		if (!reaped &&
+		    time_before_eq(jiffies, lowmem_deathpending_timeout))
+			lowmem_victim_pending = true;
+		return true;
+	}
+
+	if (test_task_lmk_waiting(p)) {
+		if (time_before_eq(jiffies, lowmem_deathpending_timeout))
+			lowmem_victim_pending = true;
+		return true;
+	}
+
+	return false;
+}
+
+static int lowmem_select_lru(short min_score_adj,
+			     struct task_struct **selected,
+			     int *selected_tasksize,
+			     short *selected_oom_score_adj)
+{
+	struct task_struct *p;
+	unsigned long tasksize;
+	short oom_score_adj;
+
+	lowmem_victim_pending = false;
+	p = adj_lru_select(min_score_adj, true, lowmem_skip_task,
+			   &oom_score_adj, &tasksize);
+	if (lowmem_victim_pending) {
+		if (p)
+			put_task_struct(p);
+		return -EAGAIN;
+	}
+
+	if (p) {
+		*selected = p;
+		*selected_tasksize = tasksize;
+		*selected_oom_score_adj = oom_score_adj;
+		lowmem_print(3, "select '%s' (%d), adj %hd, size %lu, to kill\n",
+			     p->comm, p->pid, oom_score_adj, tasksize);
+	}
+
+	return 0;
+}
+#else
+static const bool use_adj_lru;
+
+static inline int lowmem_select_lru(short min_score_adj,
+				    struct task_struct **selected,
+				    int *selected_tasksize,
+				    short *selected_oom_score_adj)
+{
+	return 0;
+}
+#endif
+
+static unsigned long lowmem_scan(struct shrinker *s, struct shrink_control *sc)
+{
 	struct task_struct *selected = NULL;
 	unsigned long rem = 0;
-	int tasksize;
+	u64 scan_start;
 	int i;
 	int ret = 0;
+	int err;
 	short min_score_adj = OOM_SCORE_ADJ_MAX + 1;
 	int minfree = 0;
 	int selected_tasksize = 0;
@@ -700,71 +870,23 @@ static unsigned long lowmem_scan(struct shrinker *s, struct shrink_control *sc)
 
 	selected_oom_score_adj = min_score_adj;
 
-	rcu_read_lock();
-	for_each_process(tsk) {
-		struct task_struct *p;
-		short oom_score_adj;
-
-		if (tsk->flags & PF_KTHREAD)
-			continue;
-
-		/* if task no longer has any memory ignore it */
-		if (test_task_flag(tsk, TIF_MM_RELEASED))
-			continue;
-
-		if (oom_reaper) {
-			p = find_lock_task_mm(tsk);
-			if (!p)
-				continue;
-
-			if (test_bit(MMF_OOM_VICTIM, &p->mm->flags)) {
-				if (test_bit(MMF_OOM_SKIP, &p->mm->flags)) {
-					task_unlock(p);
-					continue;
-				} else if (time_before_eq(jiffies,
-						lowmem_deathpending_timeout)) {
-					task_unlock(p);
-					rcu_read_unlock();
-					mutex_unlock(&scan_mutex);
-					return 0;
-				}
-			}
-		} else {
-			if (time_before_eq(jiffies,
-					   lowmem_deathpending_timeout))
-				if (test_task_lmk_waiting(tsk)) {
-					rcu_read_unlock();
-					mutex_unlock(&scan_mutex);
-					return 0;
-				}
-
-			p = find_lock_task_mm(tsk);
-			if (!p)
-				continue;
-		}
-
-		oom_score_adj = p->signal->oom_score_adj;
-		if (oom_score_adj < min_score_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(p->mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_score_adj < selected_oom_score_adj)
-				continue;
-			if (oom_score_adj == selected_oom_score_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
-		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_score_adj = oom_score_adj;
-		lowmem_print(3, "select '%s' (%d), adj %hd, size %d, to kill\n",
-			     p->comm, p->pid, oom_score_adj, tasksize);
+	scan_start = ktime_get_ns();
+	if (use_adj_lru)
+		err = lowmem_select_lru(min_score_adj, &selected,
+					&selected_tasksize,
+					&selected_oom_score_adj);
+	else
+		err = lowmem_select_walk(min_score_adj, &selected,
+					 &selected_tasksize,
+					 &selected_oom_score_adj);
+	trace_lowmemory_scan(use_adj_lru, min_score_adj, selected,
+			     ktime_get_ns() - scan_start);
+	if (err) {
+		mutex_unlock(&scan_mutex);
+		return 0;
 	}
+
+	rcu_read_lock();
 	if (selected) {
 		long cache_size = other_file * (long)(PAGE_SIZE / 1024);
 		long cache_limit = minfree * (long)(PAGE_SIZE / 1024);
@@ -779,11 +901,11 @@ static unsigned long lowmem_scan(struct shrinker *s, struct shrink_control *sc)
 				     selected->pid);
 			rcu_read_unlock();
 			mutex_unlock(&scan_mutex);
+			put_task_struct(selected);
 			return 0;
 		}
 
 		task_lock(selected);
-		get_task_struct(selected);
 		send_sig(SIGKILL, selected, 0);
 		if (selected->mm) {
 			task_set_lmk_waiting(selected);
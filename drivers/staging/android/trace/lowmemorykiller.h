@@ -34,6 +34,30 @@ TRACE_EVENT(lowmemory_kill,
 		__entry->pagecache_limit, __entry->free)
 );
 
+TRACE_EVENT(lowmemory_scan,
+	TP_PROTO(bool adj_lru, short min_adj, struct task_struct *selected,
+		 u64 scan_ns),
+
+	TP_ARGS(adj_lru, min_adj, selected, scan_ns),
+
+	TP_STRUCT__entry(
+			__field(bool, adj_lru)
+			__field(short, min_adj)
+			__field(pid_t, pid)
+			__field(u64, scan_ns)
+	),
+
+	TP_fast_assign(
+			__entry->adj_lru = adj_lru;
+			__entry->min_adj = min_adj;
+			__entry->pid = selected ? selected->pid : 0;
+			__entry->scan_ns = scan_ns;
+	),
+
+	TP_printk("%s scan for adj >= %hd selected %d in %lluns",
+		__entry->adj_lru ? "adj_lru" : "task list", __entry->min_adj,
+		__entry->pid, __entry->scan_ns)
+);
 
 #endif /* if !defined(_TRACE_LOWMEMORYKILLER_H) || defined(TRACE_HEADER_MULTI_READ) */
 
@@ -170,6 +170,42 @@ static ssize_t fuse_conn_congestion_threshold_write(struct file *file,
 	return ret;
 }
 
+static const char * const fuse_passthrough_op_names[] = {
+	[FUSE_PASSTHROUGH_READ]		= "read",
+	[FUSE_PASSTHROUGH_WRITE]	= "write",
+	[FUSE_PASSTHROUGH_MMAP]		= "mmap",
+	[FUSE_PASSTHROUGH_SPLICE_READ]	= "splice_read",
+	[FUSE_PASSTHROUGH_SPLICE_WRITE]	= "splice_write",
+	[FUSE_PASSTHROUGH_READDIR]	= "readdir",
+	[FUSE_PASSTHROUGH_GETATTR]	= "getattr",
+};
+
+/*
+ * One line per op: name, ops handled by the passthrough file, ops that
+ * went through fuse (the page cache or the daemon).
+ */
+static ssize_t fuse_conn_passthrough_read(struct file *file, char __user *buf,
+					  size_t len, loff_t *ppos)
+{
+	struct fuse_conn *fc;
+	char tmp[FUSE_PASSTHROUGH_NR_OPS * 56];
+	size_t size = 0;
+	int i;
+
+	fc = fuse_ctl_file_conn_get(file);
+	if (!fc)
+		return 0;
+
+	for (i = 0; i < FUSE_PASSTHROUGH_NR_OPS; i++)
+		size += scnprintf(tmp + size, sizeof(tmp) - size,
+				  "%s %lu %lu\n", fuse_passthrough_op_names[i],
+				  atomic_long_read(&fc->passthrough_hits[i]),
+				  atomic_long_read(&fc->passthrough_misses[i]));
+	fuse_conn_put(fc);
+
+	return simple_read_from_buffer(buf, len, ppos, tmp, size);
+}
+
 static const struct file_operations fuse_ctl_abort_ops = {
 	.open = nonseekable_open,
 	.write = fuse_conn_abort_write,
@@ -182,6 +218,12 @@ static const struct file_operations fuse_ctl_waiting_ops = {
 	.llseek = no_llseek,
 };
 
+static const struct file_operations fuse_ctl_passthrough_ops = {
+	.open = nonseekable_open,
+	.read = fuse_conn_passthrough_read,
+	.llseek = no_llseek,
+};
+
 static const struct file_operations fuse_conn_max_background_ops = {
 	.open = nonseekable_open,
 	.read = fuse_conn_max_background_read,
@@ -264,7 +306,9 @@ int fuse_ctl_add_conn(struct fuse_conn *fc)
 				 1, NULL, &fuse_conn_max_background_ops) ||
 	    !fuse_ctl_add_dentry(parent, fc, "congestion_threshold",
 				 S_IFREG | 0600, 1, NULL,
-				 &fuse_conn_congestion_threshold_ops))
+				 &fuse_conn_congestion_threshold_ops) ||
+	    !fuse_ctl_add_dentry(parent, fc, "passthrough", S_IFREG | 0400, 1,
+				 NULL, &fuse_ctl_passthrough_ops))
 		goto err;
 
 	return 0;
@@ -26,6 +26,16 @@
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
 
+static unsigned forget_wake_batch = 32;
+module_param(forget_wake_batch, uint, 0644);
+MODULE_PARM_DESC(forget_wake_batch,
+ "Number of queued FORGETs that wakes up the daemon right away");
+
+static unsigned forget_delay_ms = 20;
+module_param(forget_delay_ms, uint, 0644);
+MODULE_PARM_DESC(forget_delay_ms,
+ "Longest time a FORGET is held back to be batched with others (0 = never)");
+
 static struct kmem_cache *fuse_req_cachep;
 
 static struct fuse_dev *fuse_get_dev(struct file *file)
@@ -316,15 +326,66 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 	return nbytes;
 }
 
+/*
+ * Each input queue counts uniques in its own range, see fuse_mq_init(), so
+ * that they stay unique across the connection. A device may pick up
+ * requests from more than one queue, e.g. when a reader still waits on
+ * fc->iq after the device was bound to a per-cpu queue.
+ */
+#define FUSE_MQ_UNIQUE_SHIFT	48
+
 static u64 fuse_get_unique(struct fuse_iqueue *fiq)
 {
 	return ++fiq->reqctr;
 }
 
+/*
+ * Returns the input queue new requests from this cpu go to, with its lock
+ * held. That is fc->iq unless devices were bound to per-cpu queues.
+ */
+static struct fuse_iqueue *fuse_lock_iqueue(struct fuse_conn *fc)
+{
+	struct fuse_iqueue **map = smp_load_acquire(&fc->mq_map);
+	struct fuse_iqueue *fiq;
+
+	if (!map) {
+		spin_lock(&fc->iq.waitq.lock);
+		return &fc->iq;
+	}
+
+	for (;;) {
+		fiq = READ_ONCE(map[raw_smp_processor_id()]);
+		spin_lock(&fiq->waitq.lock);
+		/* The map is updated before a queue's last reader goes away */
+		if (fiq == &fc->iq || fiq->nr_readers)
+			return fiq;
+		spin_unlock(&fiq->waitq.lock);
+	}
+}
+
+/*
+ * Locks the input queue @req was queued on. Pending requests move to
+ * another queue when the last device bound to theirs is released.
+ */
+static struct fuse_iqueue *fuse_lock_req_iqueue(struct fuse_conn *fc,
+						struct fuse_req *req)
+{
+	struct fuse_iqueue *fiq;
+
+	for (;;) {
+		fiq = READ_ONCE(req->iq) ?: &fc->iq;
+		spin_lock(&fiq->waitq.lock);
+		if (fiq == (req->iq ?: &fc->iq))
+			return fiq;
+		spin_unlock(&fiq->waitq.lock);
+	}
+}
+
 static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
+	req->iq = fiq;
 	list_add_tail(&req->list, &fiq->pending);
 	wake_up_locked(&fiq->waitq);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
@@ -333,17 +394,30 @@ static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	forget->forget_one.nodeid = nodeid;
 	forget->forget_one.nlookup = nlookup;
 
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_lock_iqueue(fc);
 	if (fiq->connected) {
+		unsigned delay = READ_ONCE(forget_delay_ms);
+
 		fiq->forget_list_tail->next = forget;
 		fiq->forget_list_tail = forget;
-		wake_up_locked(&fiq->waitq);
-		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+		/*
+		 * Forgets are not urgent: hold them back for a little while
+		 * so the daemon gets them in FUSE_BATCH_FORGET sized chunks
+		 * rather than one wake up per evicted inode.  A reader that
+		 * is woken for anything else picks them up on the way.
+		 */
+		if (++fiq->nr_forgets >= READ_ONCE(forget_wake_batch) || !delay) {
+			wake_up_locked(&fiq->waitq);
+			kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+		} else if (fiq->nr_forgets == 1) {
+			schedule_delayed_work(&fiq->forget_work,
+					      msecs_to_jiffies(delay));
+		}
 	} else {
 		kfree(forget);
 	}
@@ -355,12 +429,12 @@ static void flush_bg_queue(struct fuse_conn *fc)
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
 		struct fuse_req *req;
-		struct fuse_iqueue *fiq = &fc->iq;
+		struct fuse_iqueue *fiq;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->waitq.lock);
+		fiq = fuse_lock_iqueue(fc);
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request(fiq, req);
 		spin_unlock(&fiq->waitq.lock);
@@ -377,12 +451,12 @@ static void flush_bg_queue(struct fuse_conn *fc)
  */
 static void request_end(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	if (test_and_set_bit(FR_FINISHED, &req->flags))
 		goto put_request;
 
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_lock_req_iqueue(fc, req);
 	list_del_init(&req->intr_entry);
 	spin_unlock(&fiq->waitq.lock);
 	WARN_ON(test_bit(FR_PENDING, &req->flags));
@@ -421,9 +495,10 @@ static void request_end(struct fuse_conn *fc, struct fuse_req *req)
 	fuse_put_request(fc, req);
 }
 
-static void queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
+static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
 {
-	spin_lock(&fiq->waitq.lock);
+	struct fuse_iqueue *fiq = fuse_lock_req_iqueue(fc, req);
+
 	if (test_bit(FR_FINISHED, &req->flags)) {
 		spin_unlock(&fiq->waitq.lock);
 		return;
@@ -438,7 +513,7 @@ static void queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 	int err;
 
 	if (!fc->no_interrupt) {
@@ -452,7 +527,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		/* matches barrier in fuse_dev_do_read() */
 		smp_mb__after_atomic();
 		if (test_bit(FR_SENT, &req->flags))
-			queue_interrupt(fiq, req);
+			queue_interrupt(fc, req);
 	}
 
 	if (!test_bit(FR_FORCE, &req->flags)) {
@@ -462,7 +537,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->waitq.lock);
+		fiq = fuse_lock_req_iqueue(fc, req);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
@@ -485,10 +560,10 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_lock_iqueue(fc);
 	if (!fiq->connected) {
 		spin_unlock(&fiq->waitq.lock);
 		req->out.h.error = -ENOTCONN;
@@ -633,11 +708,11 @@ static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 					  struct fuse_req *req, u64 unique)
 {
 	int err = -ENODEV;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	__clear_bit(FR_ISREPLY, &req->flags);
 	req->in.h.unique = unique;
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_lock_iqueue(fc);
 	if (fiq->connected) {
 		queue_request(fiq, req);
 		err = 0;
@@ -1093,6 +1168,23 @@ static int request_pending(struct fuse_iqueue *fiq)
 		forget_pending(fiq);
 }
 
+/* Flushes out forgets held back by fuse_queue_forget() */
+void fuse_iqueue_forget_work(struct work_struct *work)
+{
+	struct fuse_iqueue *fiq = container_of(to_delayed_work(work),
+					       struct fuse_iqueue, forget_work);
+	bool wake;
+
+	spin_lock(&fiq->waitq.lock);
+	wake = fiq->connected && forget_pending(fiq);
+	if (wake)
+		wake_up_locked(&fiq->waitq);
+	spin_unlock(&fiq->waitq.lock);
+
+	if (wake)
+		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+}
+
 /*
  * Transfer an interrupt request to userspace
  *
@@ -1145,6 +1237,7 @@ static struct fuse_forget_link *dequeue_forget(struct fuse_iqueue *fiq,
 
 	fiq->forget_list_head.next = *newhead;
 	*newhead = NULL;
+	fiq->nr_forgets -= count;
 	if (fiq->forget_list_head.next == NULL)
 		fiq->forget_list_tail = &fiq->forget_list_head;
 
@@ -1261,7 +1354,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 {
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq = READ_ONCE(fud->iq);
 	struct fuse_pqueue *fpq = &fud->pq;
 	struct fuse_req *req;
 	struct fuse_in *in;
@@ -1352,7 +1445,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	/* matches barrier in request_wait_answer() */
 	smp_mb__after_atomic();
 	if (test_bit(FR_INTERRUPTED, &req->flags))
-		queue_interrupt(fiq, req);
+		queue_interrupt(fc, req);
 	fuse_put_request(fc, req);
 
 	return reqsize;
@@ -1925,7 +2018,7 @@ static ssize_t fuse_dev_do_write(struct fuse_dev *fud,
 		if (oh.error == -ENOSYS)
 			fc->no_interrupt = 1;
 		else if (oh.error == -EAGAIN)
-			queue_interrupt(&fc->iq, req);
+			queue_interrupt(fc, req);
 		fuse_put_request(fc, req);
 
 		fuse_copy_finish(cs);
@@ -2086,7 +2179,7 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 	if (!fud)
 		return POLLERR;
 
-	fiq = &fud->fc->iq;
+	fiq = READ_ONCE(fud->iq);
 	poll_wait(file, &fiq->waitq, wait);
 
 	spin_lock(&fiq->waitq.lock);
@@ -2131,6 +2224,20 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/* Disconnects @fiq, moving its pending requests to @to_end */
+static void fuse_abort_iqueue(struct fuse_iqueue *fiq,
+			      struct list_head *to_end)
+{
+	spin_lock(&fiq->waitq.lock);
+	fiq->connected = 0;
+	list_splice_tail_init(&fiq->pending, to_end);
+	while (forget_pending(fiq))
+		kfree(dequeue_forget(fiq, 1, NULL));
+	wake_up_all_locked(&fiq->waitq);
+	spin_unlock(&fiq->waitq.lock);
+	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+}
+
 /*
  * Abort all requests.
  *
@@ -2151,14 +2258,13 @@ static void end_polls(struct fuse_conn *fc)
  */
 void fuse_abort_conn(struct fuse_conn *fc)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
-
 	spin_lock(&fc->lock);
 	if (fc->connected) {
 		struct fuse_dev *fud;
 		struct fuse_req *req, *next;
 		LIST_HEAD(to_end1);
 		LIST_HEAD(to_end2);
+		int cpu;
 
 		fc->connected = 0;
 		fc->blocked = 0;
@@ -2185,16 +2291,13 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		fc->max_background = UINT_MAX;
 		flush_bg_queue(fc);
 
-		spin_lock(&fiq->waitq.lock);
-		fiq->connected = 0;
-		list_splice_init(&fiq->pending, &to_end2);
+		fuse_abort_iqueue(&fc->iq, &to_end2);
+		if (fc->mq_map) {
+			for_each_possible_cpu(cpu)
+				fuse_abort_iqueue(&fc->mq[cpu], &to_end2);
+		}
 		list_for_each_entry(req, &to_end2, list)
 			clear_bit(FR_PENDING, &req->flags);
-		while (forget_pending(fiq))
-			kfree(dequeue_forget(fiq, 1, NULL));
-		wake_up_all_locked(&fiq->waitq);
-		spin_unlock(&fiq->waitq.lock);
-		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
 		spin_unlock(&fc->lock);
@@ -2218,6 +2321,211 @@ void fuse_wait_aborted(struct fuse_conn *fc)
 	wait_event(fc->blocked_waitq, atomic_read(&fc->num_waiting) == 0);
 }
 
+/*
+ * Points each cpu at the queue its requests should go to: its own when a
+ * device is bound to it, else the closest preceding bound queue on the
+ * same node, else the closest preceding one anywhere, else fc->iq.
+ *
+ * Called with fc->lock held.
+ */
+static void fuse_mq_remap(struct fuse_conn *fc)
+{
+	int cpu, other;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_iqueue *best = &fc->iq;
+		unsigned int best_dist = UINT_MAX;
+		bool best_local = false;
+
+		for_each_possible_cpu(other) {
+			unsigned int dist;
+			bool local;
+
+			if (!fc->mq[other].nr_readers)
+				continue;
+
+			dist = (cpu - other + nr_cpu_ids) % nr_cpu_ids;
+			local = cpu_to_node(other) == cpu_to_node(cpu);
+			if (local < best_local ||
+			    (local == best_local && dist >= best_dist))
+				continue;
+
+			best = &fc->mq[other];
+			best_dist = dist;
+			best_local = local;
+		}
+		WRITE_ONCE(fc->mq_map[cpu], best);
+	}
+}
+
+static int fuse_mq_init(struct fuse_conn *fc)
+{
+	struct fuse_iqueue *mq, **map;
+	int cpu, err = -ENOTCONN;
+
+	if (smp_load_acquire(&fc->mq_map))
+		return 0;
+
+	mq = kcalloc(nr_cpu_ids, sizeof(*mq), GFP_KERNEL);
+	map = kcalloc(nr_cpu_ids, sizeof(*map), GFP_KERNEL);
+	if (!mq || !map) {
+		kfree(mq);
+		kfree(map);
+		return -ENOMEM;
+	}
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		fuse_iqueue_init(&mq[cpu]);
+		mq[cpu].reqctr = (u64)(cpu + 1) << FUSE_MQ_UNIQUE_SHIFT;
+		map[cpu] = &fc->iq;
+	}
+
+	spin_lock(&fc->lock);
+	if (fc->mq_map) {
+		err = 0;
+	} else if (fc->connected) {
+		fc->mq = mq;
+		/* Pairs with smp_load_acquire() in fuse_lock_iqueue() */
+		smp_store_release(&fc->mq_map, map);
+		mq = NULL;
+		map = NULL;
+		err = 0;
+	}
+	spin_unlock(&fc->lock);
+
+	kfree(mq);
+	kfree(map);
+	return err;
+}
+
+/*
+ * O_ASYNC readers are registered on the input queue they read from. Moves
+ * the registration of @file, if any, from @from to @to. Called with
+ * fuse_mutex held, which serializes this against fuse_dev_fasync().
+ */
+static void fuse_dev_move_fasync(struct file *file, struct fuse_iqueue *from,
+				 struct fuse_iqueue *to)
+{
+	struct fasync_struct *fa;
+	int fd = -1;
+
+	rcu_read_lock();
+	for (fa = rcu_dereference(from->fasync); fa;
+	     fa = rcu_dereference(fa->fa_next)) {
+		if (READ_ONCE(fa->fa_file) == file) {
+			fd = fa->fa_fd;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	if (fd < 0)
+		return;
+
+	/* Removing the entry clears FASYNC, so remove before adding */
+	fasync_helper(fd, file, 0, &from->fasync);
+	if (fasync_helper(fd, file, 1, &to->fasync) < 0)
+		pr_warn("fuse: failed to move O_ASYNC registration\n");
+}
+
+static int fuse_dev_bind_queue(struct file *file, struct fuse_dev *fud,
+			       u32 cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *fiq;
+	int err;
+
+	if (!fc->multiqueue)
+		return -EOPNOTSUPP;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	err = fuse_mq_init(fc);
+	if (err)
+		return err;
+
+	spin_lock(&fc->lock);
+	err = -ENOTCONN;
+	if (!fc->connected)
+		goto out_unlock;
+
+	err = -EBUSY;
+	if (fud->iq != &fc->iq)
+		goto out_unlock;
+
+	fiq = &fc->mq[cpu];
+	spin_lock(&fiq->waitq.lock);
+	fiq->nr_readers++;
+	WRITE_ONCE(fud->iq, fiq);
+	fuse_mq_remap(fc);
+	spin_unlock(&fiq->waitq.lock);
+	spin_unlock(&fc->lock);
+
+	fuse_dev_move_fasync(file, &fc->iq, fiq);
+	return 0;
+
+out_unlock:
+	spin_unlock(&fc->lock);
+	return err;
+}
+
+/*
+ * Drops @fud from its input queue. When that was the last device reading
+ * from the queue, whatever is still queued there moves to the queue that
+ * now serves its cpu. Called with fuse_mutex held.
+ */
+static void fuse_dev_unbind_queue(struct file *file, struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *fiq = fud->iq;
+	struct fuse_iqueue *dst;
+	struct fuse_req *req;
+
+	if (fiq == &fc->iq)
+		return;
+
+	fuse_dev_move_fasync(file, fiq, &fc->iq);
+
+	spin_lock(&fc->lock);
+	spin_lock(&fiq->waitq.lock);
+	WRITE_ONCE(fud->iq, &fc->iq);
+	if (--fiq->nr_readers) {
+		spin_unlock(&fiq->waitq.lock);
+		spin_unlock(&fc->lock);
+		return;
+	}
+
+	/* Remap before unlocking, fuse_lock_iqueue() spins until we do */
+	fuse_mq_remap(fc);
+	dst = fc->mq_map[fiq - fc->mq];
+
+	spin_lock_nested(&dst->waitq.lock, SINGLE_DEPTH_NESTING);
+	list_for_each_entry(req, &fiq->pending, list) {
+		req->in.h.unique = fuse_get_unique(dst);
+		WRITE_ONCE(req->iq, dst);
+	}
+	list_splice_tail_init(&fiq->pending, &dst->pending);
+	list_for_each_entry(req, &fiq->interrupts, intr_entry)
+		WRITE_ONCE(req->iq, dst);
+	list_splice_tail_init(&fiq->interrupts, &dst->interrupts);
+	if (forget_pending(fiq)) {
+		dst->forget_list_tail->next = fiq->forget_list_head.next;
+		dst->forget_list_tail = fiq->forget_list_tail;
+		fiq->forget_list_head.next = NULL;
+		fiq->forget_list_tail = &fiq->forget_list_head;
+		dst->nr_forgets += fiq->nr_forgets;
+		fiq->nr_forgets = 0;
+	}
+	if (request_pending(dst))
+		wake_up_all_locked(&dst->waitq);
+	spin_unlock(&dst->waitq.lock);
+	spin_unlock(&fiq->waitq.lock);
+	spin_unlock(&fc->lock);
+
+	kill_fasync(&dst->fasync, SIGIO, POLL_IN);
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2233,6 +2541,9 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 		spin_unlock(&fpq->lock);
 
 		end_requests(fc, &to_end);
+		mutex_lock(&fuse_mutex);
+		fuse_dev_unbind_queue(file, fud);
+		mutex_unlock(&fuse_mutex);
 
 		/* Are we the last open device? */
 		if (atomic_dec_and_test(&fc->dev_count)) {
@@ -2248,12 +2559,17 @@ EXPORT_SYMBOL_GPL(fuse_dev_release);
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
+	int err;
 
 	if (!fud)
 		return -EPERM;
 
-	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fud->fc->iq.fasync);
+	/* fuse_mutex keeps fud->iq stable against binding the device */
+	mutex_lock(&fuse_mutex);
+	err = fasync_helper(fd, file, on, &fud->iq->fasync);
+	mutex_unlock(&fuse_mutex);
+
+	return err;
 }
 
 static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
@@ -2278,7 +2594,21 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 {
 	int err = -ENOTTY;
 
-	if (cmd == FUSE_DEV_IOC_CLONE) {
+	if (cmd == FUSE_DEV_IOC_BIND_QUEUE) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		u32 cpu;
+
+		err = -EINVAL;
+		if (!fud)
+			return err;
+
+		err = -EFAULT;
+		if (!get_user(cpu, (__u32 __user *) arg)) {
+			mutex_lock(&fuse_mutex);
+			err = fuse_dev_bind_queue(file, fud, cpu);
+			mutex_unlock(&fuse_mutex);
+		}
+	} else if (cmd == FUSE_DEV_IOC_CLONE) {
 		int oldfd;
 
 		err = -EFAULT;
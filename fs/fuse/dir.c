@@ -7,6 +7,7 @@
 */
 
 #include "fuse_i.h"
+#include "fuse_passthrough.h"
 
 #include <linux/pagemap.h>
 #include <linux/file.h>
@@ -29,6 +30,8 @@ static bool fuse_use_readdirplus(struct inode *dir, struct dir_context *ctx)
 		return true;
 	if (ctx->pos == 0)
 		return true;
+	if (test_bit(FUSE_I_RDPLUS_STICKY, &fi->state))
+		return true;
 	return false;
 }
 
@@ -439,6 +442,14 @@ static struct dentry *fuse_lookup(struct inode *dir, struct dentry *entry,
 	else
 		fuse_invalidate_entry_cache(entry);
 
+	/*
+	 * A child that a plain READDIR already returned is being looked up:
+	 * whoever lists this directory also stats its entries, so have the
+	 * whole listing done with READDIRPLUS from now on and let the dcache
+	 * answer those lookups.
+	 */
+	if (inode && test_bit(FUSE_I_RDPLUS_LISTED, &get_fuse_inode(dir)->state))
+		set_bit(FUSE_I_RDPLUS_STICKY, &get_fuse_inode(dir)->state);
 	fuse_advise_use_readdirplus(dir);
 	return newent;
 
@@ -1422,6 +1433,12 @@ static int fuse_readdir(struct file *file, struct dir_context *ctx)
 	if (fuse_is_bad(inode))
 		return -EIO;
 
+	if (fuse_passthrough_active(file->private_data)) {
+		fuse_passthrough_count(fc, FUSE_PASSTHROUGH_READDIR, true);
+		return fuse_passthrough_readdir(file, ctx);
+	}
+	fuse_passthrough_count(fc, FUSE_PASSTHROUGH_READDIR, false);
+
 	req = fuse_get_req(fc, 1);
 	if (IS_ERR(req))
 		return PTR_ERR(req);
@@ -1452,11 +1469,16 @@ static int fuse_readdir(struct file *file, struct dir_context *ctx)
 	err = req->out.h.error;
 	fuse_put_request(fc, req);
 	if (!err) {
+		struct fuse_inode *fi = get_fuse_inode(inode);
+
 		if (plus) {
+			clear_bit(FUSE_I_RDPLUS_LISTED, &fi->state);
 			err = parse_dirplusfile(page_address(page), nbytes,
 						file, ctx,
 						attr_version);
 		} else {
+			if (nbytes)
+				set_bit(FUSE_I_RDPLUS_LISTED, &fi->state);
 			err = parse_dirfile(page_address(page), nbytes, file,
 					    ctx);
 		}
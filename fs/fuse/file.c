@@ -962,15 +962,28 @@ static ssize_t fuse_file_read_iter(struct kiocb *iocb, struct iov_iter *to)
 	if (fc->auto_inval_data ||
 	    (iocb->ki_pos + iov_iter_count(to) > i_size_read(inode))) {
 		int err;
-		err = fuse_update_attributes(inode, NULL, iocb->ki_filp, NULL);
-		if (err)
-			return err;
+
+		if (fuse_passthrough_active(ff)) {
+			fuse_passthrough_update_attr(iocb->ki_filp);
+			fuse_passthrough_count(fc, FUSE_PASSTHROUGH_GETATTR,
+					       true);
+		} else {
+			err = fuse_update_attributes(inode, NULL, iocb->ki_filp,
+						     NULL);
+			fuse_passthrough_count(fc, FUSE_PASSTHROUGH_GETATTR,
+					       false);
+			if (err)
+				return err;
+		}
 	}
 
-	if (ff && ff->passthrough_enabled && ff->passthrough_filp)
+	if (fuse_passthrough_active(ff)) {
 		ret_val = fuse_passthrough_read_iter(iocb, to);
-	else
+		fuse_passthrough_count(fc, FUSE_PASSTHROUGH_READ, true);
+	} else {
 		ret_val = generic_file_read_iter(iocb, to);
+		fuse_passthrough_count(fc, FUSE_PASSTHROUGH_READ, false);
+	}
 
 	return ret_val;
 }
@@ -1241,10 +1254,12 @@ static ssize_t fuse_file_write_iter(struct kiocb *iocb, struct iov_iter *from)
 	if (err)
 		goto out;
 
-	if (ff && ff->passthrough_enabled && ff->passthrough_filp) {
+	if (fuse_passthrough_active(ff)) {
 		written = fuse_passthrough_write_iter(iocb, from);
+		fuse_passthrough_count(ff->fc, FUSE_PASSTHROUGH_WRITE, true);
 		goto out;
 	}
+	fuse_passthrough_count(ff->fc, FUSE_PASSTHROUGH_WRITE, false);
 
 	if (iocb->ki_flags & IOCB_DIRECT) {
 		loff_t pos = iocb->ki_pos;
@@ -2120,6 +2135,13 @@ static int fuse_file_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	struct fuse_file *ff = file->private_data;
 
+	if (fuse_passthrough_active(ff)) {
+		fuse_passthrough_count(ff->fc, FUSE_PASSTHROUGH_MMAP, true);
+		return fuse_passthrough_mmap(file, vma);
+	}
+	fuse_passthrough_count(ff->fc, FUSE_PASSTHROUGH_MMAP, false);
+
+	/* The fuse page cache is mapped, keep all io going through it */
 	ff->passthrough_enabled = 0;
 	if ((vma->vm_flags & VM_SHARED) && (vma->vm_flags & VM_MAYWRITE))
 		fuse_link_write_file(file);
@@ -2129,6 +2151,39 @@ static int fuse_file_mmap(struct file *file, struct vm_area_struct *vma)
 	return 0;
 }
 
+static ssize_t fuse_file_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe, size_t len,
+				     unsigned int flags)
+{
+	struct fuse_file *ff = in->private_data;
+
+	if (fuse_passthrough_active(ff)) {
+		fuse_passthrough_count(ff->fc, FUSE_PASSTHROUGH_SPLICE_READ,
+				       true);
+		return fuse_passthrough_splice_read(in, ppos, pipe, len, flags);
+	}
+	fuse_passthrough_count(ff->fc, FUSE_PASSTHROUGH_SPLICE_READ, false);
+
+	return generic_file_splice_read(in, ppos, pipe, len, flags);
+}
+
+static ssize_t fuse_file_splice_write(struct pipe_inode_info *pipe,
+				      struct file *out, loff_t *ppos,
+				      size_t len, unsigned int flags)
+{
+	struct fuse_file *ff = out->private_data;
+
+	if (fuse_passthrough_active(ff)) {
+		fuse_passthrough_count(ff->fc, FUSE_PASSTHROUGH_SPLICE_WRITE,
+				       true);
+		return fuse_passthrough_splice_write(pipe, out, ppos, len,
+						     flags);
+	}
+	fuse_passthrough_count(ff->fc, FUSE_PASSTHROUGH_SPLICE_WRITE, false);
+
+	return iter_file_splice_write(pipe, out, ppos, len, flags);
+}
+
 static int fuse_direct_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	struct fuse_file *ff = file->private_data;
@@ -2361,6 +2416,8 @@ static loff_t fuse_file_llseek(struct file *file, loff_t offset, int whence)
 {
 	loff_t retval;
 	struct inode *inode = file_inode(file);
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_file *ff = file->private_data;
 
 	switch (whence) {
 	case SEEK_SET:
@@ -2370,7 +2427,16 @@ static loff_t fuse_file_llseek(struct file *file, loff_t offset, int whence)
 		break;
 	case SEEK_END:
 		inode_lock(inode);
-		retval = fuse_update_attributes(inode, NULL, file, NULL);
+		if (fuse_passthrough_active(ff)) {
+			fuse_passthrough_update_attr(file);
+			fuse_passthrough_count(fc, FUSE_PASSTHROUGH_GETATTR,
+					       true);
+			retval = 0;
+		} else {
+			retval = fuse_update_attributes(inode, NULL, file, NULL);
+			fuse_passthrough_count(fc, FUSE_PASSTHROUGH_GETATTR,
+					       false);
+		}
 		if (!retval)
 			retval = generic_file_llseek(file, offset, whence);
 		inode_unlock(inode);
@@ -3081,7 +3147,8 @@ static const struct file_operations fuse_file_operations = {
 	.fsync		= fuse_fsync,
 	.lock		= fuse_file_lock,
 	.flock		= fuse_file_flock,
-	.splice_read	= generic_file_splice_read,
+	.splice_read	= fuse_file_splice_read,
+	.splice_write	= fuse_file_splice_write,
 	.unlocked_ioctl	= fuse_file_ioctl,
 	.compat_ioctl	= fuse_file_compat_ioctl,
 	.poll		= fuse_file_poll,
@@ -35,7 +35,7 @@
 #define FUSE_NAME_MAX 1024
 
 /** Number of dentries for each connection in the control filesystem */
-#define FUSE_CTL_NUM_DENTRIES 5
+#define FUSE_CTL_NUM_DENTRIES 6
 
 /** Number of page pointers embedded in fuse_req */
 #define FUSE_REQ_INLINE_PAGES 1
@@ -113,6 +113,10 @@ enum {
 	FUSE_I_ADVISE_RDPLUS,
 	/** Initialized with readdirplus */
 	FUSE_I_INIT_RDPLUS,
+	/** Entries were returned by a plain readdir since the last readdirplus */
+	FUSE_I_RDPLUS_LISTED,
+	/** Listings are followed by lookups, always use readdirplus */
+	FUSE_I_RDPLUS_STICKY,
 	/** An operation changing file size is in progress  */
 	FUSE_I_SIZE_UNSTABLE,
 	/* Bad inode */
@@ -161,6 +165,18 @@ struct fuse_file {
 	bool passthrough_enabled;
 };
 
+/** Operations that can be redirected to the passthrough file */
+enum fuse_passthrough_op {
+	FUSE_PASSTHROUGH_READ,
+	FUSE_PASSTHROUGH_WRITE,
+	FUSE_PASSTHROUGH_MMAP,
+	FUSE_PASSTHROUGH_SPLICE_READ,
+	FUSE_PASSTHROUGH_SPLICE_WRITE,
+	FUSE_PASSTHROUGH_READDIR,
+	FUSE_PASSTHROUGH_GETATTR,
+	FUSE_PASSTHROUGH_NR_OPS,
+};
+
 /** One input argument of a request */
 struct fuse_in_arg {
 	unsigned size;
@@ -315,6 +331,9 @@ struct fuse_req {
 	/** refcount */
 	atomic_t count;
 
+	/** Input queue the request was queued on */
+	struct fuse_iqueue *iq;
+
 	/** Unique ID for the interrupt request */
 	u64 intr_unique;
 
@@ -417,9 +436,18 @@ struct fuse_iqueue {
 	/** Batching of FORGET requests (positive indicates FORGET batch) */
 	int forget_batch;
 
+	/** Forgets queued since the daemon was last woken up for them */
+	unsigned nr_forgets;
+
+	/** Wakes up the daemon for forgets held back for batching */
+	struct delayed_work forget_work;
+
 	/** O_ASYNC requests */
 	struct fasync_struct *fasync;
-};
+
+	/** Number of devices bound to this queue, see fuse_dev_bind_queue() */
+	unsigned nr_readers;
+} ____cacheline_aligned_in_smp;
 
 struct fuse_pqueue {
 	/** Connection established */
@@ -445,6 +473,9 @@ struct fuse_dev {
 	/** Processing queue */
 	struct fuse_pqueue pq;
 
+	/** Input queue requests are read from, fc->iq unless bound */
+	struct fuse_iqueue *iq;
+
 	/** list entry on fc->devices */
 	struct list_head entry;
 };
@@ -483,6 +514,12 @@ struct fuse_conn {
 	/** Input queue */
 	struct fuse_iqueue iq;
 
+	/** Per-cpu input queues, allocated on the first FUSE_DEV_IOC_BIND_QUEUE */
+	struct fuse_iqueue *mq;
+
+	/** Queue the requests of each cpu go to */
+	struct fuse_iqueue **mq_map;
+
 	/** The next unique kernel file handle */
 	u64 khctr;
 
@@ -555,6 +592,9 @@ struct fuse_conn {
 	/** passthrough IO. */
 	unsigned passthrough:1;
 
+	/** devices may be bound to per-cpu input queues */
+	unsigned multiqueue:1;
+
 	/*
 	 * The following bitfields are only for optimization purposes
 	 * and hence races in setting them will not cause malfunction
@@ -659,6 +699,12 @@ struct fuse_conn {
 	/** Dentries in the control filesystem */
 	struct dentry *ctl_dentry[FUSE_CTL_NUM_DENTRIES];
 
+	/** Ops handled by the passthrough file, by fuse_passthrough_op */
+	atomic_long_t passthrough_hits[FUSE_PASSTHROUGH_NR_OPS];
+
+	/** Ops handled by fuse itself on a passthrough connection */
+	atomic_long_t passthrough_misses[FUSE_PASSTHROUGH_NR_OPS];
+
 	/** number of dentries used in the above array */
 	int ctl_ndents;
 
@@ -907,6 +953,13 @@ void fuse_conn_init(struct fuse_conn *fc);
  */
 void fuse_conn_put(struct fuse_conn *fc);
 
+void fuse_iqueue_init(struct fuse_iqueue *fiq);
+
+/**
+ * Delayed wake up for forgets queued by fuse_queue_forget()
+ */
+void fuse_iqueue_forget_work(struct work_struct *work);
+
 struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
 void fuse_dev_free(struct fuse_dev *fud);
 
@@ -26,6 +26,38 @@ ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
 
 ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
 
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
+ssize_t fuse_passthrough_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe, size_t len,
+				     unsigned int flags);
+
+ssize_t fuse_passthrough_splice_write(struct pipe_inode_info *pipe,
+				      struct file *out, loff_t *ppos,
+				      size_t len, unsigned int flags);
+
+int fuse_passthrough_readdir(struct file *file, struct dir_context *ctx);
+
+void fuse_passthrough_update_attr(struct file *file);
+
 void fuse_passthrough_release(struct fuse_file *ff);
 
+static inline bool fuse_passthrough_active(struct fuse_file *ff)
+{
+	return ff && ff->passthrough_enabled && ff->passthrough_filp;
+}
+
+static inline void fuse_passthrough_count(struct fuse_conn *fc,
+					  enum fuse_passthrough_op op,
+					  bool hit)
+{
+	if (!fc->passthrough)
+		return;
+
+	if (hit)
+		atomic_long_inc(&fc->passthrough_hits[op]);
+	else
+		atomic_long_inc(&fc->passthrough_misses[op]);
+}
+
 #endif /* _FS_FUSE_PASSTHROUGH_H */
@@ -15,7 +15,9 @@
 #include "fuse_passthrough.h"
 
 #include <linux/aio.h>
+#include <linux/cred.h>
 #include <linux/fs_stack.h>
+#include <linux/mm.h>
 
 void fuse_setup_passthrough(struct fuse_conn *fc, struct fuse_req *req)
 {
@@ -32,7 +34,8 @@ void fuse_setup_passthrough(struct fuse_conn *fc, struct fuse_req *req)
 		return;
 
 	if ((req->in.h.opcode != FUSE_OPEN) &&
-	    (req->in.h.opcode != FUSE_CREATE))
+	    (req->in.h.opcode != FUSE_CREATE) &&
+	    (req->in.h.opcode != FUSE_OPENDIR))
 		return;
 
 	open_out_index = req->in.numargs - 1;
@@ -54,6 +57,17 @@ void fuse_setup_passthrough(struct fuse_conn *fc, struct fuse_req *req)
 	passthrough_sb = passthrough_inode->i_sb;
 	fs_stack_depth = passthrough_sb->s_stack_depth + 1;
 
+	/*
+	 * Directories can only pass through to directories and vice versa.
+	 * Daemons that predate OPENDIR passthrough leave passthrough_fd zeroed
+	 * in their OPENDIR replies, so don't complain about those.
+	 */
+	if ((req->in.h.opcode == FUSE_OPENDIR) !=
+	    !!S_ISDIR(passthrough_inode->i_mode)) {
+		fput(passthrough_filp);
+		return;
+	}
+
 	/* If we reached the stacking limit go through regular io */
 	if (fs_stack_depth > FILESYSTEM_MAX_STACK_DEPTH) {
 		/* Release the passthrough file. */
@@ -124,6 +138,116 @@ ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from)
 	return fuse_passthrough_read_write_iter(iocb, from, 1);
 }
 
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *passthrough_filp = ff->passthrough_filp;
+	int ret;
+
+	if (!passthrough_filp->f_op->mmap)
+		return -ENODEV;
+
+	/*
+	 * Hand the vma over to the passthrough file, so that faults are
+	 * served straight from its page cache and never reach fuse.
+	 */
+	vma->vm_file = get_file(passthrough_filp);
+	ret = passthrough_filp->f_op->mmap(passthrough_filp, vma);
+	if (ret) {
+		vma->vm_file = file;
+		fput(passthrough_filp);
+		return ret;
+	}
+	fput(file);
+
+	fsstack_copy_attr_atime(file_inode(file), file_inode(passthrough_filp));
+
+	return 0;
+}
+
+ssize_t fuse_passthrough_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe, size_t len,
+				     unsigned int flags)
+{
+	struct fuse_file *ff = in->private_data;
+	struct file *passthrough_filp = ff->passthrough_filp;
+	ssize_t ret_val;
+
+	if (!passthrough_filp->f_op->splice_read)
+		return -EINVAL;
+
+	ret_val = passthrough_filp->f_op->splice_read(passthrough_filp, ppos,
+						      pipe, len, flags);
+	if (ret_val >= 0)
+		fsstack_copy_attr_atime(file_inode(in),
+					file_inode(passthrough_filp));
+
+	return ret_val;
+}
+
+ssize_t fuse_passthrough_splice_write(struct pipe_inode_info *pipe,
+				      struct file *out, loff_t *ppos,
+				      size_t len, unsigned int flags)
+{
+	struct fuse_file *ff = out->private_data;
+	struct file *passthrough_filp = ff->passthrough_filp;
+	struct inode *fuse_inode = file_inode(out);
+	struct inode *passthrough_inode = file_inode(passthrough_filp);
+	ssize_t ret_val;
+
+	if (!passthrough_filp->f_op->splice_write)
+		return -EINVAL;
+
+	inode_lock(fuse_inode);
+	ret_val = passthrough_filp->f_op->splice_write(pipe, passthrough_filp,
+						       ppos, len, flags);
+	if (ret_val >= 0) {
+		spin_lock(&ff->fc->lock);
+		fsstack_copy_inode_size(fuse_inode, passthrough_inode);
+		spin_unlock(&ff->fc->lock);
+		fsstack_copy_attr_times(fuse_inode, passthrough_inode);
+	}
+	inode_unlock(fuse_inode);
+
+	return ret_val;
+}
+
+int fuse_passthrough_readdir(struct file *file, struct dir_context *ctx)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *passthrough_filp = ff->passthrough_filp;
+	const struct cred *old_cred;
+	int ret;
+
+	/* Seeks on the fuse directory never reach the passthrough one */
+	passthrough_filp->f_pos = ctx->pos;
+
+	/* The daemon opened the directory, list it with its credentials */
+	old_cred = override_creds(passthrough_filp->f_cred);
+	ret = iterate_dir(passthrough_filp, ctx);
+	revert_creds(old_cred);
+
+	fsstack_copy_attr_atime(file_inode(file), file_inode(passthrough_filp));
+
+	return ret;
+}
+
+/*
+ * Refreshes the size and times of the fuse inode from the passthrough
+ * file, which is where a GETATTR would have the daemon look them up.
+ */
+void fuse_passthrough_update_attr(struct file *file)
+{
+	struct fuse_file *ff = file->private_data;
+	struct inode *fuse_inode = file_inode(file);
+	struct inode *passthrough_inode = file_inode(ff->passthrough_filp);
+
+	spin_lock(&ff->fc->lock);
+	fsstack_copy_inode_size(fuse_inode, passthrough_inode);
+	spin_unlock(&ff->fc->lock);
+	fsstack_copy_attr_times(fuse_inode, passthrough_inode);
+}
+
 void fuse_passthrough_release(struct fuse_file *ff)
 {
 	if (!(ff->passthrough_filp))
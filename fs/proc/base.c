@@ -81,6 +81,7 @@
 #include <linux/poll.h>
 #include <linux/nsproxy.h>
 #include <linux/oom.h>
+#include <linux/adj_lru.h>
 #include <linux/elf.h>
 #include <linux/pid_namespace.h>
 #include <linux/user_namespace.h>
@@ -1124,6 +1125,7 @@ static int __set_oom_adj(struct file *file, int oom_adj, bool legacy)
 	if (!legacy && has_capability_noaudit(current, CAP_SYS_RESOURCE))
 		task->signal->oom_score_adj_min = (short)oom_adj;
 	trace_oom_score_adj_update(task);
+	adj_lru_update(task);
 
 	if (mm) {
 		struct task_struct *p;
@@ -1142,6 +1144,9 @@ static int __set_oom_adj(struct file *file, int oom_adj, bool legacy)
 				p->signal->oom_score_adj = oom_adj;
 				if (!legacy && has_capability_noaudit(current, CAP_SYS_RESOURCE))
 					p->signal->oom_score_adj_min = (short)oom_adj;
+				task_unlock(p);
+				adj_lru_update(p);
+				continue;
 			}
 			task_unlock(p);
 		}
@@ -1649,6 +1654,69 @@ static const struct file_operations proc_pid_sched_group_id_operations = {
 	.release	= single_release,
 };
 
+static int sched_frame_deadline_show(struct seq_file *m, void *v)
+{
+	struct inode *inode = m->private;
+	struct task_struct *p;
+
+	p = get_proc_task(inode);
+	if (!p)
+		return -ESRCH;
+
+	seq_printf(m, "%u\n", sched_get_frame_deadline(p));
+
+	put_task_struct(p);
+
+	return 0;
+}
+
+static ssize_t
+sched_frame_deadline_write(struct file *file, const char __user *buf,
+			   size_t count, loff_t *offset)
+{
+	struct inode *inode = file_inode(file);
+	struct task_struct *p;
+	char buffer[PROC_NUMBUF];
+	unsigned int period_us;
+	int err;
+
+	memset(buffer, 0, sizeof(buffer));
+	if (count > sizeof(buffer) - 1)
+		count = sizeof(buffer) - 1;
+	if (copy_from_user(buffer, buf, count)) {
+		err = -EFAULT;
+		goto out;
+	}
+
+	err = kstrtouint(strstrip(buffer), 0, &period_us);
+	if (err)
+		goto out;
+
+	p = get_proc_task(inode);
+	if (!p)
+		return -ESRCH;
+
+	err = sched_set_frame_deadline(p, period_us);
+
+	put_task_struct(p);
+
+out:
+	return err < 0 ? err : count;
+}
+
+static int sched_frame_deadline_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, sched_frame_deadline_show, inode);
+}
+
+static const struct file_operations proc_pid_sched_frame_deadline_operations = {
+	.open		= sched_frame_deadline_open,
+	.read		= seq_read,
+	.write		= sched_frame_deadline_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 #endif	/* CONFIG_SCHED_WALT */
 
 #ifdef CONFIG_SCHED_AUTOGROUP
@@ -3167,6 +3235,7 @@ static const struct pid_entry tgid_base_stuff[] = {
 #ifdef CONFIG_SCHED_WALT
 	REG("sched_init_task_load",      S_IRUGO|S_IWUSR, proc_pid_sched_init_task_load_operations),
 	REG("sched_group_id",      S_IRUGO|S_IWUGO, proc_pid_sched_group_id_operations),
+	REG("sched_frame_deadline", S_IRUGO|S_IWUSR, proc_pid_sched_frame_deadline_operations),
 #endif
 #ifdef CONFIG_SCHED_DEBUG
 	REG("sched",      S_IRUGO|S_IWUSR, proc_pid_sched_operations),
@@ -17,6 +17,7 @@
 #include <linux/shmem_fs.h>
 #include <linux/mm_inline.h>
 #include <linux/ctype.h>
+#include <linux/proc_reclaim.h>
 
 #include <asm/elf.h>
 #include <asm/uaccess.h>
@@ -1624,8 +1625,10 @@ static int reclaim_pte_range(pmd_t *pmd, unsigned long addr,
 	spinlock_t *ptl;
 	struct page *page;
 	LIST_HEAD(page_list);
+	LIST_HEAD(shared_list);
 	int isolated;
 	int reclaimed;
+	int mapcount;
 
 	split_huge_pmd(vma, addr, pmd);
 	if (pmd_trans_unstable(pmd) || !rp->nr_to_reclaim)
@@ -1642,13 +1645,21 @@ static int reclaim_pte_range(pmd_t *pmd, unsigned long addr,
 		if (!page)
 			continue;
 
-		if (page_mapcount(page) != 1)
+		mapcount = page_mapcount(page);
+		if (mapcount > rp->max_mapcount)
 			continue;
 
 		if (isolate_lru_page(page))
 			continue;
 
-		list_add(&page->lru, &page_list);
+		/*
+		 * Shared pages have to be unmapped from every process, or
+		 * they can neither be freed nor are worth writing to swap.
+		 */
+		if (mapcount > 1)
+			list_add(&page->lru, &shared_list);
+		else
+			list_add(&page->lru, &page_list);
 		inc_node_page_state(page, NR_ISOLATED_ANON +
 				page_is_file_cache(page));
 		isolated++;
@@ -1658,6 +1669,8 @@ static int reclaim_pte_range(pmd_t *pmd, unsigned long addr,
 	}
 	pte_unmap_unlock(pte - 1, ptl);
 	reclaimed = reclaim_pages_from_list(&page_list, vma);
+	if (!list_empty(&shared_list))
+		reclaimed += reclaim_pages_from_list(&shared_list, NULL);
 	rp->nr_reclaimed += reclaimed;
 	rp->nr_to_reclaim -= reclaimed;
 	if (rp->nr_to_reclaim < 0)
@@ -1687,6 +1700,7 @@ struct reclaim_param reclaim_task_anon(struct task_struct *task,
 
 	rp.nr_reclaimed = 0;
 	rp.nr_scanned = 0;
+	rp.max_mapcount = 1;
 	get_task_struct(task);
 	mm = get_task_mm(task);
 	if (!mm)
@@ -1725,6 +1739,35 @@ struct reclaim_param reclaim_task_anon(struct task_struct *task,
 	return rp;
 }
 
+/* Reclaim the pages of the given type mapped in [start, end) */
+static int reclaim_mm_range(struct mm_walk *walk, unsigned long start,
+			    unsigned long end, enum reclaim_type type)
+{
+	struct reclaim_param *rp = walk->private;
+	struct vm_area_struct *vma;
+	int ret = 0;
+
+	for (vma = find_vma(walk->mm, start); vma && vma->vm_start < end;
+	     vma = vma->vm_next) {
+		if (is_vm_hugetlb_page(vma))
+			continue;
+
+		if (type == RECLAIM_ANON && vma->vm_file)
+			continue;
+
+		if (type == RECLAIM_FILE && !vma->vm_file)
+			continue;
+
+		rp->vma = vma;
+		ret = walk_page_range(max(vma->vm_start, start),
+				min(vma->vm_end, end), walk);
+		if (ret || !rp->nr_to_reclaim)
+			break;
+	}
+
+	return ret;
+}
+
 static ssize_t reclaim_write(struct file *file, const char __user *buf,
 				size_t count, loff_t *ppos)
 {
@@ -1802,25 +1845,13 @@ static ssize_t reclaim_write(struct file *file, const char __user *buf,
 
 	rp.nr_to_reclaim = INT_MAX;
 	rp.nr_reclaimed = 0;
+	rp.nr_scanned = 0;
+	rp.max_mapcount = 1;
 	reclaim_walk.private = &rp;
 
 	down_read(&mm->mmap_sem);
 	if (type == RECLAIM_RANGE) {
-		vma = find_vma(mm, start);
-		while (vma) {
-			if (vma->vm_start > end)
-				break;
-			if (is_vm_hugetlb_page(vma))
-				continue;
-
-			rp.vma = vma;
-			ret = walk_page_range(max(vma->vm_start, start),
-					min(vma->vm_end, end),
-					&reclaim_walk);
-			if (ret)
-				break;
-			vma = vma->vm_next;
-		}
+		reclaim_mm_range(&reclaim_walk, start, end, RECLAIM_ALL);
 	} else {
 		for (vma = mm->mmap; vma; vma = vma->vm_next) {
 			if (is_vm_hugetlb_page(vma))
@@ -1851,8 +1882,161 @@ static ssize_t reclaim_write(struct file *file, const char __user *buf,
 	return -EINVAL;
 }
 
+/* Ranges copied from userspace and reclaimed per mmap_sem hold */
+#define RECLAIM_RANGE_BATCH	64
+
+static int reclaim_range_type(u32 type, enum reclaim_type *rtype)
+{
+	switch (type) {
+	case PROC_RECLAIM_FILE:
+		*rtype = RECLAIM_FILE;
+		break;
+	case PROC_RECLAIM_ANON:
+		*rtype = RECLAIM_ANON;
+		break;
+	case PROC_RECLAIM_ALL:
+		*rtype = RECLAIM_ALL;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * PROC_RECLAIM_IOC_RANGES reclaims a whole list of ranges, each with its
+ * own page type, in one call and reports the amount of memory scanned
+ * and reclaimed back to the caller.
+ */
+static long reclaim_ranges(struct file *file,
+			   struct proc_reclaim_ranges __user *uarg)
+{
+	struct proc_reclaim_range __user *uranges;
+	struct proc_reclaim_ranges req;
+	struct proc_reclaim_range *ranges;
+	struct mm_walk reclaim_walk = {};
+	struct reclaim_param rp;
+	struct task_struct *task;
+	struct mm_struct *mm;
+	enum reclaim_type types[RECLAIM_RANGE_BATCH];
+	unsigned int done, nr, i;
+	long ret = 0;
+
+	/* Same as writing to the file, which needs it opened for writing */
+	if (!(file->f_mode & FMODE_WRITE))
+		return -EBADF;
+
+	if (copy_from_user(&req, uarg, sizeof(req)))
+		return -EFAULT;
+
+	if (!req.nr_ranges || req.nr_ranges > PROC_RECLAIM_MAX_RANGES)
+		return -EINVAL;
+
+	/* Shared pages are unmapped from every process that maps them */
+	if (req.max_mapcount > 1 && !capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	uranges = u64_to_user_ptr(req.ranges);
+	ranges = kmalloc_array(RECLAIM_RANGE_BATCH, sizeof(*ranges),
+			       GFP_KERNEL);
+	if (!ranges)
+		return -ENOMEM;
+
+	task = get_proc_task(file_inode(file));
+	if (!task) {
+		ret = -ESRCH;
+		goto out_free;
+	}
+
+	mm = get_task_mm(task);
+	if (!mm)
+		goto out_task;
+
+	reclaim_walk.mm = mm;
+	reclaim_walk.pmd_entry = reclaim_pte_range;
+
+	rp.nr_to_reclaim = INT_MAX;
+	rp.nr_reclaimed = 0;
+	rp.nr_scanned = 0;
+	rp.max_mapcount = req.max_mapcount ? : 1;
+	reclaim_walk.private = &rp;
+
+	for (done = 0; done < req.nr_ranges; done += nr) {
+		nr = min_t(unsigned int, req.nr_ranges - done,
+			   RECLAIM_RANGE_BATCH);
+
+		/* Copy before taking mmap_sem, the target may be current */
+		if (copy_from_user(ranges, uranges + done,
+				   nr * sizeof(*ranges))) {
+			ret = -EFAULT;
+			break;
+		}
+
+		for (i = 0; i < nr; i++) {
+			u64 start = ranges[i].start;
+			u64 len = PAGE_ALIGN(ranges[i].len);
+
+			if (start & ~PAGE_MASK || start > ULONG_MAX ||
+			    (ranges[i].len && !len) || start + len < start ||
+			    start + len > ULONG_MAX ||
+			    reclaim_range_type(ranges[i].type, &types[i]) ||
+			    ranges[i].reserved) {
+				ret = -EINVAL;
+				break;
+			}
+		}
+		if (ret)
+			break;
+
+		down_read(&mm->mmap_sem);
+		for (i = 0; i < nr; i++) {
+			unsigned long start = ranges[i].start;
+			unsigned long end = start + PAGE_ALIGN(ranges[i].len);
+
+			if (reclaim_mm_range(&reclaim_walk, start, end,
+					     types[i]))
+				break;
+		}
+		flush_tlb_mm(mm);
+		up_read(&mm->mmap_sem);
+
+		if (fatal_signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+	}
+
+	mmput(mm);
+
+	req.bytes_scanned = (u64)rp.nr_scanned << PAGE_SHIFT;
+	req.bytes_reclaimed = (u64)rp.nr_reclaimed << PAGE_SHIFT;
+	if (copy_to_user(uarg, &req, sizeof(req)) && !ret)
+		ret = -EFAULT;
+out_task:
+	put_task_struct(task);
+out_free:
+	kfree(ranges);
+	return ret;
+}
+
+static long reclaim_ioctl(struct file *file, unsigned int cmd,
+			  unsigned long arg)
+{
+	switch (cmd) {
+	case PROC_RECLAIM_IOC_RANGES:
+		return reclaim_ranges(file, (void __user *)arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
 const struct file_operations proc_reclaim_operations = {
 	.write		= reclaim_write,
+	.unlocked_ioctl	= reclaim_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl	= reclaim_ioctl,
+#endif
 	.llseek		= noop_llseek,
 };
 #endif
@@ -48,6 +48,148 @@ void setup_derived_state(struct inode *inode, perm_t perm, userid_t userid,
 	info->data->under_obb = false;
 }
 
+/*
+ * @hash is the d_hash of the name, which sdcardfs_hash_ci() salts with the
+ * parent dentry. The same package name under Android/data, obb and media
+ * therefore gets an entry per tree.
+ */
+struct perm_cache_entry {
+	struct hlist_node hlist;
+	struct rcu_head rcu;
+	userid_t userid;
+	appid_t appid;
+	u32 hash;
+	u32 len;
+	char name[];
+};
+
+void perm_cache_init(struct sdcardfs_perm_cache *cache)
+{
+	spin_lock_init(&cache->lock);
+	hash_init(cache->entries);
+	cache->generation = packagelist_generation();
+	cache->nr_entries = 0;
+}
+
+static void perm_cache_flush_locked(struct sdcardfs_perm_cache *cache)
+{
+	struct perm_cache_entry *entry;
+	struct hlist_node *tmp;
+	int bkt;
+
+	hash_for_each_safe(cache->entries, bkt, tmp, entry, hlist) {
+		hash_del_rcu(&entry->hlist);
+		kfree_rcu(entry, rcu);
+	}
+	cache->nr_entries = 0;
+}
+
+void perm_cache_destroy(struct sdcardfs_perm_cache *cache)
+{
+	spin_lock(&cache->lock);
+	perm_cache_flush_locked(cache);
+	spin_unlock(&cache->lock);
+}
+
+static bool perm_cache_match(const struct perm_cache_entry *entry,
+		const struct qstr *name, userid_t userid)
+{
+	return entry->hash == name->hash && entry->userid == userid &&
+		entry->len == name->len &&
+		str_n_case_eq(entry->name, name->name, name->len);
+}
+
+/*
+ * Entries only ever move forward in generation: a lookup that sampled an
+ * older generation than the cache holds just bypasses it.
+ */
+static bool perm_cache_lookup(struct sdcardfs_perm_cache *cache,
+		const struct qstr *name, userid_t userid, unsigned int gen,
+		appid_t *appid)
+{
+	struct perm_cache_entry *entry;
+	bool found = false;
+
+	if (READ_ONCE(cache->generation) != gen) {
+		if ((int)(gen - READ_ONCE(cache->generation)) < 0)
+			return false;
+		spin_lock(&cache->lock);
+		if ((int)(gen - cache->generation) > 0) {
+			perm_cache_flush_locked(cache);
+			WRITE_ONCE(cache->generation, gen);
+		}
+		spin_unlock(&cache->lock);
+		return false;
+	}
+
+	rcu_read_lock();
+	hash_for_each_possible_rcu(cache->entries, entry, hlist, name->hash) {
+		if (perm_cache_match(entry, name, userid)) {
+			*appid = entry->appid;
+			found = true;
+			break;
+		}
+	}
+	rcu_read_unlock();
+	return found;
+}
+
+static void perm_cache_insert(struct sdcardfs_perm_cache *cache,
+		const struct qstr *name, userid_t userid, unsigned int gen,
+		appid_t appid)
+{
+	struct perm_cache_entry *entry, *old;
+
+	/* Callers may hold d_lock, see __fixup_perms_recursive() */
+	entry = kmalloc(sizeof(*entry) + name->len + 1, GFP_NOWAIT);
+	if (!entry)
+		return;
+	entry->userid = userid;
+	entry->appid = appid;
+	entry->hash = name->hash;
+	entry->len = name->len;
+	memcpy(entry->name, name->name, name->len);
+	entry->name[name->len] = '\0';
+
+	spin_lock(&cache->lock);
+	if (cache->generation != gen)
+		goto out_free;
+	hash_for_each_possible(cache->entries, old, hlist, name->hash) {
+		if (perm_cache_match(old, name, userid))
+			goto out_free;
+	}
+	if (cache->nr_entries >= PERM_CACHE_MAX)
+		perm_cache_flush_locked(cache);
+	hash_add_rcu(cache->entries, &entry->hlist, name->hash);
+	cache->nr_entries++;
+	spin_unlock(&cache->lock);
+	return;
+
+out_free:
+	spin_unlock(&cache->lock);
+	kfree(entry);
+}
+
+/*
+ * Resolve the appid owning a package directory, or 0 if it has none or
+ * @userid is excluded from it. @name must have been hashed by d_hash.
+ */
+static appid_t get_package_appid(struct sdcardfs_sb_info *sbi,
+		const struct qstr *name, userid_t userid)
+{
+	unsigned int gen = packagelist_generation();
+	appid_t appid;
+
+	if (perm_cache_lookup(&sbi->perm_cache, name, userid, gen, &appid))
+		return appid;
+
+	appid = get_appid(name->name);
+	if (appid != 0 && is_excluded(name->name, userid))
+		appid = 0;
+	perm_cache_insert(&sbi->perm_cache, name, userid, gen, appid);
+	return appid;
+}
+
 /* While renaming, there is a point where we want the path from dentry,
  * but the name from newdentry
  */
@@ -130,8 +272,9 @@ void get_derived_permission_new(struct dentry *parent, struct dentry *dentry,
 	case PERM_ANDROID_DATA:
 	case PERM_ANDROID_MEDIA:
 		info->data->perm = PERM_ANDROID_PACKAGE;
-		appid = get_appid(name->name);
-		if (appid != 0 && !is_excluded(name->name, parent_data->userid))
+		appid = get_package_appid(SDCARDFS_SB(parent->d_sb), name,
+					  parent_data->userid);
+		if (appid != 0)
 			info->data->d_uid =
 				multiuser_get_uid(parent_data->userid, appid);
 		break;
@@ -310,8 +453,11 @@ static void __fixup_perms_recursive(struct dentry *dentry, struct limit_search *
 				if (d_inode(child)) {
 					get_derived_permission(dentry, child);
 					fixup_tmp_permissions(d_inode(child));
-					spin_unlock(&child->d_lock);
-					break;
+					/* Only one child can match a name */
+					if (limit->flags & BY_NAME) {
+						spin_unlock(&child->d_lock);
+						break;
+					}
 				}
 			}
 			spin_unlock(&child->d_lock);
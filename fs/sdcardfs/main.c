@@ -297,6 +297,7 @@ static int sdcardfs_read_super(struct vfsmount *mnt, struct super_block *sb,
 	}
 
 	sb_info = sb->s_fs_info;
+	perm_cache_init(&sb_info->perm_cache);
 	/* parse options */
 	err = parse_options(sb, raw_data, silent, &debug, mnt_opt, &sb_info->options);
 	if (err) {
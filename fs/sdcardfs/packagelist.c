@@ -19,7 +19,11 @@
  */
 
 #include "sdcardfs.h"
-#include <linux/hashtable.h>
+#include <linux/rhashtable.h>
+#include <linux/jhash.h>
+#include <linux/seqlock.h>
+#include <linux/vmalloc.h>
+#include <linux/sizes.h>
 #include <linux/ctype.h>
 #include <linux/delay.h>
 #include <linux/radix-tree.h>
@@ -32,18 +36,56 @@
 #include <linux/configfs.h>
 
 struct hashtable_entry {
-	struct hlist_node hlist;
-	struct hlist_node dlist; /* for deletion cleanup */
+	union {
+		struct rhash_head node;		/* package_to_appid, ext_to_groupid */
+		struct rhlist_head lnode;	/* package_to_userid */
+	};
+	struct list_head dlist; /* for batches and deletion cleanup */
+	struct rcu_head rcu;
 	struct qstr key;
 	atomic_t value;
+	bool doomed;	/* unhashed by the batch being applied */
 };
 
-static DEFINE_HASHTABLE(package_to_appid, 8);
-static DEFINE_HASHTABLE(package_to_userid, 8);
-static DEFINE_HASHTABLE(ext_to_groupid, 8);
+/*
+ * All three tables are keyed by case insensitive name, and hashed with the
+ * full_name_case_hash() value that qstr_init() stores in the key.
+ * package_to_userid holds one entry per excluded userid of a package.
+ * Readers are lockless, writers are serialized by sdcardfs_super_list_lock.
+ */
+static struct rhashtable package_to_appid;
+static struct rhltable package_to_userid;
+static struct rhashtable ext_to_groupid;
 
+/*
+ * Lets readers of package_to_appid and package_to_userid retry instead of
+ * seeing half of a packages_update batch, see packagelist_apply_batch().
+ */
+static seqcount_t packagelist_seq = SEQCNT_ZERO(packagelist_seq);
 
 static struct kmem_cache *hashtable_entry_cachep;
+static bool packagelist_ready;
+
+/*
+ * Bumped after every change to package_to_appid or package_to_userid, so
+ * that the per superblock caches of derived package uids can tell their
+ * entries went stale.
+ */
+static atomic_t packagelist_gen = ATOMIC_INIT(0);
+
+static inline void packagelist_changed(void)
+{
+	smp_mb__before_atomic();
+	atomic_inc(&packagelist_gen);
+}
+
+unsigned int packagelist_generation(void)
+{
+	unsigned int gen = atomic_read(&packagelist_gen);
+
+	smp_rmb();
+	return gen;
+}
 
 static unsigned int full_name_case_hash(const void *salt, const unsigned char *name, unsigned int len)
 {
@@ -68,23 +110,72 @@ static inline int qstr_copy(const struct qstr *src, struct qstr *dest)
 	return !!dest->name;
 }
 
+static u32 packagelist_key_hash(const void *data, u32 len, u32 seed)
+{
+	const struct qstr *key = data;
+
+	return jhash_1word(key->hash, seed);
+}
+
+static u32 packagelist_obj_hash(const void *data, u32 len, u32 seed)
+{
+	const struct hashtable_entry *entry = data;
+
+	return jhash_1word(entry->key.hash, seed);
+}
+
+static int packagelist_obj_cmp(struct rhashtable_compare_arg *arg,
+		const void *obj)
+{
+	const struct hashtable_entry *entry = obj;
+
+	return !qstr_case_eq(arg->key, &entry->key);
+}
+
+static const struct rhashtable_params packagelist_params = {
+	.head_offset		= offsetof(struct hashtable_entry, node),
+	.key_offset		= offsetof(struct hashtable_entry, key),
+	.hashfn			= packagelist_key_hash,
+	.obj_hashfn		= packagelist_obj_hash,
+	.obj_cmpfn		= packagelist_obj_cmp,
+	.automatic_shrinking	= true,
+};
+
+/*
+ * package_to_appid and package_to_userid are sized for the packages of a
+ * typical device from the start, and never shrink below that. A boot time
+ * packages_update batch then fits without growing the tables from atomic
+ * context, see packagelist_apply_batch().
+ */
+#define PACKAGELIST_NELEM_HINT	1536
+#define PACKAGELIST_MIN_SIZE	2048
+
+static const struct rhashtable_params packagelist_table_params = {
+	.nelem_hint		= PACKAGELIST_NELEM_HINT,
+	.min_size		= PACKAGELIST_MIN_SIZE,
+	.head_offset		= offsetof(struct hashtable_entry, node),
+	.key_offset		= offsetof(struct hashtable_entry, key),
+	.hashfn			= packagelist_key_hash,
+	.obj_hashfn		= packagelist_obj_hash,
+	.obj_cmpfn		= packagelist_obj_cmp,
+	.automatic_shrinking	= true,
+};
 
 static appid_t __get_appid(const struct qstr *key)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
 	appid_t ret_id;
+	unsigned int seq;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			ret_id = atomic_read(&hash_cur->value);
-			rcu_read_unlock();
-			return ret_id;
-		}
-	}
+	do {
+		seq = read_seqcount_begin(&packagelist_seq);
+		hash_cur = rhashtable_lookup(&package_to_appid, key,
+					     packagelist_params);
+		ret_id = hash_cur ? atomic_read(&hash_cur->value) : 0;
+	} while (read_seqcount_retry(&packagelist_seq, seq));
 	rcu_read_unlock();
-	return 0;
+	return ret_id;
 }
 
 appid_t get_appid(const char *key)
@@ -98,19 +189,14 @@ appid_t get_appid(const char *key)
 static appid_t __get_ext_gid(const struct qstr *key)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
-	appid_t ret_id;
+	appid_t ret_id = 0;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(ext_to_groupid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			ret_id = atomic_read(&hash_cur->value);
-			rcu_read_unlock();
-			return ret_id;
-		}
-	}
+	hash_cur = rhashtable_lookup(&ext_to_groupid, key, packagelist_params);
+	if (hash_cur)
+		ret_id = atomic_read(&hash_cur->value);
 	rcu_read_unlock();
-	return 0;
+	return ret_id;
 }
 
 appid_t get_ext_gid(const char *key)
@@ -121,21 +207,39 @@ appid_t get_ext_gid(const char *key)
 	return __get_ext_gid(&q);
 }
 
-static appid_t __is_excluded(const struct qstr *app_name, userid_t user)
+/* Must be called under rcu_read_lock() */
+static struct hashtable_entry *find_userid_entry(const struct qstr *app_name,
+		userid_t user)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = app_name->hash;
+	struct rhlist_head *list, *pos;
 
-	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (atomic_read(&hash_cur->value) == user &&
-				qstr_case_eq(app_name, &hash_cur->key)) {
-			rcu_read_unlock();
-			return 1;
-		}
+	list = rhltable_lookup(&package_to_userid, app_name,
+			       packagelist_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, lnode) {
+		if (atomic_read(&hash_cur->value) == user)
+			return hash_cur;
 	}
+	return NULL;
+}
+
+static bool userid_entry_exists(const struct qstr *app_name, userid_t user)
+{
+	return find_userid_entry(app_name, user) != NULL;
+}
+
+static appid_t __is_excluded(const struct qstr *app_name, userid_t user)
+{
+	unsigned int seq;
+	bool ret;
+
+	rcu_read_lock();
+	do {
+		seq = read_seqcount_begin(&packagelist_seq);
+		ret = userid_entry_exists(app_name, user);
+	} while (read_seqcount_retry(&packagelist_seq, seq));
 	rcu_read_unlock();
-	return 0;
+	return ret;
 }
 
 appid_t is_excluded(const char *key, userid_t user)
@@ -181,8 +285,8 @@ static struct hashtable_entry *alloc_hashtable_entry(const struct qstr *key,
 			GFP_KERNEL);
 	if (!ret)
 		return NULL;
-	INIT_HLIST_NODE(&ret->dlist);
-	INIT_HLIST_NODE(&ret->hlist);
+	INIT_LIST_HEAD(&ret->dlist);
+	ret->doomed = false;
 
 	if (!qstr_copy(key, &ret->key)) {
 		kmem_cache_free(hashtable_entry_cachep, ret);
@@ -193,60 +297,140 @@ static struct hashtable_entry *alloc_hashtable_entry(const struct qstr *key,
 	return ret;
 }
 
-static int insert_packagelist_appid_entry_locked(const struct qstr *key, appid_t value)
+static void free_hashtable_entry(struct hashtable_entry *entry)
+{
+	kfree(entry->key.name);
+	kmem_cache_free(hashtable_entry_cachep, entry);
+}
+
+static void free_hashtable_entry_rcu(struct rcu_head *head)
+{
+	free_hashtable_entry(container_of(head, struct hashtable_entry, rcu));
+}
+
+/* Frees entries that never made it into a table */
+static void free_hashtable_entries(struct list_head *free_list)
+{
+	struct hashtable_entry *hash_cur, *h_t;
+
+	list_for_each_entry_safe(hash_cur, h_t, free_list, dlist)
+		free_hashtable_entry(hash_cur);
+	INIT_LIST_HEAD(free_list);
+}
+
+/* Frees entries unhashed from a table once lockless readers are done */
+static void free_hashtable_entries_rcu(struct list_head *free_list)
+{
+	struct hashtable_entry *hash_cur, *h_t;
+
+	list_for_each_entry_safe(hash_cur, h_t, free_list, dlist)
+		call_rcu(&hash_cur->rcu, free_hashtable_entry_rcu);
+	INIT_LIST_HEAD(free_list);
+}
+
+/*
+ * Sets the appid of @new_entry's package. @new_entry is queued on @unused
+ * if the package was already known or could not be added.
+ */
+static int publish_appid_entry_locked(struct hashtable_entry *new_entry,
+		struct list_head *unused)
 {
 	struct hashtable_entry *hash_cur;
-	struct hashtable_entry *new_entry;
-	unsigned int hash = key->hash;
+	int err;
 
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			atomic_set(&hash_cur->value, value);
-			return 0;
-		}
+	hash_cur = rhashtable_lookup_fast(&package_to_appid, &new_entry->key,
+					  packagelist_params);
+	if (hash_cur) {
+		atomic_set(&hash_cur->value, atomic_read(&new_entry->value));
+		list_add(&new_entry->dlist, unused);
+		return 0;
+	}
+	err = rhashtable_insert_fast(&package_to_appid, &new_entry->node,
+				     packagelist_params);
+	if (err)
+		list_add(&new_entry->dlist, unused);
+	return err;
+}
+
+/* Same as above for a userid excluded from @new_entry's package */
+static int publish_userid_entry_locked(struct hashtable_entry *new_entry,
+		struct list_head *unused)
+{
+	bool exists;
+	int err;
+
+	/* Only insert if not already present */
+	rcu_read_lock();
+	exists = userid_entry_exists(&new_entry->key,
+				     atomic_read(&new_entry->value));
+	rcu_read_unlock();
+	if (exists) {
+		list_add(&new_entry->dlist, unused);
+		return 0;
 	}
+	err = rhltable_insert(&package_to_userid, &new_entry->lnode,
+			      packagelist_params);
+	if (err)
+		list_add(&new_entry->dlist, unused);
+	return err;
+}
+
+static int insert_packagelist_appid_entry_locked(const struct qstr *key, appid_t value)
+{
+	struct hashtable_entry *new_entry;
+	LIST_HEAD(unused);
+	int err;
+
 	new_entry = alloc_hashtable_entry(key, value);
 	if (!new_entry)
 		return -ENOMEM;
-	hash_add_rcu(package_to_appid, &new_entry->hlist, hash);
-	return 0;
+	err = publish_appid_entry_locked(new_entry, &unused);
+	free_hashtable_entries(&unused);
+	return err;
 }
 
 static int insert_ext_gid_entry_locked(const struct qstr *key, appid_t value)
 {
-	struct hashtable_entry *hash_cur;
 	struct hashtable_entry *new_entry;
-	unsigned int hash = key->hash;
+	int err;
 
-	/* An extension can only belong to one gid */
-	hash_for_each_possible_rcu(ext_to_groupid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key))
-			return -EINVAL;
-	}
 	new_entry = alloc_hashtable_entry(key, value);
 	if (!new_entry)
 		return -ENOMEM;
-	hash_add_rcu(ext_to_groupid, &new_entry->hlist, hash);
+	/* An extension can only belong to one gid */
+	err = rhashtable_lookup_insert_key(&ext_to_groupid, &new_entry->key,
+					   &new_entry->node, packagelist_params);
+	if (err) {
+		free_hashtable_entry(new_entry);
+		return err == -EEXIST ? -EINVAL : err;
+	}
 	return 0;
 }
 
 static int insert_userid_exclude_entry_locked(const struct qstr *key, userid_t value)
 {
-	struct hashtable_entry *hash_cur;
 	struct hashtable_entry *new_entry;
-	unsigned int hash = key->hash;
+	LIST_HEAD(unused);
+	int err;
 
-	/* Only insert if not already present */
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (atomic_read(&hash_cur->value) == value &&
-				qstr_case_eq(key, &hash_cur->key))
-			return 0;
-	}
 	new_entry = alloc_hashtable_entry(key, value);
 	if (!new_entry)
 		return -ENOMEM;
-	hash_add_rcu(package_to_userid, &new_entry->hlist, hash);
-	return 0;
+	err = publish_userid_entry_locked(new_entry, &unused);
+	free_hashtable_entries(&unused);
+	return err;
+}
+
+static void fixup_all_perms(void)
+{
+	struct sdcardfs_sb_info *sbinfo;
+	struct limit_search limit = {
+		.flags = 0,
+	};
+	list_for_each_entry(sbinfo, &sdcardfs_super_list, list) {
+		if (sbinfo_has_sdcard_magic(sbinfo))
+			fixup_perms_recursive(sbinfo->sb->s_root, &limit);
+	}
 }
 
 static void fixup_all_perms_name(const struct qstr *key)
@@ -295,8 +479,10 @@ static int insert_packagelist_entry(const struct qstr *key, appid_t value)
 
 	mutex_lock(&sdcardfs_super_list_lock);
 	err = insert_packagelist_appid_entry_locked(key, value);
-	if (!err)
+	if (!err) {
+		packagelist_changed();
 		fixup_all_perms_name(key);
+	}
 	mutex_unlock(&sdcardfs_super_list_lock);
 
 	return err;
@@ -319,65 +505,63 @@ static int insert_userid_exclude_entry(const struct qstr *key, userid_t value)
 
 	mutex_lock(&sdcardfs_super_list_lock);
 	err = insert_userid_exclude_entry_locked(key, value);
-	if (!err)
+	if (!err) {
+		packagelist_changed();
 		fixup_all_perms_name_userid(key, value);
+	}
 	mutex_unlock(&sdcardfs_super_list_lock);
 
 	return err;
 }
 
-static void free_hashtable_entry(struct hashtable_entry *entry)
-{
-	kfree(entry->key.name);
-	kmem_cache_free(hashtable_entry_cachep, entry);
-}
-
-static void remove_packagelist_entry_locked(const struct qstr *key)
+/* Unhashes everything known about package @key, queueing it on @free_list */
+static void unhash_packagelist_entry_locked(const struct qstr *key,
+		struct list_head *free_list)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
-	struct hlist_node *h_t;
-	HLIST_HEAD(free_list);
-
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			hash_del_rcu(&hash_cur->hlist);
-			hlist_add_head(&hash_cur->dlist, &free_list);
-		}
-	}
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			hash_del_rcu(&hash_cur->hlist);
-			hlist_add_head(&hash_cur->dlist, &free_list);
-			break;
-		}
-	}
-	synchronize_rcu();
-	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist)
-		free_hashtable_entry(hash_cur);
+	struct rhlist_head *list, *pos;
+	LIST_HEAD(userids);
+
+	rcu_read_lock();
+	list = rhltable_lookup(&package_to_userid, key, packagelist_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, lnode)
+		list_add(&hash_cur->dlist, &userids);
+	rcu_read_unlock();
+	list_for_each_entry(hash_cur, &userids, dlist)
+		rhltable_remove(&package_to_userid, &hash_cur->lnode,
+				packagelist_params);
+	list_splice(&userids, free_list);
+
+	hash_cur = rhashtable_lookup_fast(&package_to_appid, key,
+					  packagelist_params);
+	if (hash_cur && !rhashtable_remove_fast(&package_to_appid,
+						&hash_cur->node,
+						packagelist_params))
+		list_add(&hash_cur->dlist, free_list);
 }
 
 static void remove_packagelist_entry(const struct qstr *key)
 {
+	LIST_HEAD(free_list);
+
 	mutex_lock(&sdcardfs_super_list_lock);
-	remove_packagelist_entry_locked(key);
+	unhash_packagelist_entry_locked(key, &free_list);
+	packagelist_changed();
 	fixup_all_perms_name(key);
 	mutex_unlock(&sdcardfs_super_list_lock);
+	free_hashtable_entries_rcu(&free_list);
 }
 
 static void remove_ext_gid_entry_locked(const struct qstr *key, gid_t group)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
 
-	hash_for_each_possible_rcu(ext_to_groupid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key) && atomic_read(&hash_cur->value) == group) {
-			hash_del_rcu(&hash_cur->hlist);
-			synchronize_rcu();
-			free_hashtable_entry(hash_cur);
-			break;
-		}
-	}
+	hash_cur = rhashtable_lookup_fast(&ext_to_groupid, key,
+					  packagelist_params);
+	if (hash_cur && atomic_read(&hash_cur->value) == group &&
+	    !rhashtable_remove_fast(&ext_to_groupid, &hash_cur->node,
+				    packagelist_params))
+		call_rcu(&hash_cur->rcu, free_hashtable_entry_rcu);
 }
 
 static void remove_ext_gid_entry(const struct qstr *key, gid_t group)
@@ -387,78 +571,349 @@ static void remove_ext_gid_entry(const struct qstr *key, gid_t group)
 	mutex_unlock(&sdcardfs_super_list_lock);
 }
 
-static void remove_userid_all_entry_locked(userid_t userid)
+static void remove_userid_all_entry_locked(userid_t userid,
+		struct list_head *free_list)
 {
 	struct hashtable_entry *hash_cur;
-	struct hlist_node *h_t;
-	HLIST_HEAD(free_list);
-	int i;
-
-	hash_for_each_rcu(package_to_userid, i, hash_cur, hlist) {
-		if (atomic_read(&hash_cur->value) == userid) {
-			hash_del_rcu(&hash_cur->hlist);
-			hlist_add_head(&hash_cur->dlist, &free_list);
+	struct rhashtable_iter iter;
+	LIST_HEAD(userids);
+
+	rhltable_walk_enter(&package_to_userid, &iter);
+	rhashtable_walk_start(&iter);
+	while ((hash_cur = rhashtable_walk_next(&iter))) {
+		if (IS_ERR(hash_cur)) {
+			/* Resized under us, entries may be seen twice */
+			if (PTR_ERR(hash_cur) == -EAGAIN)
+				continue;
+			break;
 		}
+		if (atomic_read(&hash_cur->value) == userid &&
+		    list_empty(&hash_cur->dlist))
+			list_add(&hash_cur->dlist, &userids);
 	}
-	synchronize_rcu();
-	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist) {
-		free_hashtable_entry(hash_cur);
-	}
+	rhashtable_walk_stop(&iter);
+	rhashtable_walk_exit(&iter);
+
+	list_for_each_entry(hash_cur, &userids, dlist)
+		rhltable_remove(&package_to_userid, &hash_cur->lnode,
+				packagelist_params);
+	list_splice(&userids, free_list);
 }
 
 static void remove_userid_all_entry(userid_t userid)
 {
+	LIST_HEAD(free_list);
+
 	mutex_lock(&sdcardfs_super_list_lock);
-	remove_userid_all_entry_locked(userid);
+	remove_userid_all_entry_locked(userid, &free_list);
+	packagelist_changed();
 	fixup_all_perms_userid(userid);
 	mutex_unlock(&sdcardfs_super_list_lock);
+	free_hashtable_entries_rcu(&free_list);
 }
 
 static void remove_userid_exclude_entry_locked(const struct qstr *key, userid_t userid)
 {
-	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
-
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key) &&
-				atomic_read(&hash_cur->value) == userid) {
-			hash_del_rcu(&hash_cur->hlist);
-			synchronize_rcu();
-			free_hashtable_entry(hash_cur);
+	struct hashtable_entry *hash_cur, *found = NULL;
+	struct rhlist_head *list, *pos;
+
+	rcu_read_lock();
+	list = rhltable_lookup(&package_to_userid, key, packagelist_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, lnode) {
+		if (atomic_read(&hash_cur->value) == userid) {
+			found = hash_cur;
 			break;
 		}
 	}
+	rcu_read_unlock();
+	if (found && !rhltable_remove(&package_to_userid, &found->lnode,
+				      packagelist_params))
+		call_rcu(&found->rcu, free_hashtable_entry_rcu);
 }
 
 static void remove_userid_exclude_entry(const struct qstr *key, userid_t userid)
 {
 	mutex_lock(&sdcardfs_super_list_lock);
 	remove_userid_exclude_entry_locked(key, userid);
+	packagelist_changed();
 	fixup_all_perms_name_userid(key, userid);
 	mutex_unlock(&sdcardfs_super_list_lock);
 }
 
+static void packagelist_free_entry(void *ptr, void *arg)
+{
+	free_hashtable_entry(ptr);
+}
+
 static void packagelist_destroy(void)
 {
-	struct hashtable_entry *hash_cur;
-	struct hlist_node *h_t;
-	HLIST_HEAD(free_list);
-	int i;
+	mutex_lock(&sdcardfs_super_list_lock);
+	rhashtable_free_and_destroy(&package_to_appid, packagelist_free_entry,
+				    NULL);
+	rhltable_free_and_destroy(&package_to_userid, packagelist_free_entry,
+				  NULL);
+	rhashtable_free_and_destroy(&ext_to_groupid, packagelist_free_entry,
+				    NULL);
+	packagelist_changed();
+	mutex_unlock(&sdcardfs_super_list_lock);
+	pr_info("sdcardfs: destroyed packagelist pkgld\n");
+}
+
+/*
+ * A packages_update batch: the whole set of entries is allocated up front,
+ * so that it can be published in one go.
+ */
+struct packagelist_batch {
+	struct list_head appids;
+	struct list_head userids;
+	struct list_head removals;
+};
+
+static int packagelist_batch_add(struct list_head *list, const char *name,
+		unsigned int value)
+{
+	struct hashtable_entry *new_entry;
+	struct qstr q;
+
+	qstr_init(&q, name);
+	new_entry = alloc_hashtable_entry(&q, value);
+	if (!new_entry)
+		return -ENOMEM;
+	list_add_tail(&new_entry->dlist, list);
+	return 0;
+}
+
+static char *next_word(char **line)
+{
+	char *word;
+
+	do {
+		word = strsep(line, " \t");
+	} while (word && !*word);
+	return word;
+}
+
+/*
+ * One package per line:
+ *
+ *   <package> <appid> [<excluded userid>...]
+ *   -<package>
+ *
+ * The first form sets the appid of a package and adds userids it is
+ * excluded for, the second forgets the package and its exclusions.
+ *
+ * Removals are applied after everything else, whatever their position in
+ * the batch: a "-<package>" line never removes a package or an exclusion
+ * that the same batch adds.
+ */
+static int packagelist_parse_line(char *line, struct packagelist_batch *batch)
+{
+	char *name, *word;
+	unsigned int value;
+	int err;
+
+	name = next_word(&line);
+	if (!name || *name == '#')
+		return 0;
+	if (*name == '-') {
+		if (!name[1] || next_word(&line))
+			return -EINVAL;
+		return packagelist_batch_add(&batch->removals, name + 1, 0);
+	}
+
+	word = next_word(&line);
+	if (!word)
+		return -EINVAL;
+	err = kstrtouint(word, 10, &value);
+	if (!err)
+		err = packagelist_batch_add(&batch->appids, name, value);
+	while (!err && (word = next_word(&line))) {
+		err = kstrtouint(word, 10, &value);
+		if (!err)
+			err = packagelist_batch_add(&batch->userids, name, value);
+	}
+	return err;
+}
+
+static int packagelist_parse_batch(char *buf, struct packagelist_batch *batch)
+{
+	unsigned int lineno = 0;
+	char *line;
+	int err;
+
+	while ((line = strsep(&buf, "\n")) != NULL) {
+		lineno++;
+		err = packagelist_parse_line(line, batch);
+		if (err) {
+			pr_warn("sdcardfs: packages_update: line %u: error %d\n",
+				lineno, err);
+			return err;
+		}
+	}
+	return 0;
+}
+
+static void doom_entry(struct hashtable_entry *hash_cur,
+		struct list_head *victims)
+{
+	if (!hash_cur->doomed) {
+		hash_cur->doomed = true;
+		list_add(&hash_cur->dlist, victims);
+	}
+}
+
+/* Keeps an entry a removal was about to drop, as the batch adds it again */
+static void spare_entry(struct hashtable_entry *hash_cur)
+{
+	if (hash_cur->doomed) {
+		hash_cur->doomed = false;
+		list_del_init(&hash_cur->dlist);
+	}
+}
+
+static void spare_entries(struct list_head *victims)
+{
+	struct hashtable_entry *hash_cur, *h_t;
+
+	list_for_each_entry_safe(hash_cur, h_t, victims, dlist)
+		spare_entry(hash_cur);
+}
+
+/* Collects the table entries the removals of @batch drop */
+static void packagelist_doom_removals(struct packagelist_batch *batch,
+		struct list_head *doomed_appids,
+		struct list_head *doomed_userids)
+{
+	struct hashtable_entry *key_ent, *hash_cur;
+	struct rhlist_head *list, *pos;
+
+	list_for_each_entry(key_ent, &batch->removals, dlist) {
+		rcu_read_lock();
+		list = rhltable_lookup(&package_to_userid, &key_ent->key,
+				       packagelist_params);
+		rhl_for_each_entry_rcu(hash_cur, pos, list, lnode)
+			doom_entry(hash_cur, doomed_userids);
+		rcu_read_unlock();
+
+		hash_cur = rhashtable_lookup_fast(&package_to_appid,
+						  &key_ent->key,
+						  packagelist_params);
+		if (hash_cur)
+			doom_entry(hash_cur, doomed_appids);
+	}
+}
+
+/*
+ * Readers retry on packagelist_seq rather than see part of the batch. The
+ * entries are all allocated, so nothing in the write section sleeps and
+ * a single fixup walk covers every package that changed.
+ *
+ * Only inserting can fail, when a table has to grow from atomic context.
+ * So new entries go in first, and are taken out again on failure, before
+ * any existing entry is changed or removed. A batch is applied whole or
+ * not at all.
+ */
+static int packagelist_apply_batch(struct packagelist_batch *batch,
+		struct list_head *free_list, struct list_head *unused)
+{
+	struct hashtable_entry *hash_cur, *h_t;
+	LIST_HEAD(doomed_appids);
+	LIST_HEAD(doomed_userids);
+	LIST_HEAD(new_appids);
+	LIST_HEAD(new_userids);
+	LIST_HEAD(updates);
+	int err = 0;
 
 	mutex_lock(&sdcardfs_super_list_lock);
-	hash_for_each_rcu(package_to_appid, i, hash_cur, hlist) {
-		hash_del_rcu(&hash_cur->hlist);
-		hlist_add_head(&hash_cur->dlist, &free_list);
+	packagelist_doom_removals(batch, &doomed_appids, &doomed_userids);
+
+	preempt_disable();
+	write_seqcount_begin(&packagelist_seq);
+	list_for_each_entry_safe(hash_cur, h_t, &batch->appids, dlist) {
+		struct hashtable_entry *old;
+
+		old = rhashtable_lookup_fast(&package_to_appid,
+					     &hash_cur->key,
+					     packagelist_params);
+		if (old) {
+			spare_entry(old);
+			list_move_tail(&hash_cur->dlist, &updates);
+			continue;
+		}
+		err = rhashtable_insert_fast(&package_to_appid,
+					     &hash_cur->node,
+					     packagelist_params);
+		if (err)
+			goto rollback;
+		list_move_tail(&hash_cur->dlist, &new_appids);
 	}
-	hash_for_each_rcu(package_to_userid, i, hash_cur, hlist) {
-		hash_del_rcu(&hash_cur->hlist);
-		hlist_add_head(&hash_cur->dlist, &free_list);
+	list_for_each_entry_safe(hash_cur, h_t, &batch->userids, dlist) {
+		struct hashtable_entry *old;
+
+		rcu_read_lock();
+		old = find_userid_entry(&hash_cur->key,
+					atomic_read(&hash_cur->value));
+		rcu_read_unlock();
+		if (old) {
+			spare_entry(old);
+			list_move(&hash_cur->dlist, unused);
+			continue;
+		}
+		err = rhltable_insert(&package_to_userid, &hash_cur->lnode,
+				      packagelist_params);
+		if (err)
+			goto rollback;
+		list_move_tail(&hash_cur->dlist, &new_userids);
 	}
-	synchronize_rcu();
-	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist)
-		free_hashtable_entry(hash_cur);
+
+	/* Nothing below can fail */
+	list_for_each_entry_safe(hash_cur, h_t, &updates, dlist) {
+		struct hashtable_entry *old;
+
+		old = rhashtable_lookup_fast(&package_to_appid,
+					     &hash_cur->key,
+					     packagelist_params);
+		atomic_set(&old->value, atomic_read(&hash_cur->value));
+		list_move(&hash_cur->dlist, unused);
+	}
+	list_for_each_entry(hash_cur, &doomed_userids, dlist)
+		rhltable_remove(&package_to_userid, &hash_cur->lnode,
+				packagelist_params);
+	list_for_each_entry(hash_cur, &doomed_appids, dlist)
+		rhashtable_remove_fast(&package_to_appid, &hash_cur->node,
+				       packagelist_params);
+	list_splice_init(&doomed_userids, free_list);
+	list_splice_init(&doomed_appids, free_list);
+	list_for_each_entry_safe(hash_cur, h_t, &new_appids, dlist)
+		list_del_init(&hash_cur->dlist);
+	list_for_each_entry_safe(hash_cur, h_t, &new_userids, dlist)
+		list_del_init(&hash_cur->dlist);
+	write_seqcount_end(&packagelist_seq);
+	preempt_enable();
+	packagelist_changed();
+	fixup_all_perms();
 	mutex_unlock(&sdcardfs_super_list_lock);
-	pr_info("sdcardfs: destroyed packagelist pkgld\n");
+
+	return 0;
+
+rollback:
+	/* Lockless readers may have seen these, free them via RCU */
+	list_for_each_entry(hash_cur, &new_userids, dlist)
+		rhltable_remove(&package_to_userid, &hash_cur->lnode,
+				packagelist_params);
+	list_for_each_entry(hash_cur, &new_appids, dlist)
+		rhashtable_remove_fast(&package_to_appid, &hash_cur->node,
+				       packagelist_params);
+	list_splice_init(&new_userids, free_list);
+	list_splice_init(&new_appids, free_list);
+	list_splice_init(&updates, unused);
+	spare_entries(&doomed_userids);
+	spare_entries(&doomed_appids);
+	write_seqcount_end(&packagelist_seq);
+	preempt_enable();
+	mutex_unlock(&sdcardfs_super_list_lock);
+
+	return err;
 }
 
 #define SDCARDFS_CONFIGFS_ATTR(_pfx, _name)			\
@@ -524,15 +979,15 @@ static ssize_t package_details_excluded_userids_show(struct config_item *item,
 {
 	struct package_details *package_details = to_package_details(item);
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = package_details->name.hash;
+	struct rhlist_head *list, *pos;
 	int count = 0;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(&package_details->name, &hash_cur->key))
-			count += scnprintf(page + count, PAGE_SIZE - count,
-					"%d ", atomic_read(&hash_cur->value));
-	}
+	list = rhltable_lookup(&package_to_userid, &package_details->name,
+			       packagelist_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, lnode)
+		count += scnprintf(page + count, PAGE_SIZE - count,
+				"%d ", atomic_read(&hash_cur->value));
 	rcu_read_unlock();
 	if (count)
 		count--;
@@ -751,22 +1206,30 @@ static ssize_t packages_list_show(struct config_item *item, char *page)
 {
 	struct hashtable_entry *hash_cur_app;
 	struct hashtable_entry *hash_cur_user;
-	int i;
+	struct rhlist_head *list, *pos;
+	struct rhashtable_iter iter;
 	int count = 0, written = 0;
 	const char errormsg[] = "<truncated>\n";
-	unsigned int hash;
 
-	rcu_read_lock();
-	hash_for_each_rcu(package_to_appid, i, hash_cur_app, hlist) {
+	rhashtable_walk_enter(&package_to_appid, &iter);
+	rhashtable_walk_start(&iter);
+	while ((hash_cur_app = rhashtable_walk_next(&iter))) {
+		if (IS_ERR(hash_cur_app)) {
+			/* Resized under us, the walk starts over */
+			if (PTR_ERR(hash_cur_app) == -EAGAIN) {
+				count = 0;
+				continue;
+			}
+			break;
+		}
 		written = scnprintf(page + count, PAGE_SIZE - sizeof(errormsg) - count, "%s %d\n",
 					hash_cur_app->key.name, atomic_read(&hash_cur_app->value));
-		hash = hash_cur_app->key.hash;
-		hash_for_each_possible_rcu(package_to_userid, hash_cur_user, hlist, hash) {
-			if (qstr_case_eq(&hash_cur_app->key, &hash_cur_user->key)) {
-				written += scnprintf(page + count + written - 1,
-					PAGE_SIZE - sizeof(errormsg) - count - written + 1,
-					" %d\n", atomic_read(&hash_cur_user->value)) - 1;
-			}
+		list = rhltable_lookup(&package_to_userid, &hash_cur_app->key,
+				       packagelist_params);
+		rhl_for_each_entry_rcu(hash_cur_user, pos, list, lnode) {
+			written += scnprintf(page + count + written - 1,
+				PAGE_SIZE - sizeof(errormsg) - count - written + 1,
+				" %d\n", atomic_read(&hash_cur_user->value)) - 1;
 		}
 		if (count + written == PAGE_SIZE - sizeof(errormsg) - 1) {
 			count += scnprintf(page + count, PAGE_SIZE - count, errormsg);
@@ -774,7 +1237,8 @@ static ssize_t packages_list_show(struct config_item *item, char *page)
 		}
 		count += written;
 	}
-	rcu_read_unlock();
+	rhashtable_walk_stop(&iter);
+	rhashtable_walk_exit(&iter);
 
 	return count;
 }
@@ -807,6 +1271,64 @@ static struct configfs_attribute *packages_attrs[] = {
 	NULL,
 };
 
+/*
+ * Applies a whole batch of changes, see packagelist_parse_batch().
+ *
+ * configfs buffers binary attributes and only calls ->write when the file
+ * is released, whose return value the VFS drops. A rejected batch is not
+ * reported to the writer, so failures are logged. Writers can check that
+ * a batch took effect through packages_gid.list.
+ */
+static ssize_t packages_update_write(struct config_item *item,
+				     const void *data, size_t size)
+{
+	struct packagelist_batch batch;
+	LIST_HEAD(free_list);
+	LIST_HEAD(unused);
+	char *buf;
+	int err;
+
+	buf = vmalloc(size + 1);
+	if (!buf)
+		return -ENOMEM;
+	memcpy(buf, data, size);
+	buf[size] = '\0';
+
+	INIT_LIST_HEAD(&batch.appids);
+	INIT_LIST_HEAD(&batch.userids);
+	INIT_LIST_HEAD(&batch.removals);
+	err = packagelist_parse_batch(buf, &batch);
+	vfree(buf);
+	if (!err) {
+		err = packagelist_apply_batch(&batch, &free_list, &unused);
+		if (err)
+			pr_warn("sdcardfs: packages_update: batch rejected, error %d\n",
+				err);
+	}
+
+	free_hashtable_entries(&batch.appids);
+	free_hashtable_entries(&batch.userids);
+	free_hashtable_entries(&batch.removals);
+	free_hashtable_entries(&unused);
+	free_hashtable_entries_rcu(&free_list);
+	return err ? err : size;
+}
+
+static struct configfs_bin_attribute packages_attr_packages_update = {
+	.cb_attr = {
+		.ca_name	= "packages_update",
+		.ca_mode	= S_IWUGO,
+		.ca_owner	= THIS_MODULE,
+	},
+	.cb_max_size	= SZ_1M,
+	.write		= packages_update_write,
+};
+
+static struct configfs_bin_attribute *packages_bin_attrs[] = {
+	&packages_attr_packages_update,
+	NULL,
+};
+
 /*
  * Note that, since no extra work is required on ->drop_item(),
  * no ->drop_item() is provided.
@@ -818,6 +1340,7 @@ static struct configfs_group_operations packages_group_ops = {
 static struct config_item_type packages_type = {
 	.ct_group_ops	= &packages_group_ops,
 	.ct_attrs	= packages_attrs,
+	.ct_bin_attrs	= packages_bin_attrs,
 	.ct_owner	= THIS_MODULE,
 };
 
@@ -862,6 +1385,8 @@ static void configfs_sdcardfs_exit(void)
 
 int packagelist_init(void)
 {
+	int err;
+
 	hashtable_entry_cachep =
 		kmem_cache_create("packagelist_hashtable_entry",
 					sizeof(struct hashtable_entry), 0, 0, NULL);
@@ -870,13 +1395,39 @@ int packagelist_init(void)
 		return -ENOMEM;
 	}
 
+	err = rhashtable_init(&package_to_appid, &packagelist_table_params);
+	if (err)
+		goto out_cache;
+	err = rhltable_init(&package_to_userid, &packagelist_table_params);
+	if (err)
+		goto out_appid;
+	err = rhashtable_init(&ext_to_groupid, &packagelist_params);
+	if (err)
+		goto out_userid;
+
+	packagelist_ready = true;
 	configfs_sdcardfs_init();
 	return 0;
+
+out_userid:
+	rhltable_destroy(&package_to_userid);
+out_appid:
+	rhashtable_destroy(&package_to_appid);
+out_cache:
+	kmem_cache_destroy(hashtable_entry_cachep);
+	pr_err("sdcardfs: failed creating packagelist tables\n");
+	return err;
 }
 
 void packagelist_exit(void)
 {
+	/* Also called when module init failed early on */
+	if (!packagelist_ready)
+		return;
+	packagelist_ready = false;
 	configfs_sdcardfs_exit();
 	packagelist_destroy();
+	/* Wait for entries freed by call_rcu() */
+	rcu_barrier();
 	kmem_cache_destroy(hashtable_entry_cachep);
 }
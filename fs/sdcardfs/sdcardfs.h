@@ -37,6 +37,7 @@
 #include <linux/seq_file.h>
 #include <linux/statfs.h>
 #include <linux/fs_stack.h>
+#include <linux/hashtable.h>
 #include <linux/magic.h>
 #include <linux/uaccess.h>
 #include <linux/slab.h>
@@ -207,6 +208,21 @@ struct sdcardfs_vfsmount_options {
 	mode_t mask;
 };
 
+/*
+ * Uids of package directories under Android/{data,obb,media}, keyed by
+ * userid and case folded name. Saves get_derived_permission_new() the
+ * packages.list lookups; see get_package_appid().
+ */
+#define PERM_CACHE_BITS		8
+#define PERM_CACHE_MAX		1024
+
+struct sdcardfs_perm_cache {
+	spinlock_t lock;		/* serializes inserts and flushes */
+	unsigned int generation;	/* packages.list generation of entries */
+	unsigned int nr_entries;
+	DECLARE_HASHTABLE(entries, PERM_CACHE_BITS);
+};
+
 extern int parse_options_remount(struct super_block *sb, char *options, int silent,
 		struct sdcardfs_vfsmount_options *vfsopts);
 
@@ -223,6 +239,7 @@ struct sdcardfs_sb_info {
 	struct path obbpath;
 	void *pkgl_id;
 	struct list_head list;
+	struct sdcardfs_perm_cache perm_cache;
 };
 
 /*
@@ -491,6 +508,7 @@ extern appid_t get_appid(const char *app_name);
 extern appid_t get_ext_gid(const char *app_name);
 extern appid_t is_excluded(const char *app_name, userid_t userid);
 extern int check_caller_access_to_name(struct inode *parent_node, const struct qstr *name);
+extern unsigned int packagelist_generation(void);
 extern int packagelist_init(void);
 extern void packagelist_exit(void);
 
@@ -508,6 +526,8 @@ extern void setup_derived_state(struct inode *inode, perm_t perm,
 extern void get_derived_permission(struct dentry *parent, struct dentry *dentry);
 extern void get_derived_permission_new(struct dentry *parent, struct dentry *dentry, const struct qstr *name);
 extern void fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit);
+extern void perm_cache_init(struct sdcardfs_perm_cache *cache);
+extern void perm_cache_destroy(struct sdcardfs_perm_cache *cache);
 
 extern void update_derived_permission_lock(struct dentry *dentry);
 void fixup_lower_ownership(struct dentry *dentry, const char *name);
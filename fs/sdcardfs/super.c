@@ -57,6 +57,7 @@ static void sdcardfs_put_super(struct super_block *sb)
 		kfree(spd->obbpath_s);
 		path_put(&spd->obbpath);
 	}
+	perm_cache_destroy(&spd->perm_cache);
 
 	/* decrement lower super references */
 	s = sdcardfs_lower_super(sb);
@@ -0,0 +1,37 @@
+#ifndef _LINUX_ADJ_LRU_H
+#define _LINUX_ADJ_LRU_H
+
+#include <linux/sched.h>
+
+/*
+ * Killable processes bucketed by oom_score_adj.
+ *
+ * Every user process with a non-negative oom_score_adj sits on the list
+ * of its adj value, ordered from the least to the most recently moved
+ * one. Low memory killers can then find the highest populated adj and
+ * its oldest member without walking the whole task list.
+ */
+
+/* Return true to make adj_lru_select() pass over a candidate */
+typedef bool (*adj_lru_skip_t)(struct task_struct *p);
+
+#ifdef CONFIG_ADJ_LRU
+void adj_lru_add(struct task_struct *p);
+void adj_lru_update(struct task_struct *p);
+void adj_lru_del(struct task_struct *p);
+struct task_struct *adj_lru_select(short min_adj, bool heaviest,
+				   adj_lru_skip_t skip, short *adj,
+				   unsigned long *rss);
+#else
+static inline void adj_lru_add(struct task_struct *p) { }
+static inline void adj_lru_update(struct task_struct *p) { }
+static inline void adj_lru_del(struct task_struct *p) { }
+static inline struct task_struct *adj_lru_select(short min_adj, bool heaviest,
+						 adj_lru_skip_t skip,
+						 short *adj, unsigned long *rss)
+{
+	return NULL;
+}
+#endif
+
+#endif /* _LINUX_ADJ_LRU_H */
@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (C) 2018-2019 Sultan Alsawaf <sultan@kerneltoast.com>.
+ */
+#ifndef _INPUT_BOOST_H_
+#define _INPUT_BOOST_H_
+
+#include <linux/list.h>
+#include <linux/types.h>
+
+/* Boost levels handed to consumers range from 0 (unboosted) to this */
+#define INPUT_BOOST_LEVEL_SCALE	1024
+
+/**
+ * struct input_boost_curve - shape of an input boost
+ * @level: peak level, 0 to INPUT_BOOST_LEVEL_SCALE
+ * @hold_ms: time the peak is held after the last input event
+ * @decay_ms: time taken to ramp down from the peak once the hold expires
+ * @decay_steps: number of level drops the ramp down is made of
+ * @wake_ms: length of the max boost given when the screen turns on
+ */
+struct input_boost_curve {
+	u32 level;
+	u32 hold_ms;
+	u32 decay_ms;
+	u32 decay_steps;
+	u32 wake_ms;
+};
+
+/**
+ * struct input_boost_consumer - something boosted by the input boost core
+ * @name: short name used in debugfs and the event log
+ * @apply: called from the boost thread whenever the level or the max boost
+ *	   state of the consumer changes. It may sleep.
+ * @curve: input boost curve, tunable through debugfs
+ *
+ * All other fields are private to the boost core.
+ */
+struct input_boost_consumer {
+	const char *name;
+	void (*apply)(struct input_boost_consumer *c, unsigned int level,
+		      bool max);
+	struct input_boost_curve curve;
+
+	struct list_head node;
+	u64 kick_ns;
+	u64 hold_until;
+	u64 max_until;
+	unsigned int level;
+	bool max;
+};
+
+#ifdef CONFIG_INPUT_BOOST_CORE
+int input_boost_register(struct input_boost_consumer *c);
+void input_boost_kick(struct input_boost_consumer *c);
+void input_boost_kick_max(struct input_boost_consumer *c,
+			  unsigned int duration_ms);
+void input_boost_kick_wake(struct input_boost_consumer *c);
+
+bool input_boost_within_input(unsigned long timeout_ms);
+#else
+static inline int input_boost_register(struct input_boost_consumer *c)
+{
+	return 0;
+}
+static inline void input_boost_kick(struct input_boost_consumer *c)
+{
+}
+static inline void input_boost_kick_max(struct input_boost_consumer *c,
+					unsigned int duration_ms)
+{
+}
+static inline void input_boost_kick_wake(struct input_boost_consumer *c)
+{
+}
+
+static inline bool input_boost_within_input(unsigned long timeout_ms)
+{
+	return true;
+}
+#endif
+
+#endif /* _INPUT_BOOST_H_ */
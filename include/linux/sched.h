@@ -62,6 +62,7 @@ struct sched_param {
 #include <asm/processor.h>
 
 #define SCHED_ATTR_SIZE_VER0	48	/* sizeof first published struct */
+#define SCHED_ATTR_SIZE_VER1	56	/* add: util_{min,max} */
 
 /*
  * Extended scheduling parameters data structure.
@@ -99,6 +100,13 @@ struct sched_param {
  *  @sched_runtime	representative of the task's runtime
  *  @sched_period	representative of the task's period
  *
+ * and, for any policy, by utilization clamps:
+ *
+ *  @sched_util_min	floor of the task's utilization, SCHED_FLAG_UTIL_CLAMP_MIN
+ *  @sched_util_max	ceiling of the task's utilization, SCHED_FLAG_UTIL_CLAMP_MAX
+ *
+ * both in the [0..SCHED_CAPACITY_SCALE] range.
+ *
  * Given this task model, there are a multiplicity of scheduling algorithms
  * and policies, that can be used to ensure all the tasks will make their
  * timing constraints.
@@ -123,6 +131,10 @@ struct sched_attr {
 	u64 sched_runtime;
 	u64 sched_deadline;
 	u64 sched_period;
+
+	/* Utilization hints */
+	u32 sched_util_min;
+	u32 sched_util_max;
 };
 
 struct futex_pi_state;
@@ -893,6 +905,10 @@ struct signal_struct {
 					 * Only settable by CAP_SYS_RESOURCE. */
 	struct mm_struct *oom_mm;	/* recorded mm when the thread group got
 					 * killed by the oom killer */
+#ifdef CONFIG_ADJ_LRU
+	struct list_head adj_lru_node;	/* entry in the oom_score_adj LRU */
+	short adj_lru_bucket;		/* adj the entry is filed under */
+#endif
 
 	struct mutex cred_guard_mutex;	/* guard against foreign influences on
 					 * credential calculations
@@ -1035,6 +1051,29 @@ enum cpu_idle_type {
 #define SCHED_CAPACITY_SHIFT	SCHED_FIXEDPOINT_SHIFT
 #define SCHED_CAPACITY_SCALE	(1L << SCHED_CAPACITY_SHIFT)
 
+#ifdef CONFIG_CGROUP_SCHEDTUNE
+/*
+ * Utilization clamps: a floor and a ceiling for the utilization schedutil
+ * and the wakeup path see for a task, and for the CPU it is RUNNABLE on.
+ */
+enum uclamp_id {
+	UCLAMP_MIN = 0,
+	UCLAMP_MAX,
+	UCLAMP_CNT
+};
+
+/*
+ * @value:	clamp in the [0..SCHED_CAPACITY_SCALE] range
+ * @bucket_id:	per-CPU bucket @value is refcounted in while RUNNABLE
+ * @active:	@value is currently refcounted in a per-CPU bucket
+ */
+struct uclamp_se {
+	unsigned int value		: SCHED_CAPACITY_SHIFT + 1;
+	unsigned int bucket_id		: 5;
+	unsigned int active		: 1;
+};
+#endif
+
 struct sched_capacity_reqs {
 	unsigned long cfs;
 	unsigned long rt;
@@ -1763,6 +1802,13 @@ struct task_struct {
 #endif
 	struct sched_dl_entity dl;
 
+#ifdef CONFIG_CGROUP_SCHEDTUNE
+	/* Clamps requested with sched_setattr() */
+	struct uclamp_se uclamp_req[UCLAMP_CNT];
+	/* Effective clamps, as refcounted by SchedTune while RUNNABLE */
+	struct uclamp_se uclamp[UCLAMP_CNT];
+#endif
+
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	/* list of struct preempt_notifier: */
 	struct hlist_head preempt_notifiers;
@@ -2767,6 +2813,9 @@ extern int register_cpu_cycle_counter_cb(struct cpu_cycle_counter_cb *cb);
 extern void sched_set_io_is_busy(int val);
 extern int sched_set_group_id(struct task_struct *p, unsigned int group_id);
 extern unsigned int sched_get_group_id(struct task_struct *p);
+extern int sched_set_frame_deadline(struct task_struct *p,
+				    unsigned int period_us);
+extern unsigned int sched_get_frame_deadline(struct task_struct *p);
 extern int sched_set_init_task_load(struct task_struct *p, int init_load_pct);
 extern u32 sched_get_init_task_load(struct task_struct *p);
 extern void sched_update_cpu_freq_min_max(const cpumask_t *cpus, u32 fmin,
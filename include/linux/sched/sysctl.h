@@ -34,8 +34,11 @@ extern unsigned int sysctl_sched_boost;
 extern unsigned int sysctl_sched_group_upmigrate_pct;
 extern unsigned int sysctl_sched_group_downmigrate_pct;
 extern unsigned int sysctl_sched_walt_rotate_big_tasks;
+extern unsigned int sysctl_sched_walt_rollover_sweep;
 extern unsigned int sysctl_sched_min_task_util_for_boost_colocation;
 extern unsigned int sysctl_sched_little_cluster_coloc_fmin_khz;
+extern unsigned int sysctl_sched_frame_boost_margin_pct;
+extern unsigned int sysctl_sched_frame_boost_floor_pct;
 
 extern int
 walt_proc_update_handler(struct ctl_table *table, int write,
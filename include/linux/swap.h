@@ -245,6 +245,14 @@ struct swap_info_struct {
 	struct swap_cluster_list discard_clusters; /* discard clusters list */
 	unsigned int write_pending;
 	unsigned int max_writes;
+	unsigned long write_lat_avg;	/* swap ratio: write latency EWMA, ns */
+	/* Swapin readahead state, adapted to this device's hit ratio */
+	atomic_t ra_hits;		/* readahead hits since last swapin */
+	atomic_t ra_last_pages;		/* size of the last readahead window */
+	unsigned long ra_prev_offset;	/* offset of the last swapin */
+	atomic_t ra_issued;		/* readahead pages read in this period */
+	atomic_t ra_used;		/* of those, pages hit in swap cache */
+	unsigned int ra_order;		/* log2 of the readahead window cap */
 };
 
 /* linux/mm/workingset.c */
@@ -340,6 +348,7 @@ extern unsigned long shrink_all_memory(unsigned long nr_pages);
 extern int vm_swappiness;
 extern int sysctl_swap_ratio;
 extern int sysctl_swap_ratio_enable;
+extern int sysctl_swap_ratio_adaptive;
 extern int remove_mapping(struct address_space *mapping, struct page *page);
 extern unsigned long vm_total_pages;
 
@@ -396,6 +405,7 @@ extern struct page *swapin_readahead(swp_entry_t, gfp_t,
 extern atomic_long_t nr_swap_pages;
 extern long total_swap_pages;
 extern bool is_swap_fast(swp_entry_t entry);
+extern struct swap_info_struct *swp_swap_info(swp_entry_t entry);
 
 /* Swap 50% full? Release swapcache more aggressively.. */
 static inline bool vm_swap_full(struct swap_info_struct *si)
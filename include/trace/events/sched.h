@@ -652,6 +652,36 @@ TRACE_EVENT(sched_load_to_gov,
 		__entry->sysctl_sched_little_cluster_coloc_fmin_khz,
 		__entry->coloc_boost_load)
 );
+
+TRACE_EVENT(sched_walt_rollover,
+
+	TP_PROTO(u64 ws, bool is_migration, bool sweep, int nr_locked,
+		 u64 max_lock_ns, u64 total_ns),
+
+	TP_ARGS(ws, is_migration, sweep, nr_locked, max_lock_ns, total_ns),
+
+	TP_STRUCT__entry(
+		__field(	u64,	ws			)
+		__field(	bool,	is_migration		)
+		__field(	bool,	sweep			)
+		__field(	int,	nr_locked		)
+		__field(	u64,	max_lock_ns		)
+		__field(	u64,	total_ns		)
+	),
+
+	TP_fast_assign(
+		__entry->ws		= ws;
+		__entry->is_migration	= is_migration;
+		__entry->sweep		= sweep;
+		__entry->nr_locked	= nr_locked;
+		__entry->max_lock_ns	= max_lock_ns;
+		__entry->total_ns	= total_ns;
+	),
+
+	TP_printk("ws=%llu is_migration=%d sweep=%d nr_locked=%d max_lock_ns=%llu total_ns=%llu",
+		__entry->ws, __entry->is_migration, __entry->sweep,
+		__entry->nr_locked, __entry->max_lock_ns, __entry->total_ns)
+);
 #endif
 
 #ifdef CONFIG_SMP
@@ -1829,6 +1859,42 @@ TRACE_EVENT(core_ctl_eval_need,
 		  __entry->old_need, __entry->new_need, __entry->updated)
 );
 
+TRACE_EVENT(core_ctl_eval_inputs,
+
+	TP_PROTO(unsigned int cpu, unsigned int active_cpus,
+		 unsigned int busy_cpus, int nrrun, unsigned int max_nr,
+		 unsigned int stall_pct, unsigned int stall_thres,
+		 unsigned int boost, unsigned int need),
+	TP_ARGS(cpu, active_cpus, busy_cpus, nrrun, max_nr, stall_pct,
+		stall_thres, boost, need),
+	TP_STRUCT__entry(
+		__field(u32, cpu)
+		__field(u32, active_cpus)
+		__field(u32, busy_cpus)
+		__field(s32, nrrun)
+		__field(u32, max_nr)
+		__field(u32, stall_pct)
+		__field(u32, stall_thres)
+		__field(u32, boost)
+		__field(u32, need)
+	),
+	TP_fast_assign(
+		__entry->cpu = cpu;
+		__entry->active_cpus = active_cpus;
+		__entry->busy_cpus = busy_cpus;
+		__entry->nrrun = nrrun;
+		__entry->max_nr = max_nr;
+		__entry->stall_pct = stall_pct;
+		__entry->stall_thres = stall_thres;
+		__entry->boost = boost;
+		__entry->need = need;
+	),
+	TP_printk("cpu=%u, active_cpus=%u, busy_cpus=%u, nrrun=%d, max_nr=%u, stall_pct=%u, stall_thres=%u, boost=%u, need=%u",
+		  __entry->cpu, __entry->active_cpus, __entry->busy_cpus,
+		  __entry->nrrun, __entry->max_nr, __entry->stall_pct,
+		  __entry->stall_thres, __entry->boost, __entry->need)
+);
+
 TRACE_EVENT(core_ctl_set_busy,
 
 	TP_PROTO(unsigned int cpu, unsigned int busy,
@@ -0,0 +1,28 @@
+#ifndef _UAPI_LINUX_CPUFREQ_TIMES_H
+#define _UAPI_LINUX_CPUFREQ_TIMES_H
+
+#include <linux/types.h>
+
+/*
+ * Layout of /proc/uid_time_in_state_bin: one header, nr_states __u32
+ * frequencies in kHz in the same order as the "uid:" line of
+ * /proc/uid_time_in_state, then one record per UID. Each record is
+ * followed by nr_states __u64 times in clock ticks (USER_HZ).
+ */
+#define CPUFREQ_TIMES_UID_MAGIC		0x75746973	/* "utis" */
+#define CPUFREQ_TIMES_UID_VERSION	1
+
+struct cpufreq_times_uid_header {
+	__u32 magic;
+	__u32 version;
+	__u32 nr_states;
+	__u32 reserved;
+};
+
+struct cpufreq_times_uid_record {
+	__u32 uid;
+	__u32 reserved;
+	/* followed by __u64 time_in_state[nr_states] */
+};
+
+#endif /* _UAPI_LINUX_CPUFREQ_TIMES_H */
@@ -246,6 +246,8 @@ struct fuse_file_lock {
  * FUSE_PARALLEL_DIROPS: allow parallel lookups and readdir
  * FUSE_HANDLE_KILLPRIV: fs handles killing suid/sgid/cap on write/chown/trunc
  * FUSE_POSIX_ACL: filesystem supports posix acls
+ * FUSE_MULTIQUEUE: per-cpu request queues, see FUSE_DEV_IOC_BIND_QUEUE
+ *	(bit 31 is reserved in mainline, so stock daemons never echo it)
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -269,6 +271,7 @@ struct fuse_file_lock {
 #define FUSE_HANDLE_KILLPRIV	(1 << 19)
 #define FUSE_POSIX_ACL		(1 << 20)
 #define FUSE_PASSTHROUGH	(1 << 21)
+#define FUSE_MULTIQUEUE		(1 << 31)
 
 /**
  * CUSE INIT request/reply flags
@@ -779,6 +782,14 @@ struct fuse_notify_retrieve_in {
 /* Device ioctls: */
 #define FUSE_DEV_IOC_CLONE	_IOR(229, 0, uint32_t)
 
+/*
+ * Make a device fd read requests from the queue of the given cpu only.
+ * Needs FUSE_MULTIQUEUE. Requests of cpus without a bound fd go to the
+ * bound queue of the closest cpu, preferring the same node, and to the
+ * unbound fds when no queue is bound at all.
+ */
+#define FUSE_DEV_IOC_BIND_QUEUE	_IOW(229, 127, uint32_t)
+
 struct fuse_lseek_in {
 	uint64_t	fh;
 	uint64_t	offset;
@@ -0,0 +1,38 @@
+#ifndef _UAPI_LINUX_PROC_RECLAIM_H
+#define _UAPI_LINUX_PROC_RECLAIM_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* Page types a range is reclaimed for, matching "file", "anon" and "all" */
+#define PROC_RECLAIM_FILE	0
+#define PROC_RECLAIM_ANON	1
+#define PROC_RECLAIM_ALL	2
+
+/* Upper bound of nr_ranges in a single PROC_RECLAIM_IOC_RANGES call */
+#define PROC_RECLAIM_MAX_RANGES	4096
+
+struct proc_reclaim_range {
+	__u64 start;		/* page aligned start address */
+	__u64 len;		/* length in bytes, rounded up to pages */
+	__u32 type;		/* PROC_RECLAIM_* */
+	__u32 reserved;		/* must be zero */
+};
+
+struct proc_reclaim_ranges {
+	__u64 ranges;		/* pointer to struct proc_reclaim_range[] */
+	__u32 nr_ranges;
+	/*
+	 * Pages mapped by more than this many ptes are left alone.
+	 * Zero means one, i.e. pages private to the target process.
+	 * Anything above one needs CAP_SYS_ADMIN.
+	 */
+	__u32 max_mapcount;
+	__u64 bytes_scanned;	/* returned by the kernel */
+	__u64 bytes_reclaimed;	/* returned by the kernel */
+};
+
+/* Issued on an open /proc/<pid>/reclaim */
+#define PROC_RECLAIM_IOC_RANGES	_IOWR('R', 0x40, struct proc_reclaim_ranges)
+
+#endif /* _UAPI_LINUX_PROC_RECLAIM_H */
@@ -0,0 +1,42 @@
+#ifndef _UAPI_LINUX_UID_SYS_STATS_H
+#define _UAPI_LINUX_UID_SYS_STATS_H
+
+#include <linux/types.h>
+
+/*
+ * Layout of /proc/uid_sys_stats: one header followed by nr_records
+ * records of record_size bytes each. New fields are only ever appended to
+ * the record, so readers should step through the records by record_size
+ * rather than by sizeof(struct uid_sys_stats_record).
+ */
+#define UID_SYS_STATS_MAGIC	0x75737973	/* "usys" */
+#define UID_SYS_STATS_VERSION	1
+
+/* Indices in uid_sys_stats_record.io, matching /proc/uid_procstat/set */
+#define UID_SYS_STATS_FOREGROUND	0
+#define UID_SYS_STATS_BACKGROUND	1
+
+struct uid_sys_stats_header {
+	__u32 magic;
+	__u32 version;
+	__u32 record_size;
+	__u32 nr_records;
+};
+
+struct uid_sys_stats_io {
+	__u64 rchar;
+	__u64 wchar;
+	__u64 read_bytes;
+	__u64 write_bytes;
+	__u64 fsync;
+};
+
+struct uid_sys_stats_record {
+	__u32 uid;
+	__u32 state;		/* UID_SYS_STATS_FOREGROUND or _BACKGROUND */
+	__u64 utime_us;		/* same values as /proc/uid_cputime/show_uid_stat */
+	__u64 stime_us;
+	struct uid_sys_stats_io io[2];	/* same values as /proc/uid_io/stats */
+};
+
+#endif /* _UAPI_LINUX_UID_SYS_STATS_H */
@@ -72,6 +72,7 @@
 #include <linux/posix-timers.h>
 #include <linux/user-return-notifier.h>
 #include <linux/oom.h>
+#include <linux/adj_lru.h>
 #include <linux/khugepaged.h>
 #include <linux/signalfd.h>
 #include <linux/uprobes.h>
@@ -1390,6 +1391,9 @@ static int copy_signal(unsigned long clone_flags, struct task_struct *tsk)
 
 	sig->oom_score_adj = current->signal->oom_score_adj;
 	sig->oom_score_adj_min = current->signal->oom_score_adj_min;
+#ifdef CONFIG_ADJ_LRU
+	INIT_LIST_HEAD(&sig->adj_lru_node);
+#endif
 
 	sig->has_child_subreaper = current->signal->has_child_subreaper ||
 				   current->signal->is_child_subreaper;
@@ -1995,6 +1999,9 @@ static __latent_entropy struct task_struct *copy_process(
 	syscall_tracepoint_update(p);
 	write_unlock_irq(&tasklist_lock);
 
+	if (thread_group_leader(p))
+		adj_lru_add(p);
+
 	proc_fork_connector(p);
 	cgroup_post_fork(p);
 	threadgroup_change_end(current);
@@ -2460,6 +2460,79 @@ int sysctl_schedstats(struct ctl_table *table, int write,
 static inline void init_schedstats(void) {}
 #endif /* CONFIG_SCHEDSTATS */
 
+#ifdef CONFIG_CGROUP_SCHEDTUNE
+static void uclamp_reset(struct task_struct *p)
+{
+	p->uclamp_req[UCLAMP_MIN].value = 0;
+	p->uclamp_req[UCLAMP_MAX].value = SCHED_CAPACITY_SCALE;
+}
+
+/* The child is accounted by SchedTune at its first enqueue */
+static void uclamp_fork(struct task_struct *p)
+{
+	p->uclamp[UCLAMP_MIN].active = 0;
+	p->uclamp[UCLAMP_MAX].active = 0;
+
+	if (unlikely(p->sched_reset_on_fork))
+		uclamp_reset(p);
+}
+
+static int uclamp_validate(struct task_struct *p,
+			   const struct sched_attr *attr, bool user)
+{
+	unsigned int min_util = p->uclamp_req[UCLAMP_MIN].value;
+	unsigned int max_util = p->uclamp_req[UCLAMP_MAX].value;
+
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP_MIN)
+		min_util = attr->sched_util_min;
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP_MAX)
+		max_util = attr->sched_util_max;
+
+	if (min_util > max_util || max_util > SCHED_CAPACITY_SCALE)
+		return -EINVAL;
+
+	/* Raising the floor asks for performance, like raising priority */
+	if (user && min_util > p->uclamp_req[UCLAMP_MIN].value &&
+	    !capable(CAP_SYS_NICE))
+		return -EPERM;
+
+	return 0;
+}
+
+/*
+ * Must hold rq lock. A RUNNABLE task has been dequeued by the caller and
+ * gets its new clamps accounted when enqueued back.
+ */
+static void __setscheduler_uclamp(struct task_struct *p,
+				  const struct sched_attr *attr)
+{
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP_MIN)
+		p->uclamp_req[UCLAMP_MIN].value = attr->sched_util_min;
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP_MAX)
+		p->uclamp_req[UCLAMP_MAX].value = attr->sched_util_max;
+}
+
+static void __getparam_uclamp(struct task_struct *p, struct sched_attr *attr)
+{
+	attr->sched_util_min = p->uclamp_req[UCLAMP_MIN].value;
+	attr->sched_util_max = p->uclamp_req[UCLAMP_MAX].value;
+}
+#else
+static inline void uclamp_reset(struct task_struct *p) { }
+static inline void uclamp_fork(struct task_struct *p) { }
+
+static inline int uclamp_validate(struct task_struct *p,
+				  const struct sched_attr *attr, bool user)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline void __setscheduler_uclamp(struct task_struct *p,
+					 const struct sched_attr *attr) { }
+static inline void __getparam_uclamp(struct task_struct *p,
+				     struct sched_attr *attr) { }
+#endif /* CONFIG_CGROUP_SCHEDTUNE */
+
 /*
  * fork()/clone()-time setup:
  */
@@ -2484,6 +2557,8 @@ int sched_fork(unsigned long clone_flags, struct task_struct *p)
 	 */
 	p->prio = current->normal_prio;
 
+	uclamp_fork(p);
+
 	/*
 	 * Revert to default priority/policy on fork if requested.
 	 */
@@ -4314,9 +4389,16 @@ static int __sched_setscheduler(struct task_struct *p,
 			return -EINVAL;
 	}
 
-	if (attr->sched_flags & ~(SCHED_FLAG_RESET_ON_FORK))
+	if (attr->sched_flags &
+	    ~(SCHED_FLAG_RESET_ON_FORK | SCHED_FLAG_UTIL_CLAMP))
 		return -EINVAL;
 
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP) {
+		retval = uclamp_validate(p, attr, user);
+		if (retval)
+			return retval;
+	}
+
 	/*
 	 * Valid priorities for SCHED_FIFO and SCHED_RR are
 	 * 1..MAX_USER_RT_PRIO-1, valid priority for SCHED_NORMAL,
@@ -4414,6 +4496,8 @@ static int __sched_setscheduler(struct task_struct *p,
 			goto change;
 		if (dl_policy(policy) && dl_param_changed(p, attr))
 			goto change;
+		if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP)
+			goto change;
 
 		p->sched_reset_on_fork = reset_on_fork;
 		task_rq_unlock(rq, p, &rf);
@@ -4494,6 +4578,7 @@ static int __sched_setscheduler(struct task_struct *p,
 
 	prev_class = p->sched_class;
 	__setscheduler(rq, p, attr, pi);
+	__setscheduler_uclamp(p, attr);
 
 	if (queued) {
 		/*
@@ -4671,6 +4756,11 @@ static int sched_copy_attr(struct sched_attr __user *uattr,
 	 */
 	attr->sched_nice = clamp(attr->sched_nice, MIN_NICE, MAX_NICE);
 
+	/* Utilization clamps did not exist in the first published struct */
+	if ((attr->sched_flags & SCHED_FLAG_UTIL_CLAMP) &&
+	    size < SCHED_ATTR_SIZE_VER1)
+		return -EINVAL;
+
 	return 0;
 
 err_size:
@@ -4888,6 +4978,10 @@ SYSCALL_DEFINE4(sched_getattr, pid_t, pid, struct sched_attr __user *, uattr,
 	else
 		attr.sched_nice = task_nice(p);
 
+	/* Don't fail callers that predate the clamps with -EFBIG */
+	if (size >= SCHED_ATTR_SIZE_VER1)
+		__getparam_uclamp(p, &attr);
+
 	rcu_read_unlock();
 
 	retval = sched_read_attr(uattr, &attr, size);
@@ -8337,6 +8431,7 @@ void __init sched_init(void)
 	BUG_ON(i);
 
 	set_load_weight(&init_task);
+	uclamp_reset(&init_task);
 
 	/*
 	 * The boot idle thread does lazy MMU switching as well:
@@ -53,6 +53,8 @@ struct cluster_data {
 	struct task_struct *core_ctl_thread;
 	unsigned int first_cpu;
 	unsigned int boost;
+	unsigned int stall_pct;
+	unsigned int psi_stall_thres;
 	struct kobject kobj;
 };
 
@@ -64,6 +66,7 @@ struct cpu_data {
 	struct cluster_data *cluster;
 	struct list_head sib;
 	bool isolated_by_us;
+	u32 stall_time;
 };
 
 static DEFINE_PER_CPU(struct cpu_data, cpu_state);
@@ -168,6 +171,29 @@ static ssize_t show_offline_delay_ms(const struct cluster_data *state,
 	return snprintf(buf, PAGE_SIZE, "%u\n", state->offline_delay_ms);
 }
 
+static ssize_t show_psi_stall_thres(const struct cluster_data *state,
+				    char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", state->psi_stall_thres);
+}
+
+static ssize_t store_psi_stall_thres(struct cluster_data *state,
+				     const char *buf, size_t count)
+{
+	unsigned int val;
+
+	if (sscanf(buf, "%u\n", &val) != 1)
+		return -EINVAL;
+
+	if (val > 100)
+		return -EINVAL;
+
+	state->psi_stall_thres = val;
+	apply_need(state);
+
+	return count;
+}
+
 static ssize_t store_busy_up_thres(struct cluster_data *state,
 					const char *buf, size_t count)
 {
@@ -333,6 +359,8 @@ static ssize_t show_global_state(const struct cluster_data *state, char *buf)
 						cluster->nr_isolated_cpus);
 		count += snprintf(buf + count, PAGE_SIZE - count,
 				"\tBoost: %u\n", (unsigned int) cluster->boost);
+		count += snprintf(buf + count, PAGE_SIZE - count,
+				"\tStall%%: %u\n", cluster->stall_pct);
 	}
 	spin_unlock_irq(&state_lock);
 
@@ -406,6 +434,7 @@ core_ctl_attr_rw(offline_delay_ms);
 core_ctl_attr_rw(busy_up_thres);
 core_ctl_attr_rw(busy_down_thres);
 core_ctl_attr_rw(task_thres);
+core_ctl_attr_rw(psi_stall_thres);
 core_ctl_attr_rw(is_big_cluster);
 core_ctl_attr_ro(need_cpus);
 core_ctl_attr_ro(active_cpus);
@@ -420,6 +449,7 @@ static struct attribute *default_attrs[] = {
 	&busy_up_thres.attr,
 	&busy_down_thres.attr,
 	&task_thres.attr,
+	&psi_stall_thres.attr,
 	&is_big_cluster.attr,
 	&enable.attr,
 	&need_cpus.attr,
@@ -511,6 +541,15 @@ static unsigned int apply_task_need(const struct cluster_data *cluster,
 	if (cluster->max_nr > MAX_NR_THRESHOLD)
 		new_need = new_need + 1;
 
+	/*
+	 * Averages miss short bursts. If the active CPUs spent more than
+	 * psi_stall_thres of the last window with tasks waiting to run,
+	 * bring another CPU in.
+	 */
+	if (cluster->psi_stall_thres &&
+	    cluster->stall_pct >= cluster->psi_stall_thres)
+		new_need = new_need + 1;
+
 	return new_need;
 }
 
@@ -544,7 +583,7 @@ static bool eval_need(struct cluster_data *cluster)
 {
 	unsigned long flags;
 	struct cpu_data *c;
-	unsigned int need_cpus = 0, last_need, thres_idx;
+	unsigned int need_cpus = 0, busy_cpus = 0, last_need, thres_idx;
 	int ret = 0;
 	bool need_flag = false;
 	unsigned int new_need;
@@ -571,13 +610,18 @@ static bool eval_need(struct cluster_data *cluster)
 
 			trace_core_ctl_set_busy(c->cpu, c->busy, old_is_busy,
 						c->is_busy);
-			need_cpus += c->is_busy;
+			busy_cpus += c->is_busy;
 		}
-		need_cpus = apply_task_need(cluster, need_cpus);
+		need_cpus = apply_task_need(cluster, busy_cpus);
 	}
 	new_need = apply_limits(cluster, need_cpus);
 	need_flag = adjustment_possible(cluster, new_need);
 
+	trace_core_ctl_eval_inputs(cluster->first_cpu, cluster->active_cpus,
+				   busy_cpus, cluster->nrrun, cluster->max_nr,
+				   cluster->stall_pct, cluster->psi_stall_thres,
+				   cluster->boost, new_need);
+
 	last_need = cluster->need_cpus;
 	now = ktime_to_ms(ktime_get());
 
@@ -670,6 +714,45 @@ int core_ctl_set_boost(bool boost)
 }
 EXPORT_SYMBOL(core_ctl_set_boost);
 
+/*
+ * Runnable-wait time of the active CPUs of each cluster since the last
+ * check, as a percentage of the time those CPUs were available. This is
+ * PSI's cpu "some" state restricted to the cluster.
+ */
+static void update_stall_pct(u64 elapsed)
+{
+	struct cluster_data *cluster;
+	unsigned int index = 0;
+	struct cpu_data *c;
+	unsigned int nr_active;
+	u64 stall;
+	u32 time;
+
+	for_each_cluster(cluster, index) {
+		if (!cluster->inited)
+			continue;
+
+		stall = 0;
+		nr_active = 0;
+		list_for_each_entry(c, &cluster->lru, sib) {
+			time = psi_cpu_some_time(c->cpu);
+			if (is_active(c)) {
+				stall += (u32)(time - c->stall_time);
+				nr_active++;
+			}
+			c->stall_time = time;
+		}
+
+		if (!elapsed || !nr_active) {
+			cluster->stall_pct = 0;
+			continue;
+		}
+
+		cluster->stall_pct = min_t(u64, 100,
+				div64_u64(stall * 100, elapsed * nr_active));
+	}
+}
+
 void core_ctl_check(u64 window_start)
 {
 	int cpu;
@@ -677,6 +760,7 @@ void core_ctl_check(u64 window_start)
 	struct cluster_data *cluster;
 	unsigned int index = 0;
 	unsigned long flags;
+	u64 elapsed;
 
 	if (unlikely(!initialized))
 		return;
@@ -684,6 +768,10 @@ void core_ctl_check(u64 window_start)
 	if (window_start == core_ctl_check_timestamp)
 		return;
 
+	/* Stall times wrap at 32 bits, don't trust a longer gap */
+	elapsed = window_start - core_ctl_check_timestamp;
+	if (!core_ctl_check_timestamp || elapsed > U32_MAX)
+		elapsed = 0;
 	core_ctl_check_timestamp = window_start;
 
 	spin_lock_irqsave(&state_lock, flags);
@@ -697,6 +785,7 @@ void core_ctl_check(u64 window_start)
 
 		c->busy = sched_get_cpu_util(cpu);
 	}
+	update_stall_pct(elapsed);
 	spin_unlock_irqrestore(&state_lock, flags);
 
 	update_running_avg();
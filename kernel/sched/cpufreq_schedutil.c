@@ -28,6 +28,8 @@ struct sugov_tunables {
 	unsigned int hispeed_load;
 	unsigned int hispeed_freq;
 	bool pl;
+	bool pred_load;
+	unsigned int pred_confidence;
 };
 
 struct sugov_policy {
@@ -50,6 +52,14 @@ struct sugov_policy {
 	unsigned long hispeed_util;
 	unsigned long max;
 
+	/* Predicted load accuracy, see sugov_track_pred() */
+	unsigned int pred_conf;
+	u64 pred_windows;
+	u64 pred_hits;
+	u64 pred_under;
+	u64 pred_over;
+	u64 pred_boosts;
+
 	/* The next fields are only needed if fast switch cannot be used. */
 	struct irq_work irq_work;
 	struct kthread_work work;
@@ -71,6 +81,8 @@ struct sugov_cpu {
 	u64 last_update;
 
 	struct sched_walt_cpu_load walt_load;
+	unsigned long pred_util;
+	u64 pred_ws;
 
 	/* The fields below are only needed when sharing a policy. */
 	unsigned long util;
@@ -223,6 +235,7 @@ static void sugov_get_util(unsigned long *util, unsigned long *max, int cpu)
 	*max = cfs_max;
 
 	*util = boosted_cpu_util(cpu, &loadcpu->walt_load);
+	*util = schedtune_uclamp_cpu_util(cpu, *util);
 }
 
 static void sugov_set_iowait_boost(struct sugov_cpu *sg_cpu, u64 time)
@@ -332,6 +345,59 @@ static void sugov_calc_avg_cap(struct sugov_policy *sg_policy, u64 curr_ws,
 	sg_policy->last_ws = curr_ws;
 }
 
+#define PRED_CONF_SHIFT		10
+#define PRED_CONF_MAX		(1U << PRED_CONF_SHIFT)
+#define PRED_TOLERANCE		25
+#define DEFAULT_PRED_CONFIDENCE	70
+
+/*
+ * Score the load predicted for a CPU at the start of the window that has
+ * just closed against what the window turned out to be. A prediction is
+ * a hit when it is within PRED_TOLERANCE percent of the actual load, or
+ * within 1/16th of the CPU capacity for small loads. The policy keeps a
+ * running average of the hit rate, in 1/1024th, which gates predictive
+ * boosting in sugov_walt_adjust().
+ */
+static void sugov_track_pred(struct sugov_cpu *sg_cpu)
+{
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+	u64 ws = sg_cpu->walt_load.ws;
+	unsigned long pred = sg_cpu->pred_util;
+	unsigned long actual, tol;
+	bool hit;
+
+	if (use_pelt() || ws == sg_cpu->pred_ws)
+		return;
+
+	actual = sg_cpu->walt_load.prev_window_util;
+
+	/* Skipped windows and idle ones say nothing about the predictor */
+	if (ws != sg_cpu->pred_ws + sched_ravg_window || (!pred && !actual))
+		goto next;
+
+	tol = max(mult_frac(max(pred, actual), PRED_TOLERANCE, 100),
+		  sg_cpu->max >> 4);
+	hit = true;
+	if (actual > pred + tol) {
+		sg_policy->pred_under++;
+		hit = false;
+	} else if (pred > actual + tol) {
+		sg_policy->pred_over++;
+		hit = false;
+	} else {
+		sg_policy->pred_hits++;
+	}
+	sg_policy->pred_windows++;
+
+	sg_policy->pred_conf -= sg_policy->pred_conf >> 3;
+	if (hit)
+		sg_policy->pred_conf += PRED_CONF_MAX >> 3;
+
+next:
+	sg_cpu->pred_util = sg_cpu->walt_load.pl;
+	sg_cpu->pred_ws = ws;
+}
+
 #define NL_RATIO 75
 #define DEFAULT_HISPEED_LOAD 90
 static void sugov_walt_adjust(struct sugov_cpu *sg_cpu, unsigned long *util,
@@ -358,6 +424,18 @@ static void sugov_walt_adjust(struct sugov_cpu *sg_cpu, unsigned long *util,
 
 	if (sg_policy->tunables->pl)
 		*util = max(*util, sg_cpu->walt_load.pl);
+
+	/*
+	 * Ramp up ahead of the predicted demand of the next window, as long
+	 * as the predictions for this policy have been accurate enough.
+	 */
+	if (sg_policy->tunables->pred_load &&
+	    sg_cpu->walt_load.pl > *util &&
+	    (sg_policy->pred_conf * 100 >> PRED_CONF_SHIFT) >=
+	    sg_policy->tunables->pred_confidence) {
+		*util = min(sg_cpu->walt_load.pl, *max);
+		sg_policy->pred_boosts++;
+	}
 }
 
 #ifdef CONFIG_NO_HZ_COMMON
@@ -385,7 +463,8 @@ static void sugov_update_single(struct update_util_data *hook, u64 time,
 
 	flags &= ~SCHED_CPUFREQ_RT_DL;
 
-	if (!sg_policy->tunables->pl && flags & SCHED_CPUFREQ_PL)
+	if (!sg_policy->tunables->pl && !sg_policy->tunables->pred_load &&
+	    flags & SCHED_CPUFREQ_PL)
 		return;
 
 	sugov_set_iowait_boost(sg_cpu, time);
@@ -416,6 +495,7 @@ static void sugov_update_single(struct update_util_data *hook, u64 time,
 		sg_cpu->flags = flags;
 		sugov_calc_avg_cap(sg_policy, sg_cpu->walt_load.ws,
 				   sg_policy->policy->cur);
+		sugov_track_pred(sg_cpu);
 		trace_sugov_util_update(sg_cpu->cpu, sg_cpu->util,
 					sg_policy->avg_cap,
 					max, sg_cpu->walt_load.nl,
@@ -491,7 +571,8 @@ static void sugov_update_shared(struct update_util_data *hook, u64 time,
 	unsigned long util, max, hs_util;
 	unsigned int next_f;
 
-	if (!sg_policy->tunables->pl && flags & SCHED_CPUFREQ_PL)
+	if (!sg_policy->tunables->pl && !sg_policy->tunables->pred_load &&
+	    flags & SCHED_CPUFREQ_PL)
 		return;
 
 	sugov_get_util(&util, &max, sg_cpu->cpu);
@@ -517,6 +598,7 @@ static void sugov_update_shared(struct update_util_data *hook, u64 time,
 
 	sugov_calc_avg_cap(sg_policy, sg_cpu->walt_load.ws,
 			   sg_policy->policy->cur);
+	sugov_track_pred(sg_cpu);
 
 	trace_sugov_util_update(sg_cpu->cpu, sg_cpu->util, sg_policy->avg_cap,
 				max, sg_cpu->walt_load.nl,
@@ -597,7 +679,72 @@ static void update_min_rate_limit_ns(struct sugov_policy *sg_policy)
 	mutex_unlock(&min_rate_lock);
 }
 
+static ssize_t pred_load_show(struct gov_attr_set *attr_set, char *buf)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n", tunables->pred_load);
+}
+
+static ssize_t pred_load_store(struct gov_attr_set *attr_set,
+			       const char *buf, size_t count)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+
+	if (kstrtobool(buf, &tunables->pred_load))
+		return -EINVAL;
+
+	return count;
+}
+
+static ssize_t pred_confidence_show(struct gov_attr_set *attr_set, char *buf)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n", tunables->pred_confidence);
+}
+
+static ssize_t pred_confidence_store(struct gov_attr_set *attr_set,
+				     const char *buf, size_t count)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+	unsigned int val;
+
+	if (kstrtouint(buf, 10, &val) || val > 100)
+		return -EINVAL;
+
+	tunables->pred_confidence = val;
+
+	return count;
+}
+
+static ssize_t pred_stats_show(struct gov_attr_set *attr_set, char *buf)
+{
+	struct sugov_policy *sg_policy;
+	ssize_t ret = 0;
+
+	mutex_lock(&attr_set->update_lock);
+	list_for_each_entry(sg_policy, &attr_set->policy_list, tunables_hook)
+		ret += scnprintf(buf + ret, PAGE_SIZE - ret,
+				 "policy%u windows=%llu hits=%llu under=%llu over=%llu boosts=%llu confidence=%u\n",
+				 sg_policy->policy->cpu,
+				 sg_policy->pred_windows, sg_policy->pred_hits,
+				 sg_policy->pred_under, sg_policy->pred_over,
+				 sg_policy->pred_boosts,
+				 sg_policy->pred_conf * 100 >> PRED_CONF_SHIFT);
+	mutex_unlock(&attr_set->update_lock);
+
+	return ret;
+}
+
+static struct governor_attr pred_load = __ATTR_RW(pred_load);
+static struct governor_attr pred_confidence = __ATTR_RW(pred_confidence);
+static struct governor_attr pred_stats = __ATTR_RO(pred_stats);
+
 static struct attribute *sugov_attributes[] = {
+	&pred_load.attr,
+	&pred_confidence.attr,
+	&pred_stats.attr,
 	NULL
 };
 
@@ -718,6 +865,8 @@ static void sugov_tunables_save(struct cpufreq_policy *policy,
 	}
 
 	cached->pl = tunables->pl;
+	cached->pred_load = tunables->pred_load;
+	cached->pred_confidence = tunables->pred_confidence;
 	cached->hispeed_load = tunables->hispeed_load;
 	cached->hispeed_freq = tunables->hispeed_freq;
 	cached->up_rate_limit_us = tunables->up_rate_limit_us;
@@ -740,6 +889,8 @@ static void sugov_tunables_restore(struct cpufreq_policy *policy)
 		return;
 
 	tunables->pl = cached->pl;
+	tunables->pred_load = cached->pred_load;
+	tunables->pred_confidence = cached->pred_confidence;
 	tunables->hispeed_load = cached->hispeed_load;
 	tunables->hispeed_freq = cached->hispeed_freq;
 	tunables->up_rate_limit_us = cached->up_rate_limit_us;
@@ -793,6 +944,7 @@ static int sugov_init(struct cpufreq_policy *policy)
 	tunables->down_rate_limit_us = 500;
 	tunables->hispeed_load = DEFAULT_HISPEED_LOAD;
 	tunables->hispeed_freq = 0;
+	tunables->pred_confidence = DEFAULT_PRED_CONFIDENCE;
 
 	policy->governor_data = sg_policy;
 	sg_policy->tunables = tunables;
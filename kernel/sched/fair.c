@@ -6671,7 +6671,8 @@ boosted_task_util(struct task_struct *p)
 
 	trace_sched_boost_task(p, util, margin);
 
-	return util + margin;
+	/* Utilization clamps bound the boosted value */
+	return schedtune_uclamp_task_util(p, util + margin);
 }
 
 static unsigned long cpu_util_without(int cpu, struct task_struct *p);
@@ -173,7 +173,7 @@ static u64 psi_period __read_mostly;
 
 /* System-level pressure and stall tracking */
 static DEFINE_PER_CPU(struct psi_group_cpu, system_group_pcpu);
-static struct psi_group psi_system = {
+struct psi_group psi_system = {
 	.pcpu = &system_group_pcpu,
 };
 
@@ -279,6 +279,34 @@ static void get_recent_times(struct psi_group *group, int cpu,
 	}
 }
 
+/**
+ * psi_cpu_some_time - runnable-wait time of a CPU
+ * @cpu: the CPU to sample
+ *
+ * Returns the system-wide PSI_CPU_SOME time of @cpu in ns, including the
+ * state in progress. The counter wraps at 32 bits, so callers are only
+ * meant to look at the difference between two samples.
+ */
+u32 psi_cpu_some_time(int cpu)
+{
+	struct psi_group_cpu *groupc;
+	unsigned int seq;
+	u32 time;
+
+	if (static_branch_likely(&psi_disabled))
+		return 0;
+
+	groupc = per_cpu_ptr(psi_system.pcpu, cpu);
+	do {
+		seq = read_seqcount_begin(&groupc->seq);
+		time = groupc->times[PSI_CPU_SOME];
+		if (groupc->state_mask & (1 << PSI_CPU_SOME))
+			time += cpu_clock(cpu) - groupc->state_start;
+	} while (read_seqcount_retry(&groupc->seq, seq));
+
+	return time;
+}
+
 static void calc_avgs(unsigned long avg[3], int missed_periods,
 		      u64 time, u64 period)
 {
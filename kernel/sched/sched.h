@@ -60,6 +60,19 @@ struct load_subtractions {
 	u64 new_subs;
 };
 
+/*
+ * Previous window load of a CPU, published under rq->walt_seq for the
+ * readers which do not hold its rq lock.
+ */
+struct walt_prev_window {
+	u64 window_start;
+	u64 runnable_sum;
+	u64 nt_runnable_sum;
+	u64 grp_runnable_sum;
+	u64 grp_nt_runnable_sum;
+	u32 top_task_load;
+};
+
 #define NUM_TRACKED_WINDOWS 2
 #define NUM_LOAD_INDICES 1000
 
@@ -89,6 +102,7 @@ struct sched_cluster {
 	bool wake_up_idle;
 	u64 aggr_grp_load;
 	u64 coloc_boost_load;
+	u64 frame_boost_load;
 };
 
 extern unsigned int sched_disable_window_stats;
@@ -837,6 +851,9 @@ struct rq {
 	bool notif_pending;
 	u64 last_cc_update;
 	u64 cycles;
+	u64 walt_rolled_ws;
+	seqcount_t walt_seq;
+	struct walt_prev_window walt_prev;
 #endif
 
 #ifdef CONFIG_IRQ_TIME_ACCOUNTING
@@ -1980,7 +1997,7 @@ static inline unsigned long cpu_util_cum(int cpu, int delta)
 }
 
 #ifdef CONFIG_SCHED_WALT
-u64 freq_policy_load(struct rq *rq);
+u64 freq_policy_load(struct rq *rq, struct walt_prev_window *pw);
 extern u64 walt_load_reported_window;
 
 static inline unsigned long
@@ -1989,19 +2006,19 @@ cpu_util_freq_walt(int cpu, struct sched_walt_cpu_load *walt_load)
 	u64 util, util_unboosted;
 	struct rq *rq = cpu_rq(cpu);
 	unsigned long capacity = capacity_orig_of(cpu);
+	struct walt_prev_window pw;
 	int boost;
 
 	if (unlikely(walt_disabled || !sysctl_sched_use_walt_cpu_util))
 		return cpu_util(cpu);
 
 	boost = per_cpu(sched_load_boost, cpu);
-	util_unboosted = util = freq_policy_load(rq);
+	util_unboosted = util = freq_policy_load(rq, &pw);
 	util = div64_u64(util * (100 + boost),
 			 walt_cpu_util_freq_divisor);
 
 	if (walt_load) {
-		u64 nl = cpu_rq(cpu)->nt_prev_runnable_sum +
-			rq->grp_time.nt_prev_runnable_sum;
+		u64 nl = pw.nt_runnable_sum + pw.grp_nt_runnable_sum;
 		u64 pl = rq->walt_stats.pred_demands_sum;
 
 		/* do_pl_notif() needs unboosted signals */
@@ -2418,6 +2435,19 @@ struct related_thread_group {
 	struct sched_cluster *preferred_cluster;
 	struct rcu_head rcu;
 	u64 last_update;
+
+	/* Frame deadline tracking, see walt_frame_account() */
+	raw_spinlock_t frame_lock;
+	u64 frame_period;
+	u64 frame_start;
+	u64 frame_busy;
+	u64 frame_prev_busy;
+	bool frame_boost;
+	bool frame_boosted;
+	bool frame_boost_pref;
+	u64 nr_frames;
+	u64 nr_missed;
+	u64 nr_boosted;
 };
 
 extern struct list_head cluster_head;
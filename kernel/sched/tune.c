@@ -1,10 +1,13 @@
 #include <linux/cgroup.h>
 #include <linux/err.h>
+#include <linux/idr.h>
+#include <linux/input_boost.h>
 #include <linux/percpu.h>
 #include <linux/printk.h>
 #include <linux/slab.h>
 #include <linux/kernel.h>
 #include <linux/rcupdate.h>
+#include <linux/mutex.h>
 #include <linux/slab.h>
 #include <trace/events/sched.h>
 
@@ -116,56 +119,44 @@ __schedtune_accept_deltas(int nrg_delta, int cap_delta,
  *  - slow path: where CGroups are created/updated/removed
  *  - fast path: where tasks in a CGroups are accounted
  *
- * The slow path tracks (a limited number of) CGroups and maps each on a
- * "boost_group" index. The fastpath accounts tasks currently RUNNABLE on each
- * "boost_group".
+ * The slow path allocates a boost group ID for each new CGroup, together
+ * with a per-CPU "boost_group" which tracks the boost value and the count of
+ * RUNNABLE tasks of that CGroup on each CPU.
+ * The fast path accounts tasks currently RUNNABLE on each "boost_group".
  *
- * Once a new CGroup is created, a boost group idx is assigned and the
- * corresponding "boost_group" marked as valid on each CPU.
- * Once a CGroup is release, the corresponding "boost_group" is marked as
- * invalid on each CPU. The CPU boost value (boost_max) is aggregated by
- * considering only valid boost_groups with a non null tasks counter.
+ * A boost group is active on a CPU while it has RUNNABLE tasks there, the
+ * root one is always active. Each CPU counts its active boost groups per
+ * boost value and keeps a bitmap of the boost values in use: the CPU boost
+ * value (boost_max) is the highest bit set, found without walking the boost
+ * groups however many of them are allocated.
  *
  * .:: Locking strategy
  *
- * The fast path uses a spin lock for each CPU boost_group which protects the
- * tasks counter.
+ * The fast path uses a spin lock for each CPU which protects the tasks
+ * counters of its boost groups and the boost values bitmap.
  *
- * The "valid" and "boost" values of each CPU boost_group is instead
- * protected by the RCU lock provided by the CGroups callbacks. Thus, only the
- * slow path can access and modify the boost_group attribtues of each CPU.
- * The fast path will catch up the most updated values at the next scheduling
- * event (i.e. enqueue/dequeue).
+ * The boost value of each CPU's boost group is updated by the slow path
+ * holding the same per-CPU lock, so that a boost group is always accounted
+ * in the bitmap with the boost value it was activated with.
  *
  *                                                        |
  *                                             SLOW PATH  |   FAST PATH
  *                              CGroup add/update/remove  |   Scheduler enqueue/dequeue events
  *                                                        |
  *                                                        |
- *                                                        |     DEFINE_PER_CPU(struct boost_groups)
- *                                                        |     +--------------+----+---+----+----+
- *                                                        |     |  idle        |    |   |    |    |
- *                                                        |     |  boost_max   |    |   |    |    |
- *                                                        |  +---->lock        |    |   |    |    |
- *  struct schedtune                  allocated_groups    |  |  |  group[    ] |    |   |    |    |
- *  +------------------------------+         +-------+    |  |  +--+---------+-+----+---+----+----+
- *  | idx                          |         |       |    |  |     |  valid  |
- *  | boots / prefer_idle          |         |       |    |  |     |  boost  |
- *  | perf_{boost/constraints}_idx | <---------+(*)  |    |  |     |  tasks  | <------------+
- *  | css                          |         +-------+    |  |     +---------+              |
- *  +-+----------------------------+         |       |    |  |     |         |              |
- *    ^                                      |       |    |  |     |         |              |
- *    |                                      +-------+    |  |     +---------+              |
- *    |                                      |       |    |  |     |         |              |
- *    |                                      |       |    |  |     |         |              |
- *    |                                      +-------+    |  |     +---------+              |
- *    | zmalloc                              |       |    |  |     |         |              |
- *    |                                      |       |    |  |     |         |              |
- *    |                                      +-------+    |  |     +---------+              |
- *    +                              BOOSTGROUPS_COUNT    |  |     BOOSTGROUPS_COUNT        |
- *  schedtune_boostgroup_init()                           |  +                              |
- *                                                        |  schedtune_{en,de}queue_task()  |
- *                                                        |                                 +
+ *  struct schedtune                  boostgroup_idr      |     DEFINE_PER_CPU(struct boost_groups)
+ *  +------------------------------+         +-------+    |     +--------------+
+ *  | idx                          | <-------+(*)    |    |     |  boost_max   |
+ *  | boost / prefer_idle          |         +-------+    |  +---->lock        |
+ *  | perf_{boost/constraints}_idx |         |       |    |  |  |  active[]    | <----------+
+ *  | cpu_group (percpu)           |-------+ +-------+    |  |  |  active_map  |            |
+ *  | css                          |       |              |  |  +--------------+            |
+ *  +-+----------------------------+       |  per CPU     |  |                              |
+ *    ^                                    +->+-------+   |  |                              |
+ *    | zmalloc                               | boost | <------------------------------+    |
+ *    |                                       | tasks |   |  |                         |    |
+ *    +                                       +-------+   |  +                         +    +
+ *  schedtune_boostgroup_init()                           |  schedtune_{en,de}queue_task()
  *                                                        |          schedtune_tasks_update()
  *                                                        |
  */
@@ -181,6 +172,12 @@ struct schedtune {
 	/* Boost value for tasks on that SchedTune CGroup */
 	int boost;
 
+	/* Boost value reached by tasks on that SchedTune CGroup on input */
+	int input_boost;
+
+	/* Per CPU boost group tracking of that SchedTune CGroup */
+	struct boost_group __percpu *cpu_group;
+
 #ifdef CONFIG_SCHED_WALT
 	/* Toggle ability to override sched boost enabled */
 	bool sched_boost_no_override;
@@ -217,6 +214,10 @@ struct schedtune {
 	/* Hint to bias scheduling of tasks on that SchedTune CGroup
 	 * towards idle CPUs */
 	int prefer_idle;
+
+	/* Range the utilization clamps of tasks on that SchedTune CGroup
+	 * are restricted to */
+	unsigned int uclamp[UCLAMP_CNT];
 };
 
 static inline struct schedtune *css_st(struct cgroup_subsys_state *css)
@@ -234,6 +235,18 @@ static inline struct schedtune *parent_st(struct schedtune *st)
 	return css_st(st->css.parent);
 }
 
+/* SchedTune boost group
+ * Keep track of the boost value and the RUNNABLE tasks of a CGroup on a CPU.
+ */
+struct boost_group {
+	/* The boost for tasks on that boost group */
+	int boost;
+	/* Count of RUNNABLE tasks on that boost group */
+	unsigned int tasks;
+};
+
+static DEFINE_PER_CPU(struct boost_group, root_boost_group);
+
 /*
  * SchedTune root control group
  * The root control group is used to defined a system-wide boosting tuning,
@@ -246,6 +259,7 @@ static inline struct schedtune *parent_st(struct schedtune *st)
 static struct schedtune
 root_schedtune = {
 	.boost	= 0,
+	.cpu_group = &root_boost_group,
 #ifdef CONFIG_SCHED_WALT
 	.sched_boost_no_override = false,
 	.sched_boost_enabled = true,
@@ -256,6 +270,8 @@ root_schedtune = {
 	.perf_boost_idx = 0,
 	.perf_constrain_idx = 0,
 	.prefer_idle = 0,
+	.uclamp[UCLAMP_MIN] = 0,
+	.uclamp[UCLAMP_MAX] = SCHED_CAPACITY_SCALE,
 };
 
 int
@@ -289,44 +305,52 @@ schedtune_accept_deltas(int nrg_delta, int cap_delta,
 			perf_boost_idx, perf_constrain_idx);
 }
 
+/* Allocated boost groups, indexed by their ID */
+static DEFINE_IDR(boostgroup_idr);
+static DEFINE_MUTEX(boostgroup_mutex);
+
+/* Boost values are in the [-100..100] range */
+#define BOOST_VALUES	201
+#define BOOST_OFFSET	100
+
 /*
- * Maximum number of boost groups to support
- * When per-task boosting is used we still allow only limited number of
- * boost groups for two main reasons:
- * 1. on a real system we usually have only few classes of workloads which
- *    make sense to boost with different values (e.g. background vs foreground
- *    tasks, interactive vs low-priority tasks)
- * 2. a limited number allows for a simpler and more memory/time efficient
- *    implementation especially for the computation of the per-CPU boost
- *    value
+ * Number of utilization clamp buckets per CPU
+ * Each bucket refcounts the RUNNABLE tasks whose clamp value falls in a
+ * UCLAMP_BUCKET_DELTA wide slice of the capacity range, so that the CPU
+ * clamp can be aggregated without walking the tasks.
  */
-#define BOOSTGROUPS_COUNT 7
+#define UCLAMP_BUCKETS 5
+#define UCLAMP_BUCKET_DELTA \
+	DIV_ROUND_CLOSEST(SCHED_CAPACITY_SCALE, UCLAMP_BUCKETS)
 
-/* Array of configured boostgroups */
-static struct schedtune *allocated_group[BOOSTGROUPS_COUNT] = {
-	&root_schedtune,
-	NULL,
+struct uclamp_cpu {
+	/* Clamp enforced on the CPU: the highest of its active buckets */
+	unsigned int value;
+	struct {
+		/* Highest clamp of the RUNNABLE tasks in this bucket */
+		unsigned int value;
+		/* Count of RUNNABLE tasks in this bucket */
+		unsigned int tasks;
+	} bucket[UCLAMP_BUCKETS];
 };
 
 /* SchedTune boost groups
  * Keep track of all the boost groups which impact on CPU, for example when a
  * CPU has two RUNNABLE tasks belonging to two different boost groups and thus
  * likely with different boost values.
- * Since on each system we expect only a limited number of boost groups, here
- * we use a simple array to keep track of the metrics required to compute the
- * maximum per-CPU boosting value.
+ * Active boost groups are counted per boost value rather than per group, so
+ * that the maximum per-CPU boosting value is found with a scan of the
+ * bitmap of the values in use, independently of the number of groups.
  */
 struct boost_groups {
 	/* Maximum boost value for all RUNNABLE tasks on a CPU */
 	int boost_max;
-	struct {
-		/* True when this boost group maps an actual cgroup */
-		bool valid;
-		/* The boost for tasks on that boost group */
-		int boost;
-		/* Count of RUNNABLE tasks on that boost group */
-		unsigned tasks;
-	} group[BOOSTGROUPS_COUNT];
+	/* Count of active boost groups for each boost value */
+	unsigned int active[BOOST_VALUES];
+	/* Boost values with at least one active boost group */
+	DECLARE_BITMAP(active_map, BOOST_VALUES);
+	/* Utilization clamps of RUNNABLE tasks on a CPU */
+	struct uclamp_cpu uclamp[UCLAMP_CNT];
 	/* CPU's boost group locking */
 	raw_spinlock_t lock;
 };
@@ -334,6 +358,26 @@ struct boost_groups {
 /* Boost groups affecting each CPU in the system */
 DEFINE_PER_CPU(struct boost_groups, cpu_boost_groups);
 
+/* Input boost level, from 0 to INPUT_BOOST_LEVEL_SCALE */
+static unsigned int schedtune_input_level;
+
+/*
+ * Boost in effect for a group: its boost value, raised towards its input
+ * boost value in proportion to the current input boost level.
+ */
+static int schedtune_effective_boost(struct schedtune *st)
+{
+	unsigned int level = READ_ONCE(schedtune_input_level);
+	int input_boost = READ_ONCE(st->input_boost);
+	int boost = READ_ONCE(st->boost);
+
+	if (level && input_boost > boost)
+		boost += (input_boost - boost) * (int)level /
+			 INPUT_BOOST_LEVEL_SCALE;
+
+	return boost;
+}
+
 #ifdef CONFIG_SCHED_WALT
 static inline void init_sched_boost(struct schedtune *st)
 {
@@ -346,30 +390,28 @@ static inline void init_sched_boost(struct schedtune *st)
 
 void update_cgroup_boost_settings(void)
 {
-	int i;
-
-	for (i = 0; i < BOOSTGROUPS_COUNT; i++) {
-		if (!allocated_group[i])
-			break;
+	struct schedtune *st;
+	int idx;
 
-		if (allocated_group[i]->sched_boost_no_override)
+	mutex_lock(&boostgroup_mutex);
+	idr_for_each_entry(&boostgroup_idr, st, idx) {
+		if (st->sched_boost_no_override)
 			continue;
 
-		allocated_group[i]->sched_boost_enabled = false;
+		st->sched_boost_enabled = false;
 	}
+	mutex_unlock(&boostgroup_mutex);
 }
 
 void restore_cgroup_boost_settings(void)
 {
-	int i;
-
-	for (i = 0; i < BOOSTGROUPS_COUNT; i++) {
-		if (!allocated_group[i])
-			break;
+	struct schedtune *st;
+	int idx;
 
-		allocated_group[i]->sched_boost_enabled =
-			allocated_group[i]->sched_boost_enabled_backup;
-	}
+	mutex_lock(&boostgroup_mutex);
+	idr_for_each_entry(&boostgroup_idr, st, idx)
+		st->sched_boost_enabled = st->sched_boost_enabled_backup;
+	mutex_unlock(&boostgroup_mutex);
 }
 
 bool task_sched_boost(struct task_struct *p)
@@ -400,32 +442,41 @@ static int sched_boost_override_write(struct cgroup_subsys_state *css,
 
 #endif /* CONFIG_SCHED_WALT */
 
-static void
-schedtune_cpu_update(int cpu)
+/* The root boost group is always active */
+static inline bool
+schedtune_group_active(struct schedtune *st, struct boost_group *group)
 {
-	struct boost_groups *bg;
-	int boost_max;
-	int idx;
+	return st == &root_schedtune || group->tasks;
+}
 
-	bg = &per_cpu(cpu_boost_groups, cpu);
+static inline void
+schedtune_boost_activate(struct boost_groups *bg, int boost)
+{
+	int value = boost + BOOST_OFFSET;
 
-	/* The root boost group is always active */
-	boost_max = bg->group[0].boost;
-	for (idx = 1; idx < BOOSTGROUPS_COUNT; ++idx) {
+	if (bg->active[value]++ == 0)
+		__set_bit(value, bg->active_map);
+}
 
-		/* Ignore non boostgroups not mapping a cgroup */
-		if (!bg->group[idx].valid)
-			continue;
+static inline void
+schedtune_boost_deactivate(struct boost_groups *bg, int boost)
+{
+	int value = boost + BOOST_OFFSET;
 
-		/*
-		 * A boost group affects a CPU only if it has
-		 * RUNNABLE tasks on that CPU
-		 */
-		if (bg->group[idx].tasks == 0)
-			continue;
+	/* Update active groups count while avoiding to make it negative */
+	if (bg->active[value] && --bg->active[value] == 0)
+		__clear_bit(value, bg->active_map);
+}
 
-		boost_max = max(boost_max, bg->group[idx].boost);
-	}
+static void
+schedtune_cpu_update(struct boost_groups *bg)
+{
+	unsigned long value;
+	int boost_max = 0;
+
+	value = find_last_bit(bg->active_map, BOOST_VALUES);
+	if (value < BOOST_VALUES)
+		boost_max = (int)value - BOOST_OFFSET;
 
 	/* Ensures boost_max is non-negative when all cgroup boost values
 	 * are neagtive. Avoids under-accounting of cpu capacity which may cause
@@ -435,46 +486,44 @@ schedtune_cpu_update(int cpu)
 }
 
 static int
-schedtune_boostgroup_update(int idx, int boost)
+schedtune_boostgroup_update(struct schedtune *st, int boost)
 {
 	struct boost_groups *bg;
+	struct boost_group *group;
+	unsigned long irq_flags;
 	int cur_boost_max;
-	int old_boost;
 	int cpu;
 
 	/* Update per CPU boost groups */
 	for_each_possible_cpu(cpu) {
 		bg = &per_cpu(cpu_boost_groups, cpu);
+		group = per_cpu_ptr(st->cpu_group, cpu);
 
-		/* CGroups are never associated to non active cgroups */
-		BUG_ON(!bg->group[idx].valid);
+		raw_spin_lock_irqsave(&bg->lock, irq_flags);
 
 		/*
-		 * Keep track of current boost values to compute the per CPU
-		 * maximum only when it has been affected by the new value of
-		 * the updated boost group
+		 * Keep track of current boost values to report whether the
+		 * per CPU maximum has been affected by the new value of the
+		 * updated boost group
 		 */
 		cur_boost_max = bg->boost_max;
-		old_boost = bg->group[idx].boost;
 
-		/* Update the boost value of this boost group */
-		bg->group[idx].boost = boost;
-
-		/* Check if this update increase current max */
-		if (boost > cur_boost_max && bg->group[idx].tasks) {
-			bg->boost_max = boost;
-			trace_sched_tune_boostgroup_update(cpu, 1, bg->boost_max);
-			continue;
+		/* Move an active boost group to its new boost value */
+		if (schedtune_group_active(st, group)) {
+			schedtune_boost_deactivate(bg, group->boost);
+			schedtune_boost_activate(bg, boost);
 		}
 
-		/* Check if this update has decreased current max */
-		if (cur_boost_max == old_boost && old_boost > boost) {
-			schedtune_cpu_update(cpu);
-			trace_sched_tune_boostgroup_update(cpu, -1, bg->boost_max);
-			continue;
-		}
+		/* Update the boost value of this boost group */
+		group->boost = boost;
 
-		trace_sched_tune_boostgroup_update(cpu, 0, bg->boost_max);
+		schedtune_cpu_update(bg);
+		trace_sched_tune_boostgroup_update(cpu,
+				(bg->boost_max > cur_boost_max) -
+				(bg->boost_max < cur_boost_max),
+				bg->boost_max);
+
+		raw_spin_unlock_irqrestore(&bg->lock, irq_flags);
 	}
 
 	return 0;
@@ -483,21 +532,178 @@ schedtune_boostgroup_update(int idx, int boost)
 #define ENQUEUE_TASK  1
 #define DEQUEUE_TASK -1
 
+/*
+ * NOTE: This function must be called while holding the lock on the CPU RQ
+ * and the CPU's boost groups lock
+ */
 static inline void
-schedtune_tasks_update(struct task_struct *p, int cpu, int idx, int task_count)
+schedtune_tasks_update(struct task_struct *p, int cpu, struct schedtune *st,
+		       int task_count)
 {
 	struct boost_groups *bg = &per_cpu(cpu_boost_groups, cpu);
-	int tasks = bg->group[idx].tasks + task_count;
+	struct boost_group *group = per_cpu_ptr(st->cpu_group, cpu);
+	int tasks = group->tasks + task_count;
 
 	/* Update boosted tasks count while avoiding to make it negative */
-	bg->group[idx].tasks = max(0, tasks);
-
-	trace_sched_tune_tasks_update(p, cpu, tasks, idx,
-			bg->group[idx].boost, bg->boost_max);
+	group->tasks = max(0, tasks);
 
 	/* Boost group activation or deactivation on that RQ */
-	if (tasks == 1 || tasks == 0)
-		schedtune_cpu_update(cpu);
+	if (st != &root_schedtune) {
+		if (task_count == ENQUEUE_TASK && tasks == 1) {
+			schedtune_boost_activate(bg, group->boost);
+			schedtune_cpu_update(bg);
+		} else if (task_count == DEQUEUE_TASK && tasks == 0) {
+			schedtune_boost_deactivate(bg, group->boost);
+			schedtune_cpu_update(bg);
+		}
+	}
+
+	trace_sched_tune_tasks_update(p, cpu, tasks, st->idx,
+			group->boost, bg->boost_max);
+}
+
+/*
+ * Utilization clamps
+ *
+ * A task's effective util_min and util_max are the values it requested
+ * with sched_setattr() restricted to the range of its SchedTune group.
+ * While the task is RUNNABLE they are refcounted in the per-CPU buckets
+ * and the CPU is clamped to the highest value of each clamp: the biggest
+ * floor wins, and the CPU is capped only as long as all its tasks are.
+ *
+ * A bucket remembers the highest value it has seen since it was last
+ * empty, thus the CPU clamp may overshoot by up to UCLAMP_BUCKET_DELTA
+ * until the bucket drains.
+ */
+static inline unsigned int uclamp_none(int clamp_id)
+{
+	return clamp_id == UCLAMP_MIN ? 0 : SCHED_CAPACITY_SCALE;
+}
+
+static inline unsigned int
+uclamp_eff_value(struct task_struct *p, struct schedtune *st, int clamp_id)
+{
+	return clamp_t(unsigned int, p->uclamp_req[clamp_id].value,
+		       st->uclamp[UCLAMP_MIN], st->uclamp[UCLAMP_MAX]);
+}
+
+static void uclamp_cpu_update(struct uclamp_cpu *uc, int clamp_id)
+{
+	unsigned int value = uclamp_none(clamp_id);
+	int bucket_id;
+
+	for (bucket_id = UCLAMP_BUCKETS - 1; bucket_id >= 0; --bucket_id) {
+		if (uc->bucket[bucket_id].tasks) {
+			value = uc->bucket[bucket_id].value;
+			break;
+		}
+	}
+
+	WRITE_ONCE(uc->value, value);
+}
+
+static void
+schedtune_uclamp_enqueue(struct boost_groups *bg, struct task_struct *p,
+			 struct schedtune *st)
+{
+	struct uclamp_cpu *uc;
+	struct uclamp_se *uc_se;
+	unsigned int value, bucket_id;
+	int clamp_id;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; ++clamp_id) {
+		uc = &bg->uclamp[clamp_id];
+		uc_se = &p->uclamp[clamp_id];
+
+		value = uclamp_eff_value(p, st, clamp_id);
+		bucket_id = min_t(unsigned int, value / UCLAMP_BUCKET_DELTA,
+				  UCLAMP_BUCKETS - 1);
+
+		uc_se->value = value;
+		uc_se->bucket_id = bucket_id;
+		uc_se->active = 1;
+
+		if (uc->bucket[bucket_id].tasks++ &&
+		    uc->bucket[bucket_id].value >= value)
+			continue;
+
+		uc->bucket[bucket_id].value = value;
+		uclamp_cpu_update(uc, clamp_id);
+	}
+}
+
+static void
+schedtune_uclamp_dequeue(struct boost_groups *bg, struct task_struct *p)
+{
+	struct uclamp_cpu *uc;
+	struct uclamp_se *uc_se;
+	int clamp_id;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; ++clamp_id) {
+		uc = &bg->uclamp[clamp_id];
+		uc_se = &p->uclamp[clamp_id];
+
+		if (!uc_se->active)
+			continue;
+		uc_se->active = 0;
+
+		/* Update the bucket count while avoiding to make it negative */
+		if (uc->bucket[uc_se->bucket_id].tasks &&
+		    --uc->bucket[uc_se->bucket_id].tasks)
+			continue;
+
+		uclamp_cpu_update(uc, clamp_id);
+	}
+}
+
+/*
+ * Re-account the clamps of a RUNNABLE task against @st, which may not be
+ * its current group yet.
+ * NOTE: This function must be called while holding the lock on the CPU RQ
+ */
+static void
+schedtune_uclamp_update(struct boost_groups *bg, struct task_struct *p,
+			struct schedtune *st)
+{
+	if (!p->uclamp[UCLAMP_MIN].active)
+		return;
+
+	schedtune_uclamp_dequeue(bg, p);
+	schedtune_uclamp_enqueue(bg, p, st);
+}
+
+unsigned long schedtune_uclamp_cpu_util(int cpu, unsigned long util)
+{
+	struct boost_groups *bg = &per_cpu(cpu_boost_groups, cpu);
+	unsigned int min_util = READ_ONCE(bg->uclamp[UCLAMP_MIN].value);
+	unsigned int max_util = READ_ONCE(bg->uclamp[UCLAMP_MAX].value);
+
+	/* The floor of one task wins over the ceiling of another */
+	if (unlikely(min_util >= max_util))
+		return min_util;
+
+	return clamp_t(unsigned long, util, min_util, max_util);
+}
+
+unsigned long
+schedtune_uclamp_task_util(struct task_struct *p, unsigned long util)
+{
+	struct schedtune *st;
+	unsigned int min_util, max_util;
+
+	if (!unlikely(schedtune_initialized))
+		return util;
+
+	rcu_read_lock();
+	st = task_schedtune(p);
+	min_util = uclamp_eff_value(p, st, UCLAMP_MIN);
+	max_util = uclamp_eff_value(p, st, UCLAMP_MAX);
+	rcu_read_unlock();
+
+	if (unlikely(min_util >= max_util))
+		return min_util;
+
+	return clamp_t(unsigned long, util, min_util, max_util);
 }
 
 /*
@@ -508,7 +714,6 @@ void schedtune_enqueue_task(struct task_struct *p, int cpu)
 	struct boost_groups *bg = &per_cpu(cpu_boost_groups, cpu);
 	unsigned long irq_flags;
 	struct schedtune *st;
-	int idx;
 
 	if (!unlikely(schedtune_initialized))
 		return;
@@ -531,9 +736,9 @@ void schedtune_enqueue_task(struct task_struct *p, int cpu)
 	rcu_read_lock();
 
 	st = task_schedtune(p);
-	idx = st->idx;
 
-	schedtune_tasks_update(p, cpu, idx, ENQUEUE_TASK);
+	schedtune_tasks_update(p, cpu, st, ENQUEUE_TASK);
+	schedtune_uclamp_enqueue(bg, p, st);
 
 	rcu_read_unlock();
 	raw_spin_unlock_irqrestore(&bg->lock, irq_flags);
@@ -547,9 +752,8 @@ int schedtune_can_attach(struct cgroup_taskset *tset)
 	struct rq_flags irq_flags;
 	unsigned int cpu;
 	struct rq *rq;
-	int src_bg; /* Source boost group index */
-	int dst_bg; /* Destination boost group index */
-	int tasks;
+	struct schedtune *src_st; /* Source boost group */
+	struct schedtune *dst_st; /* Destination boost group */
 
 	if (!unlikely(schedtune_initialized))
 		return 0;
@@ -577,14 +781,14 @@ int schedtune_can_attach(struct cgroup_taskset *tset)
 		bg = &per_cpu(cpu_boost_groups, cpu);
 		raw_spin_lock(&bg->lock);
 
-		dst_bg = css_st(css)->idx;
-		src_bg = task_schedtune(task)->idx;
+		dst_st = css_st(css);
+		src_st = task_schedtune(task);
 
 		/*
 		 * Current task is not changing boostgroup, which can
 		 * happen when the new hierarchy is in use.
 		 */
-		if (unlikely(dst_bg == src_bg)) {
+		if (unlikely(dst_st == src_st)) {
 			raw_spin_unlock(&bg->lock);
 			unlock_rq_of(rq, task, &irq_flags);
 			continue;
@@ -596,17 +800,14 @@ int schedtune_can_attach(struct cgroup_taskset *tset)
 		 */
 
 		/* Move task from src to dst boost group */
-		tasks = bg->group[src_bg].tasks - 1;
-		bg->group[src_bg].tasks = max(0, tasks);
-		bg->group[dst_bg].tasks += 1;
+		schedtune_tasks_update(task, cpu, src_st, DEQUEUE_TASK);
+		schedtune_tasks_update(task, cpu, dst_st, ENQUEUE_TASK);
+
+		/* Clamps are restricted by the destination group from now on */
+		schedtune_uclamp_update(bg, task, dst_st);
 
 		raw_spin_unlock(&bg->lock);
 		unlock_rq_of(rq, task, &irq_flags);
-
-		/* Update CPU boost group */
-		if (bg->group[src_bg].tasks == 0 || bg->group[dst_bg].tasks == 1)
-			schedtune_cpu_update(task_cpu(task));
-
 	}
 
 	return 0;
@@ -693,7 +894,6 @@ void schedtune_dequeue_task(struct task_struct *p, int cpu)
 	struct boost_groups *bg = &per_cpu(cpu_boost_groups, cpu);
 	unsigned long irq_flags;
 	struct schedtune *st;
-	int idx;
 
 	if (!unlikely(schedtune_initialized))
 		return;
@@ -717,9 +917,9 @@ void schedtune_dequeue_task(struct task_struct *p, int cpu)
 	rcu_read_lock();
 
 	st = task_schedtune(p);
-	idx = st->idx;
 
-	schedtune_tasks_update(p, cpu, idx, DEQUEUE_TASK);
+	schedtune_tasks_update(p, cpu, st, DEQUEUE_TASK);
+	schedtune_uclamp_dequeue(bg, p);
 
 	rcu_read_unlock();
 	raw_spin_unlock_irqrestore(&bg->lock, irq_flags);
@@ -727,11 +927,11 @@ void schedtune_dequeue_task(struct task_struct *p, int cpu)
 
 void schedtune_exit_task(struct task_struct *tsk)
 {
+	struct boost_groups *bg;
 	struct schedtune *st;
 	struct rq_flags irq_flags;
 	unsigned int cpu;
 	struct rq *rq;
-	int idx;
 
 	if (!unlikely(schedtune_initialized))
 		return;
@@ -740,10 +940,14 @@ void schedtune_exit_task(struct task_struct *tsk)
 	rcu_read_lock();
 
 	cpu = cpu_of(rq);
+	bg = &per_cpu(cpu_boost_groups, cpu);
+	raw_spin_lock(&bg->lock);
+
 	st = task_schedtune(tsk);
-	idx = st->idx;
-	schedtune_tasks_update(tsk, cpu, idx, DEQUEUE_TASK);
+	schedtune_tasks_update(tsk, cpu, st, DEQUEUE_TASK);
+	schedtune_uclamp_dequeue(bg, tsk);
 
+	raw_spin_unlock(&bg->lock);
 	rcu_read_unlock();
 	unlock_rq_of(rq, tsk, &irq_flags);
 }
@@ -767,7 +971,7 @@ int schedtune_task_boost(struct task_struct *p)
 	/* Get task boost value */
 	rcu_read_lock();
 	st = task_schedtune(p);
-	task_boost = st->boost;
+	task_boost = schedtune_effective_boost(st);
 	rcu_read_unlock();
 
 	return task_boost;
@@ -861,6 +1065,7 @@ boost_write(struct cgroup_subsys_state *css, struct cftype *cft,
 	st->perf_boost_idx = threshold_idx;
 	st->perf_constrain_idx = threshold_idx;
 
+	mutex_lock(&boostgroup_mutex);
 	st->boost = boost;
 	if (css == &root_schedtune.css) {
 		sysctl_sched_cfs_boost = boost;
@@ -869,13 +1074,131 @@ boost_write(struct cgroup_subsys_state *css, struct cftype *cft,
 	}
 
 	/* Update CPU boost */
-	schedtune_boostgroup_update(st->idx, st->boost);
+	schedtune_boostgroup_update(st, schedtune_effective_boost(st));
+	mutex_unlock(&boostgroup_mutex);
 
 	trace_sched_tune_config(st->boost);
 
 	return 0;
 }
 
+#ifdef CONFIG_INPUT_BOOST_CORE
+static s64
+input_boost_read(struct cgroup_subsys_state *css, struct cftype *cft)
+{
+	struct schedtune *st = css_st(css);
+
+	return st->input_boost;
+}
+
+static int
+input_boost_write(struct cgroup_subsys_state *css, struct cftype *cft,
+		  s64 input_boost)
+{
+	struct schedtune *st = css_st(css);
+
+	if (input_boost < 0 || input_boost > 100)
+		return -EINVAL;
+
+	mutex_lock(&boostgroup_mutex);
+	st->input_boost = input_boost;
+	schedtune_boostgroup_update(st, schedtune_effective_boost(st));
+	mutex_unlock(&boostgroup_mutex);
+
+	return 0;
+}
+
+/* Called from the input boost thread */
+static void schedtune_input_boost_apply(struct input_boost_consumer *c,
+					unsigned int level, bool max)
+{
+	struct schedtune *st;
+	int idx;
+
+	mutex_lock(&boostgroup_mutex);
+	WRITE_ONCE(schedtune_input_level,
+		   max ? INPUT_BOOST_LEVEL_SCALE : level);
+	idr_for_each_entry(&boostgroup_idr, st, idx) {
+		if (st->input_boost <= st->boost)
+			continue;
+
+		schedtune_boostgroup_update(st, schedtune_effective_boost(st));
+	}
+	mutex_unlock(&boostgroup_mutex);
+}
+
+/* Groups opt in by writing their schedtune.input_boost */
+static struct input_boost_consumer schedtune_input_boost = {
+	.name = "schedtune",
+	.apply = schedtune_input_boost_apply,
+	.curve = {
+		.level = INPUT_BOOST_LEVEL_SCALE,
+		.hold_ms = 100,
+		.decay_ms = 200,
+		.decay_steps = 4
+	}
+};
+#endif /* CONFIG_INPUT_BOOST_CORE */
+
+static DEFINE_MUTEX(uclamp_mutex);
+
+static u64
+util_clamp_read(struct cgroup_subsys_state *css, struct cftype *cft)
+{
+	struct schedtune *st = css_st(css);
+
+	return st->uclamp[cft->private];
+}
+
+static int
+util_clamp_write(struct cgroup_subsys_state *css, struct cftype *cft,
+		 u64 value)
+{
+	struct schedtune *st = css_st(css);
+	int clamp_id = cft->private;
+	struct css_task_iter it;
+	struct task_struct *task;
+	struct rq_flags irq_flags;
+	struct boost_groups *bg;
+	struct rq *rq;
+	int ret = 0;
+
+	if (value > SCHED_CAPACITY_SCALE)
+		return -EINVAL;
+
+	mutex_lock(&uclamp_mutex);
+
+	if ((clamp_id == UCLAMP_MIN && value > st->uclamp[UCLAMP_MAX]) ||
+	    (clamp_id == UCLAMP_MAX && value < st->uclamp[UCLAMP_MIN])) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	st->uclamp[clamp_id] = value;
+
+	if (!unlikely(schedtune_initialized))
+		goto out;
+
+	/* Apply the new range to the RUNNABLE tasks right away */
+	css_task_iter_start(css, &it);
+	while ((task = css_task_iter_next(&it))) {
+		rq = lock_rq_of(task, &irq_flags);
+		bg = &per_cpu(cpu_boost_groups, cpu_of(rq));
+
+		raw_spin_lock(&bg->lock);
+		schedtune_uclamp_update(bg, task, st);
+		raw_spin_unlock(&bg->lock);
+
+		unlock_rq_of(rq, task, &irq_flags);
+	}
+	css_task_iter_end(&it);
+
+out:
+	mutex_unlock(&uclamp_mutex);
+
+	return ret;
+}
+
 static struct cftype files[] = {
 #ifdef CONFIG_SCHED_WALT
 	{
@@ -899,37 +1222,62 @@ static struct cftype files[] = {
 		.read_s64 = boost_read,
 		.write_s64 = boost_write,
 	},
+#ifdef CONFIG_INPUT_BOOST_CORE
+	{
+		.name = "input_boost",
+		.read_s64 = input_boost_read,
+		.write_s64 = input_boost_write,
+	},
+#endif
 	{
 		.name = "prefer_idle",
 		.read_u64 = prefer_idle_read,
 		.write_u64 = prefer_idle_write,
 	},
+	{
+		.name = "util_min",
+		.read_u64 = util_clamp_read,
+		.write_u64 = util_clamp_write,
+		.private = UCLAMP_MIN,
+	},
+	{
+		.name = "util_max",
+		.read_u64 = util_clamp_read,
+		.write_u64 = util_clamp_write,
+		.private = UCLAMP_MAX,
+	},
 	{ }	/* terminate */
 };
 
-static void
-schedtune_boostgroup_init(struct schedtune *st, int idx)
+static int
+schedtune_boostgroup_init(struct schedtune *st)
 {
-	struct boost_groups *bg;
-	int cpu;
+	int idx;
 
 	/* Initialize per CPUs boost group support */
-	for_each_possible_cpu(cpu) {
-		bg = &per_cpu(cpu_boost_groups, cpu);
-		bg->group[idx].boost = 0;
-		bg->group[idx].valid = true;
-	}
+	st->cpu_group = alloc_percpu(struct boost_group);
+	if (!st->cpu_group)
+		return -ENOMEM;
 
 	/* Keep track of allocated boost groups */
-	allocated_group[idx] = st;
+	mutex_lock(&boostgroup_mutex);
+	idx = idr_alloc(&boostgroup_idr, st, 1, 0, GFP_KERNEL);
+	mutex_unlock(&boostgroup_mutex);
+	if (idx < 0) {
+		free_percpu(st->cpu_group);
+		return idx;
+	}
+
 	st->idx = idx;
+
+	return 0;
 }
 
 static struct cgroup_subsys_state *
 schedtune_css_alloc(struct cgroup_subsys_state *parent_css)
 {
 	struct schedtune *st;
-	int idx;
+	int ret;
 
 	if (!parent_css)
 		return &root_schedtune.css;
@@ -940,45 +1288,50 @@ schedtune_css_alloc(struct cgroup_subsys_state *parent_css)
 		return ERR_PTR(-ENOMEM);
 	}
 
-	/* Allow only a limited number of boosting groups */
-	for (idx = 1; idx < BOOSTGROUPS_COUNT; ++idx)
-		if (!allocated_group[idx])
-			break;
-	if (idx == BOOSTGROUPS_COUNT) {
-		pr_err("Trying to create more than %d SchedTune boosting groups\n",
-		       BOOSTGROUPS_COUNT);
-		return ERR_PTR(-ENOSPC);
-	}
-
 	st = kzalloc(sizeof(*st), GFP_KERNEL);
 	if (!st)
-		goto out;
+		return ERR_PTR(-ENOMEM);
+
+	st->uclamp[UCLAMP_MAX] = SCHED_CAPACITY_SCALE;
 
 	/* Initialize per CPUs boost group support */
 	init_sched_boost(st);
-	schedtune_boostgroup_init(st, idx);
+	ret = schedtune_boostgroup_init(st);
+	if (ret) {
+		kfree(st);
+		return ERR_PTR(ret);
+	}
 
 	return &st->css;
-
-out:
-	return ERR_PTR(-ENOMEM);
 }
 
 static void
 schedtune_boostgroup_release(struct schedtune *st)
 {
 	struct boost_groups *bg;
+	struct boost_group *group;
+	unsigned long irq_flags;
 	int cpu;
 
-	/* Reset per CPUs boost group support */
+	/* Drop the boost of any task still accounted to the group */
 	for_each_possible_cpu(cpu) {
 		bg = &per_cpu(cpu_boost_groups, cpu);
-		bg->group[st->idx].valid = false;
-		bg->group[st->idx].boost = 0;
+		group = per_cpu_ptr(st->cpu_group, cpu);
+
+		raw_spin_lock_irqsave(&bg->lock, irq_flags);
+		if (group->tasks) {
+			schedtune_boost_deactivate(bg, group->boost);
+			schedtune_cpu_update(bg);
+		}
+		raw_spin_unlock_irqrestore(&bg->lock, irq_flags);
 	}
 
 	/* Keep track of allocated boost groups */
-	allocated_group[st->idx] = NULL;
+	mutex_lock(&boostgroup_mutex);
+	idr_remove(&boostgroup_idr, st->idx);
+	mutex_unlock(&boostgroup_mutex);
+
+	free_percpu(st->cpu_group);
 }
 
 static void
@@ -1012,14 +1365,26 @@ schedtune_init_cgroups(void)
 	for_each_possible_cpu(cpu) {
 		bg = &per_cpu(cpu_boost_groups, cpu);
 		memset(bg, 0, sizeof(struct boost_groups));
-		bg->group[0].valid = true;
+		bg->uclamp[UCLAMP_MAX].value = SCHED_CAPACITY_SCALE;
 		raw_spin_lock_init(&bg->lock);
+
+		/* The root boost group is always active */
+		schedtune_boost_activate(bg,
+			per_cpu(root_boost_group, cpu).boost);
+		schedtune_cpu_update(bg);
 	}
 
-	pr_info("schedtune: configured to support %d boost groups\n",
-		BOOSTGROUPS_COUNT);
+	mutex_lock(&boostgroup_mutex);
+	idr_alloc(&boostgroup_idr, &root_schedtune, 0, 1, GFP_KERNEL);
+	mutex_unlock(&boostgroup_mutex);
+
+	pr_info("schedtune: configured to support dynamic boost groups\n");
 
 	schedtune_initialized = true;
+
+#ifdef CONFIG_INPUT_BOOST_CORE
+	input_boost_register(&schedtune_input_boost);
+#endif
 }
 
 #else /* CONFIG_CGROUP_SCHEDTUNE */
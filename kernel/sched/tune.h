@@ -24,6 +24,10 @@ void schedtune_exit_task(struct task_struct *tsk);
 void schedtune_enqueue_task(struct task_struct *p, int cpu);
 void schedtune_dequeue_task(struct task_struct *p, int cpu);
 
+unsigned long schedtune_uclamp_cpu_util(int cpu, unsigned long util);
+unsigned long schedtune_uclamp_task_util(struct task_struct *p,
+					 unsigned long util);
+
 #else /* CONFIG_CGROUP_SCHEDTUNE */
 
 #define schedtune_cpu_boost(cpu)  get_sysctl_sched_cfs_boost()
@@ -35,6 +39,9 @@ void schedtune_dequeue_task(struct task_struct *p, int cpu);
 #define schedtune_enqueue_task(task, cpu) do { } while (0)
 #define schedtune_dequeue_task(task, cpu) do { } while (0)
 
+#define schedtune_uclamp_cpu_util(cpu, util) (util)
+#define schedtune_uclamp_task_util(tsk, util) (util)
+
 #endif /* CONFIG_CGROUP_SCHEDTUNE */
 
 int schedtune_normalize_energy(int energy);
@@ -52,6 +59,9 @@ int schedtune_accept_deltas(int nrg_delta, int cap_delta,
 #define schedtune_enqueue_task(task, cpu) do { } while (0)
 #define schedtune_dequeue_task(task, cpu) do { } while (0)
 
+#define schedtune_uclamp_cpu_util(cpu, util) (util)
+#define schedtune_uclamp_task_util(tsk, util) (util)
+
 #define schedtune_accept_deltas(nrg_delta, cap_delta, task) nrg_delta
 
 #endif /* CONFIG_SCHED_TUNE */
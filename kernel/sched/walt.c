@@ -23,6 +23,8 @@
 #include <linux/cpufreq.h>
 #include <linux/list_sort.h>
 #include <linux/jiffies.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 #include <linux/sched/core_ctl.h>
 #include <trace/events/sched.h>
 #include "sched.h"
@@ -536,7 +538,38 @@ static u32  top_task_load(struct rq *rq)
 	}
 }
 
-u64 freq_policy_load(struct rq *rq)
+/*
+ * The previous window sums of a CPU are published at its own window
+ * rollover, and whenever they are changed afterwards, so that frequency
+ * aggregation can read any CPU without taking its rq lock.
+ */
+static void walt_publish_prev_window(struct rq *rq)
+{
+	struct walt_prev_window *pw = &rq->walt_prev;
+
+	lockdep_assert_held(&rq->lock);
+
+	write_seqcount_begin(&rq->walt_seq);
+	pw->window_start = rq->window_start;
+	pw->runnable_sum = rq->prev_runnable_sum;
+	pw->nt_runnable_sum = rq->nt_prev_runnable_sum;
+	pw->grp_runnable_sum = rq->grp_time.prev_runnable_sum;
+	pw->grp_nt_runnable_sum = rq->grp_time.nt_prev_runnable_sum;
+	pw->top_task_load = top_task_load(rq);
+	write_seqcount_end(&rq->walt_seq);
+}
+
+static void walt_read_prev_window(struct rq *rq, struct walt_prev_window *pw)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqcount_begin(&rq->walt_seq);
+		*pw = rq->walt_prev;
+	} while (read_seqcount_retry(&rq->walt_seq, seq));
+}
+
+u64 freq_policy_load(struct rq *rq, struct walt_prev_window *pw)
 {
 	unsigned int reporting_policy = sysctl_sched_freq_reporting_policy;
 	int freq_aggr_thresh = sched_freq_aggregate_threshold;
@@ -545,20 +578,25 @@ u64 freq_policy_load(struct rq *rq)
 	u64 load, tt_load = 0;
 	u64 coloc_boost_load = cluster->coloc_boost_load;
 
+	walt_read_prev_window(rq, pw);
+
 	if (rq->ed_task != NULL) {
 		load = sched_ravg_window;
 		goto done;
 	}
 
 	if (aggr_grp_load > freq_aggr_thresh)
-		load = rq->prev_runnable_sum + aggr_grp_load;
+		load = pw->runnable_sum + aggr_grp_load;
 	else
-		load = rq->prev_runnable_sum + rq->grp_time.prev_runnable_sum;
+		load = pw->runnable_sum + pw->grp_runnable_sum;
 
 	if (coloc_boost_load)
 		load = max_t(u64, load, coloc_boost_load);
 
-	tt_load = top_task_load(rq);
+	if (cluster->frame_boost_load)
+		load = max_t(u64, load, cluster->frame_boost_load);
+
+	tt_load = pw->top_task_load;
 	switch (reporting_policy) {
 	case FREQ_REPORT_MAX_CPU_LOAD_TOP_TASK:
 		load = max_t(u64, load, tt_load);
@@ -613,6 +651,31 @@ static inline void account_load_subtractions(struct rq *rq)
 	BUG_ON((s64)rq->nt_curr_runnable_sum < 0);
 }
 
+/*
+ * Subtractions are queued on remote CPUs under cluster->load_lock by
+ * update_cluster_load_subtractions(), without their rq lock.
+ */
+static void walt_account_load_subtractions(struct rq *rq)
+{
+	struct sched_cluster *cluster = rq->cluster;
+
+	raw_spin_lock(&cluster->load_lock);
+	account_load_subtractions(rq);
+	raw_spin_unlock(&cluster->load_lock);
+}
+
+static bool walt_load_subs_pending(struct rq *rq)
+{
+	int i;
+
+	for (i = 0; i < NUM_TRACKED_WINDOWS; i++) {
+		if (READ_ONCE(rq->load_subs[i].subs))
+			return true;
+	}
+
+	return false;
+}
+
 static inline void create_subtraction_entry(struct rq *rq, u64 ws, int index)
 {
 	rq->load_subs[index].window_start = ws;
@@ -905,17 +968,20 @@ void fixup_busy_time(struct task_struct *p, int new_cpu)
 
 	migrate_top_tasks(p, src_rq, dest_rq);
 
-	if (!same_freq_domain(new_cpu, task_cpu(p))) {
-		src_rq->notif_pending = true;
-		dest_rq->notif_pending = true;
-		sched_irq_work_queue(&walt_migration_irq_work);
-	}
-
 	if (p == src_rq->ed_task) {
 		src_rq->ed_task = NULL;
 		dest_rq->ed_task = p;
 	}
 
+	walt_publish_prev_window(src_rq);
+	walt_publish_prev_window(dest_rq);
+
+	if (!same_freq_domain(new_cpu, task_cpu(p))) {
+		WRITE_ONCE(src_rq->notif_pending, true);
+		WRITE_ONCE(dest_rq->notif_pending, true);
+		sched_irq_work_queue(&walt_migration_irq_work);
+	}
+
 done:
 	if (p->state == TASK_WAKING)
 		double_rq_unlock(src_rq, dest_rq);
@@ -947,6 +1013,7 @@ void set_window_start(struct rq *rq)
 	}
 
 	rq->curr->ravg.mark_start = rq->window_start;
+	walt_publish_prev_window(rq);
 }
 
 unsigned int max_possible_efficiency = 1;
@@ -1974,11 +2041,115 @@ static inline void run_walt_irq_work(u64 old_window_start, struct rq *rq)
 		sched_irq_work_queue(&walt_cpufreq_irq_work);
 }
 
+unsigned int __read_mostly sysctl_sched_frame_boost_margin_pct = 80;
+unsigned int __read_mostly sysctl_sched_frame_boost_floor_pct = 50;
+
+#define FRAME_BOOST_HYST_PCT	15
+
+/*
+ * A related thread group with a frame deadline works on one frame per
+ * period. The busy time of a frame is the runtime of all the tasks of the
+ * group within the period, the frame being handed from one thread to the
+ * next like a UI thread and its render thread do. A frame busy for longer
+ * than the period missed its deadline.
+ *
+ * The group is boosted as soon as the current or the previous frame is
+ * busy for more than sched_frame_boost_margin_pct of the period, i.e. when
+ * the current frame is projected to miss, and released once both are
+ * FRAME_BOOST_HYST_PCT below that. Returns true if the boost changed.
+ */
+static bool walt_frame_update_boost(struct related_thread_group *grp)
+{
+	u64 busy = max(grp->frame_busy, grp->frame_prev_busy) * 100;
+	unsigned int margin = sysctl_sched_frame_boost_margin_pct;
+	bool boost = grp->frame_boost;
+
+	if (busy >= grp->frame_period * margin)
+		boost = true;
+	else if (margin <= FRAME_BOOST_HYST_PCT ||
+		 busy < grp->frame_period * (margin - FRAME_BOOST_HYST_PCT))
+		boost = false;
+
+	if (boost && !grp->frame_boosted) {
+		grp->frame_boosted = true;
+		grp->nr_boosted++;
+	}
+
+	if (boost == grp->frame_boost)
+		return false;
+
+	WRITE_ONCE(grp->frame_boost, boost);
+	return true;
+}
+
+static void walt_frame_close(struct related_thread_group *grp)
+{
+	if (grp->frame_busy) {
+		grp->nr_frames++;
+		if (grp->frame_busy > grp->frame_period)
+			grp->nr_missed++;
+	}
+
+	grp->frame_prev_busy = grp->frame_busy;
+	grp->frame_busy = 0;
+	grp->frame_boosted = false;
+	grp->frame_start += grp->frame_period;
+}
+
+/* Account [@start, @end) of runtime to the frames of @grp */
+static void walt_frame_account(struct related_thread_group *grp,
+			       u64 start, u64 end)
+{
+	u64 period, boundary;
+	bool changed;
+
+	if (!READ_ONCE(grp->frame_period))
+		return;
+
+	raw_spin_lock(&grp->frame_lock);
+
+	period = grp->frame_period;
+	if (!period) {
+		raw_spin_unlock(&grp->frame_lock);
+		return;
+	}
+
+	while (end >= grp->frame_start + period) {
+		boundary = grp->frame_start + period;
+		if (start < boundary) {
+			grp->frame_busy += boundary - max(start,
+							  grp->frame_start);
+			start = boundary;
+		}
+		walt_frame_close(grp);
+
+		/* Skip the idle periods up to @start, they hold no frame */
+		if (start >= grp->frame_start + period) {
+			grp->frame_start += period *
+				div64_u64(start - grp->frame_start, period);
+			grp->frame_prev_busy = 0;
+		}
+	}
+
+	start = max(start, grp->frame_start);
+	if (end > start)
+		grp->frame_busy += end - start;
+
+	changed = walt_frame_update_boost(grp);
+
+	raw_spin_unlock(&grp->frame_lock);
+
+	/* Let walt_irq_work() move the group and its frequency floor */
+	if (changed)
+		sched_irq_work_queue(&walt_migration_irq_work);
+}
+
 /* Reflect task activity on its demand and cpu's busy time statistics */
 void update_task_ravg(struct task_struct *p, struct rq *rq, int event,
 						u64 wallclock, u64 irqtime)
 {
 	u64 old_window_start;
+	bool new_window;
 
 	if (!rq->window_start || sched_disable_window_stats ||
 	    p->ravg.mark_start == wallclock)
@@ -1993,11 +2164,39 @@ void update_task_ravg(struct task_struct *p, struct rq *rq, int event,
 		goto done;
 	}
 
+	new_window = p->ravg.mark_start < rq->window_start;
+
+	/*
+	 * The rq sums only roll over with the current task. Bring it up to
+	 * date first when another task crosses the window boundary, so that
+	 * the busy time of @p lands in the right window and the snapshot
+	 * published below is not stamped with a window it does not cover.
+	 */
+	if (new_window && p != rq->curr && rq->curr->ravg.mark_start &&
+	    rq->curr->ravg.mark_start < rq->window_start)
+		update_task_ravg(rq->curr, rq, TASK_UPDATE, wallclock, 0);
+
 	update_task_rq_cpu_cycles(p, rq, event, wallclock, irqtime);
 	update_task_demand(p, rq, event, wallclock);
 	update_cpu_busy_time(p, rq, event, wallclock, irqtime);
+	if (p->grp && p == rq->curr && event != PICK_NEXT_TASK)
+		walt_frame_account(p->grp, p->ravg.mark_start, wallclock);
 	update_task_pred_demand(rq, p, event);
 
+	/*
+	 * The CPU window rolls over with its current task. Settle the
+	 * subtractions queued against it and publish the closed window
+	 * right away, so walt_irq_work() does not need this rq lock.
+	 */
+	if (new_window) {
+		if (p == rq->curr) {
+			walt_account_load_subtractions(rq);
+			WRITE_ONCE(rq->walt_rolled_ws, rq->window_start);
+		}
+		if (rq->walt_rolled_ws == rq->window_start)
+			walt_publish_prev_window(rq);
+	}
+
 	if (exiting_task(p))
 		goto done;
 
@@ -2653,7 +2852,8 @@ static void _set_preferred_cluster(struct related_thread_group *grp)
 {
 	struct task_struct *p;
 	u64 combined_demand = 0;
-	bool group_boost = false;
+	bool frame_boost = READ_ONCE(grp->frame_boost);
+	bool group_boost = frame_boost;
 	u64 wallclock;
 
 	if (list_empty(&grp->tasks))
@@ -2661,6 +2861,7 @@ static void _set_preferred_cluster(struct related_thread_group *grp)
 
 	if (!sysctl_sched_is_big_little) {
 		grp->preferred_cluster = sched_cluster[0];
+		grp->frame_boost_pref = frame_boost;
 		return;
 	}
 
@@ -2672,10 +2873,16 @@ static void _set_preferred_cluster(struct related_thread_group *grp)
 	 * at same time. Avoid overhead in such cases of rechecking preferred
 	 * cluster
 	 */
-	if (wallclock - grp->last_update < sched_ravg_window / 10)
+	if (wallclock - grp->last_update < sched_ravg_window / 10 &&
+	    frame_boost == grp->frame_boost_pref)
 		return;
 
+	grp->frame_boost_pref = frame_boost;
+
 	list_for_each_entry(p, &grp->tasks, grp_list) {
+		if (group_boost)
+			break;
+
 		if (task_boost_policy(p) == SCHED_BOOST_ON_BIG) {
 			group_boost = true;
 			break;
@@ -2710,6 +2917,9 @@ int update_preferred_cluster(struct related_thread_group *grp,
 	if (!grp)
 		return 0;
 
+	if (READ_ONCE(grp->frame_boost) != grp->frame_boost_pref)
+		return 1;
+
 	/*
 	 * Update if task's load has changed significantly or a complete window
 	 * has passed since we last updated preference
@@ -2771,6 +2981,7 @@ int alloc_related_thread_groups(void)
 		INIT_LIST_HEAD(&grp->tasks);
 		INIT_LIST_HEAD(&grp->list);
 		raw_spin_lock_init(&grp->lock);
+		raw_spin_lock_init(&grp->frame_lock);
 
 		related_thread_groups[i] = grp;
 	}
@@ -2814,6 +3025,14 @@ static void remove_task_from_group(struct task_struct *p)
 
 	raw_spin_unlock(&grp->lock);
 
+	/* The frame deadline goes away with the last task of the group */
+	if (empty_group) {
+		raw_spin_lock(&grp->frame_lock);
+		grp->frame_period = 0;
+		WRITE_ONCE(grp->frame_boost, false);
+		raw_spin_unlock(&grp->frame_lock);
+	}
+
 	/* Reserved groups cannot be destroyed */
 	if (empty_group && grp->id != DEFAULT_CGROUP_COLOC_ID)
 		 /*
@@ -2941,6 +3160,149 @@ unsigned int sched_get_group_id(struct task_struct *p)
 	return group_id;
 }
 
+#define FRAME_PERIOD_MIN_US	1000
+#define FRAME_PERIOD_MAX_US	USEC_PER_SEC
+
+/**
+ * sched_set_frame_deadline - declare the frame period of a task's group
+ * @p: a member of the related thread group
+ * @period_us: the frame period, or 0 to stop tracking frames
+ *
+ * Frame statistics of the group restart from the current time.
+ */
+int sched_set_frame_deadline(struct task_struct *p, unsigned int period_us)
+{
+	struct related_thread_group *grp;
+	unsigned long flags;
+	int rc = 0;
+
+	if (period_us && (period_us < FRAME_PERIOD_MIN_US ||
+			  period_us > FRAME_PERIOD_MAX_US))
+		return -EINVAL;
+
+	rcu_read_lock();
+	grp = task_related_thread_group(p);
+	if (!grp) {
+		rc = -EINVAL;
+		goto out;
+	}
+
+	raw_spin_lock_irqsave(&grp->frame_lock, flags);
+	grp->frame_period = (u64)period_us * NSEC_PER_USEC;
+	grp->frame_start = sched_ktime_clock();
+	grp->frame_busy = 0;
+	grp->frame_prev_busy = 0;
+	grp->frame_boosted = false;
+	grp->nr_frames = 0;
+	grp->nr_missed = 0;
+	grp->nr_boosted = 0;
+	WRITE_ONCE(grp->frame_boost, false);
+	raw_spin_unlock_irqrestore(&grp->frame_lock, flags);
+out:
+	rcu_read_unlock();
+
+	return rc;
+}
+
+unsigned int sched_get_frame_deadline(struct task_struct *p)
+{
+	struct related_thread_group *grp;
+	unsigned int period_us = 0;
+
+	rcu_read_lock();
+	grp = task_related_thread_group(p);
+	if (grp)
+		period_us = div64_u64(READ_ONCE(grp->frame_period),
+				      NSEC_PER_USEC);
+	rcu_read_unlock();
+
+	return period_us;
+}
+
+/*
+ * Move the groups whose frame boost changed to their new preferred
+ * cluster, and raise the load reported for the clusters hosting boosted
+ * groups to sched_frame_boost_floor_pct.
+ */
+static void walt_update_frame_boost(void)
+{
+	struct related_thread_group *grp;
+	struct sched_cluster *cluster;
+	u64 floor = pct_to_real(sysctl_sched_frame_boost_floor_pct);
+
+	read_lock(&related_thread_group_lock);
+
+	list_for_each_entry(grp, &active_related_thread_groups, list) {
+		if (READ_ONCE(grp->frame_boost) != grp->frame_boost_pref)
+			set_preferred_cluster(grp);
+	}
+
+	for_each_sched_cluster(cluster) {
+		u64 load = 0;
+
+		list_for_each_entry(grp, &active_related_thread_groups, list) {
+			if (READ_ONCE(grp->frame_boost) &&
+			    grp->preferred_cluster == cluster)
+				load = floor;
+		}
+		cluster->frame_boost_load = load;
+	}
+
+	read_unlock(&related_thread_group_lock);
+}
+
+static int sched_frame_stats_show(struct seq_file *m, void *v)
+{
+	struct related_thread_group *grp;
+	unsigned long flags;
+	int i;
+
+	for (i = 1; i < MAX_NUM_CGROUP_COLOC_ID; i++) {
+		u64 period, frames, missed, boosted;
+		bool boost;
+
+		grp = lookup_related_thread_group(i);
+		if (!grp)
+			continue;
+
+		raw_spin_lock_irqsave(&grp->frame_lock, flags);
+		period = grp->frame_period;
+		frames = grp->nr_frames;
+		missed = grp->nr_missed;
+		boosted = grp->nr_boosted;
+		boost = grp->frame_boost;
+		raw_spin_unlock_irqrestore(&grp->frame_lock, flags);
+
+		if (!period && !frames)
+			continue;
+
+		seq_printf(m, "group=%d period_us=%llu frames=%llu missed=%llu boosted=%llu boost=%d\n",
+			   grp->id, div64_u64(period, NSEC_PER_USEC),
+			   frames, missed, boosted, boost);
+	}
+
+	return 0;
+}
+
+static int sched_frame_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sched_frame_stats_show, NULL);
+}
+
+static const struct file_operations sched_frame_stats_fops = {
+	.open		= sched_frame_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init sched_frame_stats_init(void)
+{
+	proc_create("sched_frame_stats", 0444, NULL, &sched_frame_stats_fops);
+	return 0;
+}
+late_initcall(sched_frame_stats_init);
+
 #if defined(CONFIG_SCHED_TUNE) && defined(CONFIG_CGROUP_SCHEDTUNE)
 /*
  * We create a default colocation group at boot. There is no need to
@@ -3175,6 +3537,8 @@ static void transfer_busy_time(struct rq *rq, struct related_thread_group *grp,
 	BUG_ON((s64)*src_prev_runnable_sum < 0);
 	BUG_ON((s64)*src_nt_curr_runnable_sum < 0);
 	BUG_ON((s64)*src_nt_prev_runnable_sum < 0);
+
+	walt_publish_prev_window(rq);
 }
 
 unsigned int sysctl_sched_little_cluster_coloc_fmin_khz;
@@ -3241,54 +3605,107 @@ int sched_little_cluster_coloc_fmin_khz_handler(struct ctl_table *table,
 	return ret;
 }
 
+unsigned int __read_mostly sysctl_sched_walt_rollover_sweep;
+
+/*
+ * Bring the window of @cpu up to date for walt_irq_work(). CPUs which
+ * rolled over on their own, and have no subtractions queued since, are
+ * skipped without touching their rq lock.
+ */
+static u64 walt_rollover_cpu(int cpu, u64 ws, bool locked)
+{
+	struct rq *rq = cpu_rq(cpu);
+	unsigned long flags;
+	u64 start;
+
+	if (!locked && READ_ONCE(rq->walt_rolled_ws) >= ws &&
+	    !walt_load_subs_pending(rq))
+		return 0;
+
+	start = sched_clock();
+	if (!locked)
+		raw_spin_lock_irqsave(&rq->lock, flags);
+
+	if (rq->curr)
+		update_task_ravg(rq->curr, rq, TASK_UPDATE,
+				 sched_ktime_clock(), 0);
+	walt_account_load_subtractions(rq);
+	walt_publish_prev_window(rq);
+
+	if (!locked)
+		raw_spin_unlock_irqrestore(&rq->lock, flags);
+
+	return sched_clock() - start;
+}
+
 /*
  * Runs in hard-irq context. This should ideally run just after the latest
  * window roll-over.
+ *
+ * Each CPU rolls its own window over from update_task_ravg() and publishes
+ * the closed window under rq->walt_seq, so only the CPUs which have not
+ * rolled yet (idle ones, typically) are locked here, one at a time.
+ * Setting sched_walt_rollover_sweep brings back the former behaviour of
+ * holding every rq lock for the whole aggregation, to compare the two
+ * with the irqsoff tracer or the sched_walt_rollover tracepoint.
  */
 void walt_irq_work(struct irq_work *irq_work)
 {
 	struct sched_cluster *cluster;
+	struct walt_prev_window pw;
 	struct rq *rq;
 	int cpu;
-	u64 wc, total_grp_load = 0;
+	u64 ws, total_grp_load = 0;
+	u64 start, lock_ns, max_lock_ns = 0;
 	int flag = SCHED_CPUFREQ_WALT;
 	bool is_migration = false;
+	bool sweep = READ_ONCE(sysctl_sched_walt_rollover_sweep);
+	int nr_locked = 0;
 	int level = 0;
 
 	/* Am I the window rollover work or the migration work? */
 	if (irq_work == &walt_migration_irq_work)
 		is_migration = true;
 
-	for_each_cpu(cpu, cpu_possible_mask) {
-		if (level == 0)
-			raw_spin_lock(&cpu_rq(cpu)->lock);
-		else
-			raw_spin_lock_nested(&cpu_rq(cpu)->lock, level);
-		level++;
+	/* Takes group locks, which nest outside of rq locks */
+	walt_update_frame_boost();
+
+	start = sched_clock();
+
+	if (sweep) {
+		for_each_cpu(cpu, cpu_possible_mask) {
+			if (level == 0)
+				raw_spin_lock(&cpu_rq(cpu)->lock);
+			else
+				raw_spin_lock_nested(&cpu_rq(cpu)->lock,
+						     level);
+			level++;
+		}
 	}
 
-	wc = sched_ktime_clock();
 	walt_load_reported_window = atomic64_read(&walt_irq_work_lastq_ws);
+	ws = walt_load_reported_window;
+
+	for_each_possible_cpu(cpu) {
+		lock_ns = walt_rollover_cpu(cpu, ws, sweep);
+		if (lock_ns) {
+			nr_locked++;
+			max_lock_ns = max(max_lock_ns, lock_ns);
+		}
+	}
 
 	for_each_sched_cluster(cluster) {
 		u64 aggr_grp_load = 0;
 
-		raw_spin_lock(&cluster->load_lock);
-
 		for_each_cpu(cpu, &cluster->cpus) {
-			rq = cpu_rq(cpu);
-			if (rq->curr) {
-				update_task_ravg(rq->curr, rq,
-						TASK_UPDATE, wc, 0);
-				account_load_subtractions(rq);
-				aggr_grp_load += rq->grp_time.prev_runnable_sum;
-			}
+			walt_read_prev_window(cpu_rq(cpu), &pw);
+			aggr_grp_load += pw.grp_runnable_sum;
 		}
 
+		raw_spin_lock(&cluster->load_lock);
 		cluster->aggr_grp_load = aggr_grp_load;
 		total_grp_load = aggr_grp_load;
 		cluster->coloc_boost_load = 0;
-
 		raw_spin_unlock(&cluster->load_lock);
 	}
 
@@ -3302,9 +3719,9 @@ void walt_irq_work(struct irq_work *irq_work)
 			rq = cpu_rq(cpu);
 
 			if (is_migration) {
-				if (rq->notif_pending) {
+				if (READ_ONCE(rq->notif_pending)) {
 					nflag |= SCHED_CPUFREQ_INTERCLUSTER_MIG;
-					rq->notif_pending = false;
+					WRITE_ONCE(rq->notif_pending, false);
 				} else {
 					nflag |= SCHED_CPUFREQ_FORCE_UPDATE;
 				}
@@ -3314,8 +3731,14 @@ void walt_irq_work(struct irq_work *irq_work)
 		}
 	}
 
-	for_each_cpu(cpu, cpu_possible_mask)
-		raw_spin_unlock(&cpu_rq(cpu)->lock);
+	if (sweep) {
+		for_each_cpu(cpu, cpu_possible_mask)
+			raw_spin_unlock(&cpu_rq(cpu)->lock);
+		max_lock_ns = sched_clock() - start;
+	}
+
+	trace_sched_walt_rollover(ws, is_migration, sweep, nr_locked,
+				  max_lock_ns, sched_clock() - start);
 
 	if (!is_migration)
 		core_ctl_check(this_rq()->window_start);
@@ -3426,4 +3849,7 @@ void walt_sched_init_rq(struct rq *rq)
 	}
 	rq->cum_window_demand = 0;
 	rq->notif_pending = false;
+	rq->walt_rolled_ws = 0;
+	seqcount_init(&rq->walt_seq);
+	memset(&rq->walt_prev, 0, sizeof(struct walt_prev_window));
 }
@@ -387,6 +387,15 @@ static struct ctl_table kern_table[] = {
 		.extra1		= &zero,
 		.extra2		= &one,
 	},
+	{
+		.procname	= "sched_walt_rollover_sweep",
+		.data		= &sysctl_sched_walt_rollover_sweep,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &one,
+	},
 	{
 		.procname	= "sched_initial_task_util",
 		.data		= &sysctl_sched_init_task_load_pct,
@@ -412,6 +421,24 @@ static struct ctl_table kern_table[] = {
 		.extra1		= &zero,
 		.extra2		= &two_million,
 	},
+	{
+		.procname	= "sched_frame_boost_margin_pct",
+		.data		= &sysctl_sched_frame_boost_margin_pct,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &one,
+		.extra2		= &one_hundred,
+	},
+	{
+		.procname	= "sched_frame_boost_floor_pct",
+		.data		= &sysctl_sched_frame_boost_floor_pct,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &one_hundred,
+	},
 #endif
 	{
 		.procname	= "sched_upmigrate",
@@ -1895,6 +1922,13 @@ static struct ctl_table vm_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec_minmax,
 	},
+	{
+		.procname	= "swap_ratio_adaptive",
+		.data		= &sysctl_swap_ratio_adaptive,
+		.maxlen		= sizeof(sysctl_swap_ratio_adaptive),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+	},
 #endif
 	{ }
 };
@@ -0,0 +1,244 @@
+/*
+ * zsmalloc concurrency stress and throughput test
+ *
+ * Runs one thread per online cpu against a shared pool. Each thread keeps
+ * a ring of live objects and replaces the oldest one with a fresh
+ * allocation at every step, the way zram churns through objects while
+ * swapping. The number of zs_malloc()/zs_free() pairs per second is
+ * reported when the run ends.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/completion.h>
+#include <linux/cpu.h>
+#include <linux/init.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/zsmalloc.h>
+
+static unsigned int duration_ms = 2000;
+module_param(duration_ms, uint, 0);
+MODULE_PARM_DESC(duration_ms, "Length of the run in ms (default: 2000)");
+
+static unsigned int nr_objs = 256;
+module_param(nr_objs, uint, 0);
+MODULE_PARM_DESC(nr_objs, "Live objects per thread (default: 256)");
+
+static unsigned int max_size = 3072;
+module_param(max_size, uint, 0);
+MODULE_PARM_DESC(max_size, "Largest object size in bytes (default: 3072)");
+
+static bool verify = true;
+module_param(verify, bool, 0);
+MODULE_PARM_DESC(verify, "Tag each object and check the tag before freeing it (default: on)");
+
+#define MIN_OBJ_SIZE	32
+
+/* Tags are the thread id in the top bits and a per-thread sequence number */
+#define TAG_ID_SHIFT	48
+
+struct test_obj {
+	unsigned long handle;
+	size_t size;
+	u64 tag;
+};
+
+struct thread_data {
+	struct task_struct *task;
+	struct test_obj *objs;
+	u64 id;
+	u64 seq;
+	u64 ops;
+	unsigned long errors;
+};
+
+static struct zs_pool *pool;
+static DECLARE_COMPLETION(start);
+static DECLARE_COMPLETION(done);
+static atomic_t running;
+
+/*
+ * The tag goes at both ends of the object, and the expected value stays
+ * with the handle. An object handed out twice, or overlapping another
+ * one, ends up with the tag of its last writer, which the other owner
+ * notices when it frees the object.
+ */
+static void test_alloc(struct thread_data *td, struct test_obj *to)
+{
+	void *obj;
+
+	to->size = MIN_OBJ_SIZE + prandom_u32_max(max_size - MIN_OBJ_SIZE + 1);
+	to->handle = zs_malloc(pool, to->size, GFP_KERNEL);
+	if (!to->handle) {
+		td->errors++;
+		return;
+	}
+
+	if (verify) {
+		to->tag = (td->id << TAG_ID_SHIFT) | ++td->seq;
+		obj = zs_map_object(pool, to->handle, ZS_MM_WO);
+		memcpy(obj, &to->tag, sizeof(to->tag));
+		memcpy(obj + to->size - sizeof(to->tag), &to->tag,
+		       sizeof(to->tag));
+		zs_unmap_object(pool, to->handle);
+	}
+}
+
+static void test_free(struct thread_data *td, struct test_obj *to)
+{
+	u64 head, tail;
+	void *obj;
+
+	if (!to->handle)
+		return;
+
+	if (verify) {
+		obj = zs_map_object(pool, to->handle, ZS_MM_RO);
+		memcpy(&head, obj, sizeof(head));
+		memcpy(&tail, obj + to->size - sizeof(tail), sizeof(tail));
+		zs_unmap_object(pool, to->handle);
+		if (head != to->tag || tail != to->tag)
+			td->errors++;
+	}
+
+	zs_free(pool, to->handle);
+	to->handle = 0;
+}
+
+static int test_thread(void *data)
+{
+	struct thread_data *td = data;
+	unsigned long deadline;
+	unsigned int i;
+
+	for (i = 0; i < nr_objs; i++)
+		test_alloc(td, &td->objs[i]);
+
+	wait_for_completion(&start);
+	deadline = jiffies + msecs_to_jiffies(duration_ms);
+
+	i = 0;
+	while (time_before(jiffies, deadline)) {
+		test_free(td, &td->objs[i]);
+		test_alloc(td, &td->objs[i]);
+		td->ops++;
+
+		if (++i == nr_objs) {
+			i = 0;
+			cond_resched();
+		}
+	}
+
+	for (i = 0; i < nr_objs; i++)
+		test_free(td, &td->objs[i]);
+
+	if (atomic_dec_and_test(&running))
+		complete(&done);
+
+	return 0;
+}
+
+static int __init test_zsmalloc_init(void)
+{
+	struct thread_data *tdata;
+	unsigned long errors = 0;
+	u64 total = 0, elapsed;
+	ktime_t begin;
+	int cpu, nr = 0;
+
+	if (!nr_objs || !duration_ms ||
+	    max_size < MIN_OBJ_SIZE || max_size > PAGE_SIZE) {
+		pr_err("invalid parameters\n");
+		return -EINVAL;
+	}
+
+	tdata = kcalloc(nr_cpu_ids, sizeof(*tdata), GFP_KERNEL);
+	if (!tdata)
+		return -ENOMEM;
+
+	pool = zs_create_pool("test_zsmalloc");
+	if (!pool) {
+		kfree(tdata);
+		return -ENOMEM;
+	}
+
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		struct thread_data *td = &tdata[cpu];
+
+		td->objs = kcalloc(nr_objs, sizeof(*td->objs), GFP_KERNEL);
+		if (!td->objs)
+			continue;
+		td->id = cpu + 1;
+
+		td->task = kthread_create(test_thread, td, "test_zsmalloc/%d",
+					  cpu);
+		if (IS_ERR(td->task)) {
+			td->task = NULL;
+			continue;
+		}
+		kthread_bind(td->task, cpu);
+		nr++;
+	}
+
+	atomic_set(&running, nr);
+	for_each_online_cpu(cpu) {
+		if (tdata[cpu].task)
+			wake_up_process(tdata[cpu].task);
+	}
+	put_online_cpus();
+
+	if (!nr) {
+		pr_err("no test thread could be started\n");
+		goto out;
+	}
+
+	begin = ktime_get();
+	complete_all(&start);
+	wait_for_completion(&done);
+	elapsed = ktime_us_delta(ktime_get(), begin);
+
+	for_each_possible_cpu(cpu) {
+		struct thread_data *td = &tdata[cpu];
+
+		if (!td->task)
+			continue;
+		pr_info("cpu%d: %llu ops\n", cpu, td->ops);
+		total += td->ops;
+		errors += td->errors;
+	}
+
+	pr_info("%d threads, %u objects each, %llu ops in %llu us, %llu ops/sec\n",
+		nr, nr_objs, total, elapsed,
+		div64_u64(total * USEC_PER_SEC, max_t(u64, elapsed, 1)));
+	if (errors)
+		pr_err("%lu failed allocations or corrupted objects\n", errors);
+
+out:
+	for_each_possible_cpu(cpu)
+		kfree(tdata[cpu].objs);
+	kfree(tdata);
+	zs_destroy_pool(pool);
+
+	return errors ? -EINVAL : 0;
+}
+
+static void __exit test_zsmalloc_exit(void)
+{
+}
+
+module_init(test_zsmalloc_init);
+module_exit(test_zsmalloc_exit);
+
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,174 @@
+/*
+ * mm/adj_lru.c
+ *
+ * Killable processes kept in per-oom_score_adj LRU lists, so that low
+ * memory killers can pick a victim without a for_each_process() walk.
+ *
+ * The lists are updated when a process is forked, when its oom_score_adj
+ * is written and when its last thread exits. Entries are signal_structs,
+ * which stay put across de_thread() unlike the group leader.
+ */
+
+#include <linux/adj_lru.h>
+#include <linux/bitmap.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/oom.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+
+#define ADJ_LRU_BUCKETS	(OOM_SCORE_ADJ_MAX + 1)
+
+static struct list_head adj_lru[ADJ_LRU_BUCKETS];
+static DECLARE_BITMAP(adj_lru_used, ADJ_LRU_BUCKETS);
+static DEFINE_SPINLOCK(adj_lru_lock);
+
+static void __adj_lru_del(struct signal_struct *sig)
+{
+	short bucket = sig->adj_lru_bucket;
+
+	if (list_empty(&sig->adj_lru_node))
+		return;
+
+	list_del_init(&sig->adj_lru_node);
+	if (list_empty(&adj_lru[bucket]))
+		clear_bit(bucket, adj_lru_used);
+}
+
+static void __adj_lru_add(struct task_struct *p)
+{
+	struct signal_struct *sig = p->signal;
+	short adj = sig->oom_score_adj;
+
+	if (adj < 0 || p->flags & PF_KTHREAD || is_global_init(p))
+		return;
+
+	/* The group is already on its way out, do_exit() won't see us */
+	if (!atomic_read(&sig->live))
+		return;
+
+	sig->adj_lru_bucket = adj;
+	list_add_tail(&sig->adj_lru_node, &adj_lru[adj]);
+	set_bit(adj, adj_lru_used);
+}
+
+/*
+ * Called for a new thread group leader once it is visible to the system.
+ * An oom_score_adj write may have filed the group already by then.
+ */
+void adj_lru_add(struct task_struct *p)
+{
+	spin_lock(&adj_lru_lock);
+	if (list_empty(&p->signal->adj_lru_node))
+		__adj_lru_add(p);
+	spin_unlock(&adj_lru_lock);
+}
+
+/*
+ * Called after p->signal->oom_score_adj has changed. The process moves
+ * to the tail of its new bucket, even when the value is unchanged, so
+ * each list is ordered by the time of the last adj write.
+ */
+void adj_lru_update(struct task_struct *p)
+{
+	spin_lock(&adj_lru_lock);
+	__adj_lru_del(p->signal);
+	__adj_lru_add(p);
+	spin_unlock(&adj_lru_lock);
+}
+
+/* Called from do_exit() by the last live thread of the group */
+void adj_lru_del(struct task_struct *p)
+{
+	spin_lock(&adj_lru_lock);
+	__adj_lru_del(p->signal);
+	spin_unlock(&adj_lru_lock);
+}
+
+/**
+ * adj_lru_select - pick a victim from the highest populated adj bucket
+ * @min_adj: lowest oom_score_adj that may be selected
+ * @heaviest: pick the largest RSS in the bucket instead of its LRU head
+ * @skip: optional filter called on each candidate's mm owning thread
+ * @adj: returns the oom_score_adj of the victim
+ * @rss: returns the RSS of the victim in pages
+ *
+ * Buckets are walked from OOM_SCORE_ADJ_MAX down to @min_adj and the
+ * first one holding an acceptable candidate wins. Without @heaviest the
+ * cost is independent of the number of processes on the system.
+ *
+ * Returns the chosen thread with a reference held, or NULL.
+ */
+struct task_struct *adj_lru_select(short min_adj, bool heaviest,
+				   adj_lru_skip_t skip, short *adj,
+				   unsigned long *rss)
+{
+	struct task_struct *selected = NULL;
+	unsigned long selected_rss = 0;
+	unsigned long bucket = ADJ_LRU_BUCKETS;
+
+	if (min_adj < 0)
+		min_adj = 0;
+
+	spin_lock(&adj_lru_lock);
+	rcu_read_lock();
+	while (!selected) {
+		unsigned long prev = bucket;
+		struct signal_struct *sig;
+
+		bucket = find_last_bit(adj_lru_used, prev);
+		if (bucket == prev || bucket < min_adj)
+			break;
+
+		list_for_each_entry(sig, &adj_lru[bucket], adj_lru_node) {
+			struct task_struct *t, *p;
+			unsigned long tasksize;
+
+			/* A listed group has at least one live thread */
+			t = list_first_or_null_rcu(&sig->thread_head,
+						   struct task_struct,
+						   thread_node);
+			if (!t)
+				continue;
+
+			p = find_lock_task_mm(t);
+			if (!p)
+				continue;
+
+			tasksize = get_mm_rss(p->mm);
+			task_unlock(p);
+
+			if (!tasksize || (skip && skip(p)))
+				continue;
+
+			if (tasksize <= selected_rss)
+				continue;
+
+			selected = p;
+			selected_rss = tasksize;
+			if (!heaviest)
+				break;
+		}
+	}
+
+	if (selected) {
+		get_task_struct(selected);
+		*adj = bucket;
+		*rss = selected_rss;
+	}
+	rcu_read_unlock();
+	spin_unlock(&adj_lru_lock);
+
+	return selected;
+}
+
+static int __init adj_lru_init(void)
+{
+	int i;
+
+	for (i = 0; i < ADJ_LRU_BUCKETS; i++)
+		INIT_LIST_HEAD(&adj_lru[i]);
+
+	return 0;
+}
+pure_initcall(adj_lru_init);
@@ -15,6 +15,7 @@
 #include <linux/gfp.h>
 #include <linux/pagemap.h>
 #include <linux/swap.h>
+#include <linux/swapfile.h>
 #include <linux/bio.h>
 #include <linux/swapops.h>
 #include <linux/buffer_head.h>
@@ -45,6 +46,12 @@ void end_swap_bio_write(struct bio *bio)
 {
 	struct page *page = bio->bi_io_vec[0].bv_page;
 
+	/* Submission time, stored by __swap_writepage() for swap ratio */
+	if (bio->bi_private)
+		swap_ratio_write_latency(page_swap_info(page),
+			(unsigned long)ktime_get_ns() -
+			(unsigned long)bio->bi_private);
+
 	if (bio->bi_error) {
 		SetPageError(page);
 		/*
@@ -258,6 +265,8 @@ int __swap_writepage(struct page *page, struct writeback_control *wbc,
 	struct bio *bio;
 	int ret;
 	struct swap_info_struct *sis = page_swap_info(page);
+	bool track_latency = swap_ratio_adaptive(sis);
+	unsigned long start = 0;
 
 	VM_BUG_ON_PAGE(!PageSwapCache(page), page);
 	if (sis->flags & SWP_FILE) {
@@ -301,9 +310,13 @@ int __swap_writepage(struct page *page, struct writeback_control *wbc,
 		return ret;
 	}
 
+	if (track_latency)
+		start = ktime_get_ns();
 	ret = bdev_write_page(sis->bdev, map_swap_page(page, &sis->bdev),
 			      page, wbc);
 	if (!ret) {
+		if (track_latency)
+			swap_ratio_write_latency(sis, ktime_get_ns() - start);
 		count_vm_event(PSWPOUT);
 		return 0;
 	}
@@ -320,6 +333,8 @@ int __swap_writepage(struct page *page, struct writeback_control *wbc,
 		bio_set_op_attrs(bio, REQ_OP_WRITE, REQ_SYNC);
 	else
 		bio_set_op_attrs(bio, REQ_OP_WRITE, 0);
+	if (track_latency)
+		bio->bi_private = (void *)(unsigned long)ktime_get_ns();
 	count_vm_event(PSWPOUT);
 	set_page_writeback(page);
 	unlock_page(page);
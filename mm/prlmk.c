@@ -22,6 +22,9 @@
 #include <linux/vmpressure.h>
 #include <linux/delay.h>
 #include <linux/cred.h>
+#include <linux/kthread.h>
+#include <linux/psi.h>
+#include <linux/adj_lru.h>
 
 #ifdef DEBUG
 #define kill_dbg(tsk)                                                        \
@@ -510,6 +513,134 @@ static void proc_tasks(struct work_struct *work)
 	sort_and_kill_tasks();
 }
 
+#ifdef CONFIG_PRLMK_PSI
+/*
+ * Memory stall thresholds, in ms per PSI_WINDOW_MS window. The triggers
+ * are created once at init, so these can only be set on the command line.
+ *
+ * A "some" stall queues the regular reclaim and kill pass, while a
+ * "full" stall kills the oldest task of the highest adj straight from
+ * the oom_score_adj LRU when memory is low.
+ */
+static unsigned int psi_some_ms = 70;
+module_param_named(psi_some_ms, psi_some_ms, uint, 0444);
+
+static unsigned int psi_full_ms = 100;
+module_param_named(psi_full_ms, psi_full_ms, uint, 0444);
+
+#define PSI_WINDOW_MS 1000
+
+static struct psi_trigger *psi_some, *psi_full;
+
+static bool psi_skip_task(struct task_struct *tsk)
+{
+	return test_task(tsk) || test_tsk_thread_flag(tsk, TIF_MEMDIE);
+}
+
+static void psi_kill_task(void)
+{
+	struct selected_task select;
+	unsigned long rss;
+	short adj;
+
+	if (is_low_mem() == LOWMEM_NONE)
+		goto slow_path;
+
+	select.p = adj_lru_select(min_adj, false, psi_skip_task, &adj, &rss);
+	if (!select.p)
+		goto slow_path;
+
+	select.adj = adj;
+	kill_task(select);
+	put_task_struct(select.p);
+	return;
+
+slow_path:
+	if (!work_pending(&proc_work))
+		queue_work(system_highpri_wq, &proc_work);
+}
+
+static int psi_thread(void *data)
+{
+	while (!kthread_should_stop()) {
+		DEFINE_WAIT(some_wait);
+		DEFINE_WAIT(full_wait);
+
+		prepare_to_wait(&psi_some->event_wait, &some_wait,
+				TASK_INTERRUPTIBLE);
+		prepare_to_wait(&psi_full->event_wait, &full_wait,
+				TASK_INTERRUPTIBLE);
+		if (!READ_ONCE(psi_some->event) &&
+		    !READ_ONCE(psi_full->event) && !kthread_should_stop())
+			schedule();
+		finish_wait(&psi_full->event_wait, &full_wait);
+		finish_wait(&psi_some->event_wait, &some_wait);
+
+		if (cmpxchg(&psi_full->event, 1, 0) == 1) {
+			psi_kill_task();
+			continue;
+		}
+
+		if (cmpxchg(&psi_some->event, 1, 0) == 1)
+			if (!work_pending(&proc_work))
+				queue_work(system_highpri_wq, &proc_work);
+	}
+
+	return 0;
+}
+
+static struct psi_trigger *psi_trigger_setup(const char *state,
+					     unsigned int thresh_ms)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%s %u %u", state,
+		 thresh_ms * 1000, PSI_WINDOW_MS * 1000);
+
+	return psi_trigger_create(&psi_system, buf, strlen(buf), PSI_MEM);
+}
+
+static int psi_mode_init(void)
+{
+	struct sched_param param = { .sched_priority = 1 };
+	struct psi_trigger *t;
+	struct task_struct *tsk;
+	int ret;
+
+	t = psi_trigger_setup("some", psi_some_ms);
+	if (IS_ERR(t))
+		return PTR_ERR(t);
+	psi_some = t;
+
+	t = psi_trigger_setup("full", psi_full_ms);
+	if (IS_ERR(t)) {
+		ret = PTR_ERR(t);
+		goto put_some;
+	}
+	psi_full = t;
+
+	tsk = kthread_run(psi_thread, NULL, "prlmk_psi");
+	if (IS_ERR(tsk)) {
+		ret = PTR_ERR(tsk);
+		goto put_full;
+	}
+	sched_setscheduler_nocheck(tsk, SCHED_FIFO, &param);
+
+	return 0;
+
+put_full:
+	psi_trigger_replace((void **)&psi_full, NULL);
+put_some:
+	psi_trigger_replace((void **)&psi_some, NULL);
+	return ret;
+}
+#else
+static inline int psi_mode_init(void)
+{
+	return -EOPNOTSUPP;
+}
+#endif
+
 static int vmpressure_notifier(struct notifier_block *nb,
 			unsigned long action, void *data)
 {
@@ -533,7 +664,7 @@ static int prlmk_init(const char *val, const struct kernel_param *kp)
 {
 	static atomic_t init_done = ATOMIC_INIT(0);
 
-	if (!atomic_cmpxchg(&init_done, 0, 1))
+	if (!atomic_cmpxchg(&init_done, 0, 1) && psi_mode_init())
 		BUG_ON(vmpressure_notifier_register(&vmpr_nb));
 
 	return 0;
@@ -20,11 +20,17 @@
 #include <linux/rcupdate.h>
 #include <linux/notifier.h>
 #include <linux/vmpressure.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/process_reclaim.h>
 
 #define MAX_SWAP_TASKS SWAP_CLUSTER_MAX
+#define MAX_RECLAIM_WORKERS 8
 
 static void swap_fn(struct work_struct *work);
 DECLARE_WORK(swap_work, swap_fn);
@@ -49,6 +55,13 @@ module_param_named(pressure_max, pressure_max, ulong, 0644);
 static short min_score_adj = 360;
 module_param_named(min_score_adj, min_score_adj, short, 0644);
 
+/*
+ * Number of work items a run is spread across, each reclaiming from the
+ * next largest selected task. 1 keeps reclaim sequential.
+ */
+static int reclaim_workers = 1;
+module_param_named(reclaim_workers, reclaim_workers, int, 0644);
+
 /*
  * Scheduling process reclaim workqueue unecessarily
  * when the reclaim efficiency is low does not make
@@ -68,12 +81,50 @@ static atomic_t skip_reclaim = ATOMIC_INIT(0);
 /* Not atomic since only a single instance of swap_fn run at a time */
 static int monitor_eff;
 
+/* Last vmpressure level seen, to stop a run once pressure has eased */
+static unsigned long cur_pressure;
+
+static struct workqueue_struct *reclaim_wq;
+
 struct selected_task {
 	struct task_struct *p;
 	int tasksize;
 	short oom_score_adj;
 };
 
+struct reclaim_worker {
+	struct work_struct work;
+	int nr_tasks;
+	int nr_scanned;
+	int nr_reclaimed;
+};
+
+struct reclaim_stats {
+	unsigned long runs;
+	int nr_tasks;
+	int nr_workers;
+	int nr_scanned;
+	int nr_reclaimed;
+	unsigned int time_ms;
+	bool stopped_early;
+	struct reclaim_worker workers[MAX_RECLAIM_WORKERS];
+};
+
+/*
+ * State of the current run. swap_fn() sets it up before queueing the
+ * workers and only reads it back once they are all flushed.
+ */
+static struct selected_task selected[MAX_SWAP_TASKS];
+static int nr_selected;
+static int total_sz;
+static atomic_t next_task;
+static atomic_t run_reclaimed;
+static bool stopped_early;
+static struct reclaim_worker workers[MAX_RECLAIM_WORKERS];
+
+static DEFINE_SPINLOCK(stats_lock);
+static struct reclaim_stats last_run;
+
 int selected_cmp(const void *a, const void *b)
 {
 	const struct selected_task *x = a;
@@ -104,20 +155,78 @@ static int test_task_flag(struct task_struct *p, int flag)
 	return 0;
 }
 
+static bool reclaim_target_met(void)
+{
+	return atomic_read(&run_reclaimed) >= per_swap_size ||
+		READ_ONCE(cur_pressure) < pressure_min;
+}
+
+/* Reclaim the selected tasks, largest first, until none are left */
+static void reclaim_worker_fn(struct work_struct *work)
+{
+	struct reclaim_worker *w = container_of(work, struct reclaim_worker,
+						work);
+	struct reclaim_param rp;
+	int nr_to_reclaim;
+	int si;
+
+	while ((si = nr_selected - atomic_inc_return(&next_task)) >= 0) {
+		if (reclaim_target_met()) {
+			stopped_early = true;
+			break;
+		}
+
+		nr_to_reclaim =
+			(selected[si].tasksize * per_swap_size) / total_sz;
+		/* scan atleast a page */
+		if (!nr_to_reclaim)
+			nr_to_reclaim = 1;
+
+		rp = reclaim_task_anon(selected[si].p, nr_to_reclaim);
+
+		trace_process_reclaim(selected[si].tasksize,
+				selected[si].oom_score_adj, rp.nr_scanned,
+				rp.nr_reclaimed, per_swap_size, total_sz,
+				nr_to_reclaim);
+		w->nr_tasks++;
+		w->nr_scanned += rp.nr_scanned;
+		w->nr_reclaimed += rp.nr_reclaimed;
+		atomic_add(rp.nr_reclaimed, &run_reclaimed);
+	}
+}
+
+static void update_stats(int nr_workers, ktime_t start)
+{
+	int i;
+
+	spin_lock(&stats_lock);
+	last_run.runs++;
+	last_run.nr_tasks = nr_selected;
+	last_run.nr_workers = nr_workers;
+	last_run.nr_scanned = 0;
+	last_run.nr_reclaimed = 0;
+	last_run.time_ms = ktime_ms_delta(ktime_get(), start);
+	last_run.stopped_early = stopped_early;
+	for (i = 0; i < nr_workers; i++) {
+		last_run.workers[i] = workers[i];
+		last_run.nr_scanned += workers[i].nr_scanned;
+		last_run.nr_reclaimed += workers[i].nr_reclaimed;
+	}
+	spin_unlock(&stats_lock);
+}
+
 static void swap_fn(struct work_struct *work)
 {
 	struct task_struct *tsk;
-	struct reclaim_param rp;
+	ktime_t start = ktime_get();
 
 	/* Pick the best MAX_SWAP_TASKS tasks in terms of anon size */
-	struct selected_task selected[MAX_SWAP_TASKS] = {{0, 0, 0},};
 	int si = 0;
 	int i;
 	int tasksize;
-	int total_sz = 0;
 	int total_scan = 0;
 	int total_reclaimed = 0;
-	int nr_to_reclaim;
+	int nr_workers;
 	int efficiency;
 
 	rcu_read_lock();
@@ -164,6 +273,7 @@ static void swap_fn(struct work_struct *work)
 		}
 	}
 
+	total_sz = 0;
 	for (i = 0; i < si; i++)
 		total_sz += selected[i].tasksize;
 
@@ -178,23 +288,39 @@ static void swap_fn(struct work_struct *work)
 
 	rcu_read_unlock();
 
-	while (si--) {
-		nr_to_reclaim =
-			(selected[si].tasksize * per_swap_size) / total_sz;
-		/* scan atleast a page */
-		if (!nr_to_reclaim)
-			nr_to_reclaim = 1;
+	/* Largest tasks go first, see reclaim_worker_fn() */
+	sort(&selected[0], si, sizeof(struct selected_task),
+			&selected_cmp, NULL);
+
+	nr_selected = si;
+	atomic_set(&next_task, 0);
+	atomic_set(&run_reclaimed, 0);
+	stopped_early = false;
+
+	nr_workers = clamp(reclaim_workers, 1, MAX_RECLAIM_WORKERS);
+	nr_workers = min(nr_workers, si);
+	memset(workers, 0, sizeof(workers));
+
+	if (nr_workers == 1 || !reclaim_wq) {
+		nr_workers = 1;
+		reclaim_worker_fn(&workers[0].work);
+	} else {
+		for (i = 0; i < nr_workers; i++) {
+			INIT_WORK(&workers[i].work, reclaim_worker_fn);
+			queue_work(reclaim_wq, &workers[i].work);
+		}
+		for (i = 0; i < nr_workers; i++)
+			flush_work(&workers[i].work);
+	}
 
-		rp = reclaim_task_anon(selected[si].p, nr_to_reclaim);
+	for (i = 0; i < si; i++)
+		put_task_struct(selected[i].p);
 
-		trace_process_reclaim(selected[si].tasksize,
-				selected[si].oom_score_adj, rp.nr_scanned,
-				rp.nr_reclaimed, per_swap_size, total_sz,
-				nr_to_reclaim);
-		total_scan += rp.nr_scanned;
-		total_reclaimed += rp.nr_reclaimed;
-		put_task_struct(selected[si].p);
+	for (i = 0; i < nr_workers; i++) {
+		total_scan += workers[i].nr_scanned;
+		total_reclaimed += workers[i].nr_reclaimed;
 	}
+	update_stats(nr_workers, start);
 
 	if (total_scan) {
 		efficiency = (total_reclaimed * 100) / total_scan;
@@ -222,6 +348,8 @@ static int vmpressure_notifier(struct notifier_block *nb,
 	if (!enable_process_reclaim)
 		return 0;
 
+	WRITE_ONCE(cur_pressure, pressure);
+
 	if (!current_is_kswapd())
 		return 0;
 
@@ -238,8 +366,78 @@ static struct notifier_block vmpr_nb = {
 	.notifier_call = vmpressure_notifier,
 };
 
+#ifdef CONFIG_DEBUG_FS
+static int reclaim_stats_show(struct seq_file *s, void *unused)
+{
+	struct reclaim_stats *st;
+	int i;
+
+	st = kmalloc(sizeof(*st), GFP_KERNEL);
+	if (!st)
+		return -ENOMEM;
+
+	spin_lock(&stats_lock);
+	*st = last_run;
+	spin_unlock(&stats_lock);
+
+	seq_printf(s, "runs: %lu\n", st->runs);
+	seq_printf(s, "tasks: %d\n", st->nr_tasks);
+	seq_printf(s, "workers: %d\n", st->nr_workers);
+	seq_printf(s, "scanned: %d\n", st->nr_scanned);
+	seq_printf(s, "reclaimed: %d\n", st->nr_reclaimed);
+	seq_printf(s, "time_ms: %u\n", st->time_ms);
+	seq_printf(s, "stopped_early: %d\n", st->stopped_early);
+	for (i = 0; i < st->nr_workers; i++)
+		seq_printf(s, "worker%d: tasks %d scanned %d reclaimed %d\n",
+			   i, st->workers[i].nr_tasks,
+			   st->workers[i].nr_scanned,
+			   st->workers[i].nr_reclaimed);
+
+	kfree(st);
+	return 0;
+}
+
+static int reclaim_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, reclaim_stats_show, NULL);
+}
+
+static const struct file_operations reclaim_stats_fops = {
+	.open		= reclaim_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static struct dentry *reclaim_debugfs_root;
+
+static void reclaim_debugfs_init(void)
+{
+	reclaim_debugfs_root = debugfs_create_dir("process_reclaim", NULL);
+	if (!reclaim_debugfs_root)
+		return;
+
+	debugfs_create_file("stats", 0444, reclaim_debugfs_root, NULL,
+			    &reclaim_stats_fops);
+}
+
+static void reclaim_debugfs_exit(void)
+{
+	debugfs_remove_recursive(reclaim_debugfs_root);
+}
+#else
+static void reclaim_debugfs_init(void) { }
+static void reclaim_debugfs_exit(void) { }
+#endif
+
 static int __init process_reclaim_init(void)
 {
+	reclaim_wq = alloc_workqueue("process_reclaim", WQ_UNBOUND,
+				     MAX_RECLAIM_WORKERS);
+	if (!reclaim_wq)
+		pr_warn("process_reclaim: falling back to a single worker\n");
+
+	reclaim_debugfs_init();
 	vmpressure_notifier_register(&vmpr_nb);
 	return 0;
 }
@@ -247,6 +445,10 @@ static int __init process_reclaim_init(void)
 static void __exit process_reclaim_exit(void)
 {
 	vmpressure_notifier_unregister(&vmpr_nb);
+	flush_work(&swap_work);
+	reclaim_debugfs_exit();
+	if (reclaim_wq)
+		destroy_workqueue(reclaim_wq);
 }
 
 module_init(process_reclaim_init);
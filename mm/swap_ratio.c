@@ -14,12 +14,17 @@
 #include <linux/mm_types.h>
 #include <linux/swapfile.h>
 #include <linux/swap.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #define SWAP_RATIO_GROUP_START (SWAP_FLAG_PRIO_MASK - 9) /* 32758 */
 #define SWAP_RATIO_GROUP_END (SWAP_FLAG_PRIO_MASK) /* 32767 */
 #define SWAP_FAST_WRITES (SWAPFILE_CLUSTER * (SWAP_CLUSTER_MAX / 8))
 #define SWAP_SLOW_WRITES SWAPFILE_CLUSTER
 
+/* Weight of a new sample in the write latency EWMA, as a shift */
+#define SWAP_LAT_EWMA_SHIFT 3
+
 /*
  * The fast/slow swap write ratio.
  * 100 indicates that all writes should
@@ -30,6 +35,12 @@ int sysctl_swap_ratio = 100;
 /* Enable the swap ratio feature */
 int sysctl_swap_ratio_enable;
 
+/*
+ * Derive the ratio from the measured write latency of the fast and
+ * slow device instead of using sysctl_swap_ratio as is.
+ */
+int sysctl_swap_ratio_adaptive;
+
 static bool is_same_group(struct swap_info_struct *a,
 		struct swap_info_struct *b)
 {
@@ -45,11 +56,51 @@ static bool is_same_group(struct swap_info_struct *a,
 	return false;
 }
 
+bool swap_ratio_adaptive(struct swap_info_struct *si)
+{
+	return sysctl_swap_ratio_enable && sysctl_swap_ratio_adaptive &&
+		is_swap_ratio_group(si->prio);
+}
+
+/* Called on completion of each write to a device in a ratio group */
+void swap_ratio_write_latency(struct swap_info_struct *si,
+			      unsigned long lat_ns)
+{
+	unsigned long avg = READ_ONCE(si->write_lat_avg);
+
+	if (!avg)
+		avg = lat_ns;
+	else
+		avg = avg - (avg >> SWAP_LAT_EWMA_SHIFT) +
+			(lat_ns >> SWAP_LAT_EWMA_SHIFT);
+
+	WRITE_ONCE(si->write_lat_avg, avg ? : 1);
+}
+
+/*
+ * In adaptive mode each device gets a share of the writes inversely
+ * proportional to its recent write latency, so the ratio moves toward
+ * whichever device currently completes writes faster. Until both
+ * devices have been written to, the sysctl value is used.
+ */
+static int effective_swap_ratio(struct swap_info_struct *fast,
+				struct swap_info_struct *slow)
+{
+	unsigned long fast_lat = READ_ONCE(fast->write_lat_avg);
+	unsigned long slow_lat = READ_ONCE(slow->write_lat_avg);
+
+	if (!sysctl_swap_ratio_adaptive || !fast_lat || !slow_lat)
+		return sysctl_swap_ratio;
+
+	return clamp_t(int, div64_u64(100ULL * slow_lat, fast_lat + slow_lat),
+		       1, 100);
+}
+
 /* Caller must hold swap_avail_lock */
 static int calculate_write_pending(struct swap_info_struct *si,
 			struct swap_info_struct *n)
 {
-	int ratio = sysctl_swap_ratio;
+	int ratio = effective_swap_ratio(si, n);
 
 	if ((ratio < 0) || (ratio > 100))
 		return -EINVAL;
@@ -194,3 +245,52 @@ int swap_ratio(struct swap_info_struct **si)
 	else
 		return -ENODEV;
 }
+
+#ifdef CONFIG_DEBUG_FS
+static int swap_ratio_show(struct seq_file *s, void *unused)
+{
+	struct swap_info_struct *si, *fast = NULL, *slow = NULL;
+
+	seq_puts(s, "Type\tPriority\tFast\tWriteLatencyUs\n");
+
+	spin_lock(&swap_lock);
+	plist_for_each_entry(si, &swap_active_head, list) {
+		seq_printf(s, "%d\t%d\t\t%d\t%lu\n", si->type, si->prio,
+			   !!(si->flags & SWP_FAST),
+			   READ_ONCE(si->write_lat_avg) / NSEC_PER_USEC);
+
+		if (!is_swap_ratio_group(si->prio))
+			continue;
+		if (si->flags & SWP_FAST) {
+			if (!fast)
+				fast = si;
+		} else if (!slow) {
+			slow = si;
+		}
+	}
+	if (fast && slow && fast->prio == slow->prio)
+		seq_printf(s, "ratio: %d\n", effective_swap_ratio(fast, slow));
+	spin_unlock(&swap_lock);
+
+	return 0;
+}
+
+static int swap_ratio_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, swap_ratio_show, NULL);
+}
+
+static const struct file_operations swap_ratio_fops = {
+	.open		= swap_ratio_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init swap_ratio_debugfs_init(void)
+{
+	debugfs_create_file("swap_ratio", 0444, NULL, NULL, &swap_ratio_fops);
+	return 0;
+}
+late_initcall(swap_ratio_debugfs_init);
+#endif
@@ -63,8 +63,6 @@ unsigned long total_swapcache_pages(void)
 	return ret;
 }
 
-static atomic_t swapin_readahead_hits = ATOMIC_INIT(4);
-
 void show_swap_cache_info(void)
 {
 	printk("%lu pages in swap cache\n", total_swapcache_pages());
@@ -289,8 +287,13 @@ struct page * lookup_swap_cache(swp_entry_t entry)
 
 	if (page) {
 		INC_CACHE_INFO(find_success);
-		if (TestClearPageReadahead(page))
-			atomic_inc(&swapin_readahead_hits);
+		if (TestClearPageReadahead(page)) {
+			struct swap_info_struct *si = swp_swap_info(entry);
+
+			atomic_inc(&si->ra_hits);
+			atomic_inc(&si->ra_used);
+			count_vm_event(SWAP_RA_HIT);
+		}
 	}
 
 	INC_CACHE_INFO(find_total);
@@ -411,31 +414,64 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return retpage;
 }
 
-static unsigned long swapin_nr_pages(unsigned long offset)
+/* Readahead pages read from a device between adjustments of its cap */
+#define SWAP_RA_PERIOD		256
+/* How far above page_cluster a device with a good hit ratio may grow */
+#define SWAP_RA_ORDER_EXTRA	2
+
+/*
+ * Grow the readahead cap of a device by one order when at least 3/4 of
+ * the pages it read ahead in the last period were used, and shrink it
+ * when less than 1/4 were. The cap never drops below two pages, so that
+ * a device keeps getting the readahead hits needed to grow again.
+ */
+static void swap_ra_update_order(struct swap_info_struct *si)
+{
+	unsigned int issued, used, order, max_order;
+
+	issued = atomic_read(&si->ra_issued);
+	if (issued < SWAP_RA_PERIOD)
+		return;
+
+	atomic_set(&si->ra_issued, 0);
+	used = atomic_xchg(&si->ra_used, 0);
+
+	order = READ_ONCE(si->ra_order);
+	max_order = READ_ONCE(page_cluster) + SWAP_RA_ORDER_EXTRA;
+	if (used * 4 >= issued * 3)
+		order++;
+	else if (used * 4 < issued && order > 1)
+		order--;
+
+	WRITE_ONCE(si->ra_order, clamp(order, 1U, max_order));
+}
+
+static unsigned long swapin_nr_pages(struct swap_info_struct *si,
+				     unsigned long offset)
 {
-	static unsigned long prev_offset;
 	unsigned int pages, max_pages, last_ra;
-	static atomic_t last_readahead_pages;
 
-	max_pages = 1 << READ_ONCE(page_cluster);
-	if (max_pages <= 1)
+	if (!READ_ONCE(page_cluster))
 		return 1;
 
+	swap_ra_update_order(si);
+	max_pages = 1 << max(READ_ONCE(si->ra_order), 1U);
+
 	/*
 	 * This heuristic has been found to work well on both sequential and
 	 * random loads, swapping to hard disk or to SSD: please don't ask
 	 * what the "+ 2" means, it just happens to work well, that's all.
 	 */
-	pages = atomic_xchg(&swapin_readahead_hits, 0) + 2;
+	pages = atomic_xchg(&si->ra_hits, 0) + 2;
 	if (pages == 2) {
 		/*
 		 * We can have no readahead hits to judge by: but must not get
-		 * stuck here forever, so check for an adjacent offset instead
-		 * (and don't even bother to check whether swap type is same).
+		 * stuck here forever, so check for an adjacent offset instead.
 		 */
-		if (offset != prev_offset + 1 && offset != prev_offset - 1)
+		if (offset != si->ra_prev_offset + 1 &&
+		    offset != si->ra_prev_offset - 1)
 			pages = 1;
-		prev_offset = offset;
+		si->ra_prev_offset = offset;
 	} else {
 		unsigned int roundup = 4;
 		while (roundup < pages)
@@ -447,10 +483,10 @@ static unsigned long swapin_nr_pages(unsigned long offset)
 		pages = max_pages;
 
 	/* Don't shrink readahead too fast */
-	last_ra = atomic_read(&last_readahead_pages) / 2;
+	last_ra = atomic_read(&si->ra_last_pages) / 2;
 	if (pages < last_ra)
 		pages = last_ra;
-	atomic_set(&last_readahead_pages, pages);
+	atomic_set(&si->ra_last_pages, pages);
 
 	return pages;
 }
@@ -465,7 +501,8 @@ static unsigned long swapin_nr_pages(unsigned long offset)
  * Returns the struct page for entry and addr, after queueing swapin.
  *
  * Primitive swap readahead code. We simply read an aligned block of
- * (1 << page_cluster) entries in the swap area. This method is chosen
+ * up to (1 << si->ra_order) entries in the swap area, where the cap
+ * follows each device's readahead hit ratio. This method is chosen
  * because it doesn't cost us any seek time.  We also make sure to queue
  * the 'original' request together with the readahead ones...
  *
@@ -481,14 +518,16 @@ static unsigned long swapin_nr_pages(unsigned long offset)
 struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 			struct vm_area_struct *vma, unsigned long addr)
 {
+	struct swap_info_struct *si = swp_swap_info(entry);
 	struct page *page;
 	unsigned long entry_offset = swp_offset(entry);
 	unsigned long offset = entry_offset;
 	unsigned long start_offset, end_offset;
 	unsigned long mask;
 	struct blk_plug plug;
+	bool page_allocated;
 
-	mask = is_swap_fast(entry) ? 0 : swapin_nr_pages(offset) - 1;
+	mask = is_swap_fast(entry) ? 0 : swapin_nr_pages(si, offset) - 1;
 	if (!mask)
 		goto skip;
 
@@ -501,12 +540,19 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	blk_start_plug(&plug);
 	for (offset = start_offset; offset <= end_offset ; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
+		page = __read_swap_cache_async(
+				swp_entry(swp_type(entry), offset),
+				gfp_mask, vma, addr, &page_allocated);
 		if (!page)
 			continue;
-		if (offset != entry_offset)
-			SetPageReadahead(page);
+		if (page_allocated) {
+			swap_readpage(page);
+			if (offset != entry_offset) {
+				SetPageReadahead(page);
+				atomic_inc(&si->ra_issued);
+				count_vm_event(SWAP_RA);
+			}
+		}
 		put_page(page);
 	}
 	blk_finish_plug(&plug);
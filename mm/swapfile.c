@@ -117,6 +117,11 @@ bool is_swap_fast(swp_entry_t entry)
 	return false;
 }
 
+struct swap_info_struct *swp_swap_info(swp_entry_t entry)
+{
+	return swap_info[swp_type(entry)];
+}
+
 /* returns 1 if swap entry is freed */
 static int
 __try_to_reclaim_swap(struct swap_info_struct *si, unsigned long offset)
@@ -2230,6 +2235,13 @@ static struct swap_info_struct *alloc_swap_info(void)
 	p->flags = SWP_USED;
 	spin_unlock(&swap_lock);
 	spin_lock_init(&p->lock);
+	p->write_lat_avg = 0;
+	atomic_set(&p->ra_hits, 4);
+	atomic_set(&p->ra_last_pages, 0);
+	p->ra_prev_offset = 0;
+	atomic_set(&p->ra_issued, 0);
+	atomic_set(&p->ra_used, 0);
+	p->ra_order = READ_ONCE(page_cluster);
 
 	return p;
 }
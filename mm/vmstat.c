@@ -1077,6 +1077,10 @@ const char * const vmstat_text[] = {
 	"balloon_migrate",
 #endif
 #endif /* CONFIG_MEMORY_BALLOON */
+#ifdef CONFIG_SWAP
+	"swap_ra",
+	"swap_ra_hit",
+#endif
 #ifdef CONFIG_DEBUG_TLBFLUSH
 	"nr_tlb_remote_flush",
 	"nr_tlb_remote_flush_received",
@@ -43,6 +43,7 @@
 #include <asm/pgtable.h>
 #include <linux/cpumask.h>
 #include <linux/cpu.h>
+#include <linux/percpu.h>
 #include <linux/vmalloc.h>
 #include <linux/preempt.h>
 #include <linux/spinlock.h>
@@ -54,6 +55,10 @@
 #include <linux/migrate.h>
 #include <linux/wait.h>
 #include <linux/pagemap.h>
+#include <linux/sort.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
 
 #define ZSPAGE_MAGIC	0x58
 
@@ -155,13 +160,72 @@ enum zs_stat_type {
 	CLASS_FULL,
 	OBJ_ALLOCATED,
 	OBJ_USED,
+	OBJ_CACHED,
 	NR_ZS_STAT_TYPE,
 };
 
+/*
+ * Kept per cpu and folded on read, so that the counters can be updated
+ * outside of class->lock and read without taking it.
+ */
 struct zs_size_stat {
 	unsigned long objs[NR_ZS_STAT_TYPE];
 };
 
+/*
+ * Per-cpu magazine of allocated objects in front of a size_class.
+ *
+ * zs_free() parks the handle here instead of returning the object to its
+ * zspage and zs_malloc() hands it out again, so most alloc/free pairs on
+ * a cpu never take class->lock. As far as the zspage is concerned the
+ * objects stay allocated: migration and compaction move them like any
+ * other object and update the handle. Magazines are drained before the
+ * pool is compacted through zs_compact() or destroyed, and by background
+ * compaction only under memory pressure, see zs_background_compact().
+ */
+#define ZS_MAGAZINE_SIZE	16
+
+struct zs_magazine {
+	spinlock_t lock;
+	unsigned int nr;
+	unsigned long handles[ZS_MAGAZINE_SIZE];
+};
+
+/* Objects cached per cpu and class, zero disables the magazines */
+static unsigned int magazine_size = ZS_MAGAZINE_SIZE;
+module_param(magazine_size, uint, 0644);
+MODULE_PARM_DESC(magazine_size, "Objects cached per cpu and size class (max 16)");
+
+/*
+ * Background compaction. Every compact_interval_ms the classes wasting at
+ * least compact_frag_pct of their allocated objects are compacted, worst
+ * first, until compact_max_zspages source zspages have been migrated.
+ */
+static unsigned int compact_interval_ms = 5000;
+
+static unsigned int compact_frag_pct = 25;
+module_param(compact_frag_pct, uint, 0644);
+MODULE_PARM_DESC(compact_frag_pct, "Unused share of allocated objects that makes a class worth compacting");
+
+static unsigned int compact_max_zspages = 64;
+module_param(compact_max_zspages, uint, 0644);
+MODULE_PARM_DESC(compact_max_zspages, "Most zspages migrated per background pass");
+
+/* Pools with background compaction work, re-armed when the period changes */
+static LIST_HEAD(zs_pools);
+static DEFINE_MUTEX(zs_pools_lock);
+
+struct zs_compact_stats {
+	unsigned long passes;
+	unsigned long pages_freed;
+	unsigned long zspages_migrated;
+	u64 time_ns;
+	/* The most recent pass */
+	unsigned long last_pages_freed;
+	unsigned long last_zspages_migrated;
+	u64 last_time_ns;
+};
+
 #ifdef CONFIG_ZSMALLOC_STAT
 static struct dentry *zs_stat_root;
 #endif
@@ -205,7 +269,9 @@ struct size_class {
 	int pages_per_zspage;
 
 	unsigned int index;
-	struct zs_size_stat stats;
+	struct zs_size_stat __percpu *stats;
+	/* NULL for classes holding a single object per zspage */
+	struct zs_magazine __percpu *magazine;
 };
 
 /* huge object: pages_per_zspage == 1 && maxobj_per_zspage == 1 */
@@ -262,6 +328,11 @@ struct zs_pool {
 	 * and unregister_shrinker() will not Oops.
 	 */
 	bool shrinker_enabled;
+
+	/* Background compaction */
+	struct list_head pool_list;
+	struct delayed_work compact_work;
+	struct zs_compact_stats compact_stats;
 #ifdef CONFIG_ZSMALLOC_STAT
 	struct dentry *stat_dentry;
 #endif
@@ -569,21 +640,27 @@ static int get_size_class_index(int size)
 static inline void zs_stat_inc(struct size_class *class,
 				int type, unsigned long cnt)
 {
-	class->stats.objs[type] += cnt;
+	this_cpu_add(class->stats->objs[type], cnt);
 }
 
 /* type can be of enum type zs_stat_type or fullness_group */
 static inline void zs_stat_dec(struct size_class *class,
 				int type, unsigned long cnt)
 {
-	class->stats.objs[type] -= cnt;
+	this_cpu_sub(class->stats->objs[type], cnt);
 }
 
 /* type can be of enum type zs_stat_type or fullness_group */
 static inline unsigned long zs_stat_get(struct size_class *class,
 				int type)
 {
-	return class->stats.objs[type];
+	unsigned long sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += per_cpu_ptr(class->stats, cpu)->objs[type];
+
+	return sum;
 }
 
 #ifdef CONFIG_ZSMALLOC_STAT
@@ -614,15 +691,15 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 	struct size_class *class;
 	int objs_per_zspage;
 	unsigned long class_almost_full, class_almost_empty;
-	unsigned long obj_allocated, obj_used, pages_used, freeable;
+	unsigned long obj_allocated, obj_used, obj_cached, pages_used, freeable;
 	unsigned long total_class_almost_full = 0, total_class_almost_empty = 0;
 	unsigned long total_objs = 0, total_used_objs = 0, total_pages = 0;
-	unsigned long total_freeable = 0;
+	unsigned long total_freeable = 0, total_cached_objs = 0;
 
-	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s %8s\n",
+	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s %8s %10s\n",
 			"class", "size", "almost_full", "almost_empty",
 			"obj_allocated", "obj_used", "pages_used",
-			"pages_per_zspage", "freeable");
+			"pages_per_zspage", "freeable", "obj_cached");
 
 	for (i = 0; i < zs_size_classes; i++) {
 		class = pool->size_class[i];
@@ -630,23 +707,22 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 		if (class->index != i)
 			continue;
 
-		spin_lock(&class->lock);
 		class_almost_full = zs_stat_get(class, CLASS_ALMOST_FULL);
 		class_almost_empty = zs_stat_get(class, CLASS_ALMOST_EMPTY);
 		obj_allocated = zs_stat_get(class, OBJ_ALLOCATED);
 		obj_used = zs_stat_get(class, OBJ_USED);
+		obj_cached = zs_stat_get(class, OBJ_CACHED);
 		freeable = zs_can_compact(class);
-		spin_unlock(&class->lock);
 
 		objs_per_zspage = class->objs_per_zspage;
 		pages_used = obj_allocated / objs_per_zspage *
 				class->pages_per_zspage;
 
 		seq_printf(s, " %5u %5u %11lu %12lu %13lu"
-				" %10lu %10lu %16d %8lu\n",
+				" %10lu %10lu %16d %8lu %10lu\n",
 			i, class->size, class_almost_full, class_almost_empty,
 			obj_allocated, obj_used, pages_used,
-			class->pages_per_zspage, freeable);
+			class->pages_per_zspage, freeable, obj_cached);
 
 		total_class_almost_full += class_almost_full;
 		total_class_almost_empty += class_almost_empty;
@@ -654,13 +730,15 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 		total_used_objs += obj_used;
 		total_pages += pages_used;
 		total_freeable += freeable;
+		total_cached_objs += obj_cached;
 	}
 
 	seq_puts(s, "\n");
-	seq_printf(s, " %5s %5s %11lu %12lu %13lu %10lu %10lu %16s %8lu\n",
+	seq_printf(s, " %5s %5s %11lu %12lu %13lu %10lu %10lu %16s %8lu %10lu\n",
 			"Total", "", total_class_almost_full,
 			total_class_almost_empty, total_objs,
-			total_used_objs, total_pages, "", total_freeable);
+			total_used_objs, total_pages, "", total_freeable,
+			total_cached_objs);
 
 	return 0;
 }
@@ -677,6 +755,39 @@ static const struct file_operations zs_stat_size_ops = {
 	.release        = single_release,
 };
 
+static int zs_stats_compact_show(struct seq_file *s, void *v)
+{
+	struct zs_pool *pool = s->private;
+	struct zs_compact_stats *stats = &pool->compact_stats;
+
+	seq_printf(s, "passes %lu\n", READ_ONCE(stats->passes));
+	seq_printf(s, "pages_freed %lu\n", READ_ONCE(stats->pages_freed));
+	seq_printf(s, "zspages_migrated %lu\n",
+		   READ_ONCE(stats->zspages_migrated));
+	seq_printf(s, "time_us %llu\n",
+		   div_u64(READ_ONCE(stats->time_ns), NSEC_PER_USEC));
+	seq_printf(s, "last_pages_freed %lu\n",
+		   READ_ONCE(stats->last_pages_freed));
+	seq_printf(s, "last_zspages_migrated %lu\n",
+		   READ_ONCE(stats->last_zspages_migrated));
+	seq_printf(s, "last_time_us %llu\n",
+		   div_u64(READ_ONCE(stats->last_time_ns), NSEC_PER_USEC));
+
+	return 0;
+}
+
+static int zs_stats_compact_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zs_stats_compact_show, inode->i_private);
+}
+
+static const struct file_operations zs_stat_compact_ops = {
+	.open           = zs_stats_compact_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
 static void zs_pool_stat_create(struct zs_pool *pool, const char *name)
 {
 	struct dentry *entry;
@@ -700,7 +811,14 @@ static void zs_pool_stat_create(struct zs_pool *pool, const char *name)
 				name, "classes");
 		debugfs_remove_recursive(pool->stat_dentry);
 		pool->stat_dentry = NULL;
+		return;
 	}
+
+	entry = debugfs_create_file("compaction", S_IFREG | S_IRUGO,
+			pool->stat_dentry, pool, &zs_stat_compact_ops);
+	if (!entry)
+		pr_warn("%s: debugfs file entry <%s> creation failed\n",
+				name, "compaction");
 }
 
 static void zs_pool_stat_destroy(struct zs_pool *pool)
@@ -1554,6 +1672,150 @@ static unsigned long obj_malloc(struct size_class *class,
 	return obj;
 }
 
+static void __zs_free(struct zs_pool *pool, unsigned long handle, bool cache);
+
+/* Park a freed object in this cpu's magazine, false if there is no room */
+static bool zs_magazine_put(struct size_class *class, unsigned long handle)
+{
+	struct zs_magazine *mag;
+	bool cached = false;
+
+	if (!class->magazine)
+		return false;
+
+	mag = raw_cpu_ptr(class->magazine);
+	spin_lock(&mag->lock);
+	if (mag->nr < min_t(unsigned int, READ_ONCE(magazine_size),
+			    ZS_MAGAZINE_SIZE)) {
+		mag->handles[mag->nr++] = handle;
+		cached = true;
+	}
+	spin_unlock(&mag->lock);
+
+	if (cached)
+		zs_stat_inc(class, OBJ_CACHED, 1);
+
+	return cached;
+}
+
+/*
+ * Refill an empty magazine with half its size worth of objects from the
+ * zspages the class already has, under a single class->lock hold. The
+ * first object is returned to the caller. Allocating a new zspage is
+ * left to the slow path.
+ */
+static unsigned long zs_magazine_refill(struct zs_pool *pool,
+				struct size_class *class, gfp_t gfp)
+{
+	unsigned long handles[ZS_MAGAZINE_SIZE / 2];
+	unsigned int batch, nr, filled, i;
+	struct zs_magazine *mag;
+	struct zspage *zspage;
+	unsigned long obj;
+
+	batch = min_t(unsigned int, READ_ONCE(magazine_size) / 2,
+		      ZS_MAGAZINE_SIZE / 2);
+	if (batch < 2)
+		return 0;
+
+	for (nr = 0; nr < batch; nr++) {
+		handles[nr] = cache_alloc_handle(pool, gfp);
+		if (!handles[nr])
+			break;
+	}
+
+	spin_lock(&class->lock);
+	for (filled = 0; filled < nr; filled++) {
+		zspage = find_get_zspage(class);
+		if (!zspage)
+			break;
+		obj = obj_malloc(class, zspage, handles[filled]);
+		fix_fullness_group(class, zspage);
+		record_obj(handles[filled], obj);
+	}
+	spin_unlock(&class->lock);
+
+	for (i = filled; i < nr; i++)
+		cache_free_handle(pool, handles[i]);
+
+	if (!filled)
+		return 0;
+
+	/* We may have moved to another cpu, its magazine may be full */
+	mag = raw_cpu_ptr(class->magazine);
+	spin_lock(&mag->lock);
+	for (i = 1; i < filled && mag->nr < ZS_MAGAZINE_SIZE; i++)
+		mag->handles[mag->nr++] = handles[i];
+	spin_unlock(&mag->lock);
+
+	zs_stat_inc(class, OBJ_CACHED, i - 1);
+	for (; i < filled; i++)
+		__zs_free(pool, handles[i], false);
+
+	return handles[0];
+}
+
+static unsigned long zs_magazine_get(struct zs_pool *pool,
+				struct size_class *class, gfp_t gfp)
+{
+	struct zs_magazine *mag;
+	unsigned long handle = 0;
+
+	if (!class->magazine)
+		return 0;
+
+	mag = raw_cpu_ptr(class->magazine);
+	spin_lock(&mag->lock);
+	if (mag->nr)
+		handle = mag->handles[--mag->nr];
+	spin_unlock(&mag->lock);
+
+	if (handle) {
+		zs_stat_dec(class, OBJ_CACHED, 1);
+		return handle;
+	}
+
+	return zs_magazine_refill(pool, class, gfp);
+}
+
+/* Return every object cached for @class to its zspage */
+static void zs_magazine_drain(struct zs_pool *pool, struct size_class *class)
+{
+	unsigned long handles[ZS_MAGAZINE_SIZE];
+	struct zs_magazine *mag;
+	unsigned int nr;
+	int cpu;
+
+	if (!class->magazine)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		mag = per_cpu_ptr(class->magazine, cpu);
+
+		spin_lock(&mag->lock);
+		nr = mag->nr;
+		memcpy(handles, mag->handles, nr * sizeof(handles[0]));
+		mag->nr = 0;
+		spin_unlock(&mag->lock);
+
+		zs_stat_dec(class, OBJ_CACHED, nr);
+		while (nr)
+			__zs_free(pool, handles[--nr], false);
+	}
+}
+
+static void zs_magazine_drain_all(struct zs_pool *pool)
+{
+	struct size_class *class;
+	int i;
+
+	for (i = 0; i < zs_size_classes; i++) {
+		class = pool->size_class[i];
+		if (!class || class->index != i)
+			continue;
+		zs_magazine_drain(pool, class);
+	}
+}
 
 /**
  * zs_malloc - Allocate block of given size from pool.
@@ -1575,14 +1837,18 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
 		return 0;
 
-	handle = cache_alloc_handle(pool, gfp);
-	if (!handle)
-		return 0;
-
 	/* extra space in chunk to keep the handle */
 	size += ZS_HANDLE_SIZE;
 	class = pool->size_class[get_size_class_index(size)];
 
+	handle = zs_magazine_get(pool, class, gfp);
+	if (handle)
+		return handle;
+
+	handle = cache_alloc_handle(pool, gfp);
+	if (!handle)
+		return 0;
+
 	spin_lock(&class->lock);
 	zspage = find_get_zspage(class);
 	if (likely(zspage)) {
@@ -1646,7 +1912,7 @@ static void obj_free(struct size_class *class, unsigned long obj)
 	zs_stat_dec(class, OBJ_USED, 1);
 }
 
-void zs_free(struct zs_pool *pool, unsigned long handle)
+static void __zs_free(struct zs_pool *pool, unsigned long handle, bool cache)
 {
 	struct zspage *zspage;
 	struct page *f_page;
@@ -1657,9 +1923,6 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	enum fullness_group fullness;
 	bool isolated;
 
-	if (unlikely(!handle))
-		return;
-
 	pin_tag(handle);
 	obj = handle_to_obj(handle);
 	obj_to_location(obj, &f_page, &f_objidx);
@@ -1670,6 +1933,12 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	get_zspage_mapping(zspage, &class_idx, &fullness);
 	class = pool->size_class[class_idx];
 
+	if (cache && zs_magazine_put(class, handle)) {
+		migrate_read_unlock(zspage);
+		unpin_tag(handle);
+		return;
+	}
+
 	spin_lock(&class->lock);
 	obj_free(class, obj);
 	fullness = fix_fullness_group(class, zspage);
@@ -1689,6 +1958,14 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	unpin_tag(handle);
 	cache_free_handle(pool, handle);
 }
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	if (unlikely(!handle))
+		return;
+
+	__zs_free(pool, handle, true);
+}
 EXPORT_SYMBOL_GPL(zs_free);
 
 static void zs_object_copy(struct size_class *class, unsigned long dst,
@@ -2354,8 +2631,14 @@ static unsigned long zs_can_compact(struct size_class *class)
 	return obj_wasted * class->pages_per_zspage;
 }
 
+/*
+ * Compact @class and return the number of pages freed. With a @budget,
+ * at most *@budget source zspages are migrated and *@budget is reduced
+ * by the number that were.
+ */
 static unsigned long __zs_compact(struct zs_pool *pool,
-				  struct size_class *class)
+				  struct size_class *class,
+				  unsigned int *budget)
 {
 	struct zs_compact_control cc;
 	struct zspage *src_zspage;
@@ -2368,6 +2651,12 @@ static unsigned long __zs_compact(struct zs_pool *pool,
 		if (!zs_can_compact(class))
 			break;
 
+		if (budget) {
+			if (!*budget)
+				break;
+			(*budget)--;
+		}
+
 		cc.obj_idx = 0;
 		cc.s_page = get_first_page(src_zspage);
 
@@ -2417,7 +2706,8 @@ unsigned long zs_compact(struct zs_pool *pool)
 			continue;
 		if (class->index != i)
 			continue;
-		pages_freed += __zs_compact(pool, class);
+		zs_magazine_drain(pool, class);
+		pages_freed += __zs_compact(pool, class, NULL);
 	}
 	atomic_long_add(pages_freed, &pool->stats.pages_compacted);
 
@@ -2425,6 +2715,157 @@ unsigned long zs_compact(struct zs_pool *pool)
 }
 EXPORT_SYMBOL_GPL(zs_compact);
 
+struct zs_frag {
+	unsigned int pct;
+	int index;
+};
+
+static int zs_frag_cmp(const void *a, const void *b)
+{
+	const struct zs_frag *fa = a, *fb = b;
+
+	return fb->pct - fa->pct;
+}
+
+/* Free memory is below the high watermarks, kswapd has work to do */
+static bool zs_memory_pressure(void)
+{
+	unsigned long high = 0;
+	struct zone *zone;
+
+	for_each_populated_zone(zone)
+		high += high_wmark_pages(zone);
+
+	return global_page_state(NR_FREE_PAGES) < high;
+}
+
+/* Compact the most fragmented classes within compact_max_zspages */
+static void zs_background_compact(struct zs_pool *pool)
+{
+	struct zs_compact_stats *stats = &pool->compact_stats;
+	unsigned int max_zspages = READ_ONCE(compact_max_zspages);
+	unsigned int budget = max_zspages;
+	unsigned int min_pct = READ_ONCE(compact_frag_pct);
+	unsigned long pages_freed = 0;
+	struct size_class *class;
+	struct zs_frag *frag;
+	bool pressure;
+	int i, nr = 0;
+	u64 start;
+
+	frag = kmalloc_array(zs_size_classes, sizeof(*frag),
+			     GFP_KERNEL | __GFP_NOWARN);
+	if (!frag)
+		return;
+
+	start = ktime_get_ns();
+	for (i = 0; i < zs_size_classes; i++) {
+		unsigned long allocated, used;
+
+		class = pool->size_class[i];
+		if (class->index != i)
+			continue;
+
+		/* Objects parked in magazines count as unused here */
+		allocated = zs_stat_get(class, OBJ_ALLOCATED);
+		used = zs_stat_get(class, OBJ_USED) -
+			zs_stat_get(class, OBJ_CACHED);
+		if (!allocated || allocated <= used)
+			continue;
+
+		frag[nr].pct = (allocated - used) * 100 / allocated;
+		frag[nr].index = i;
+		if (frag[nr].pct >= min_pct)
+			nr++;
+	}
+
+	sort(frag, nr, sizeof(*frag), zs_frag_cmp, NULL);
+
+	pressure = zs_memory_pressure();
+	for (i = 0; i < nr && budget; i++) {
+		class = pool->size_class[frag[i].index];
+		/*
+		 * Compaction moves objects parked in magazines like any
+		 * other, so the magazines are only given up when their
+		 * objects are what keeps zspages from being freed, and
+		 * memory is short. Otherwise they keep serving allocations.
+		 */
+		if (!zs_can_compact(class)) {
+			if (!pressure)
+				continue;
+			zs_magazine_drain(pool, class);
+			if (!zs_can_compact(class))
+				continue;
+		}
+		pages_freed += __zs_compact(pool, class, &budget);
+		cond_resched();
+	}
+	kfree(frag);
+
+	if (!nr)
+		return;
+
+	atomic_long_add(pages_freed, &pool->stats.pages_compacted);
+
+	stats->last_pages_freed = pages_freed;
+	stats->last_zspages_migrated = max_zspages - budget;
+	stats->last_time_ns = ktime_get_ns() - start;
+	stats->passes++;
+	stats->pages_freed += pages_freed;
+	stats->zspages_migrated += stats->last_zspages_migrated;
+	stats->time_ns += stats->last_time_ns;
+}
+
+static void zs_compact_work(struct work_struct *work)
+{
+	struct zs_pool *pool = container_of(to_delayed_work(work),
+					    struct zs_pool, compact_work);
+	unsigned int interval;
+
+	if (!READ_ONCE(compact_interval_ms))
+		return;
+
+	zs_background_compact(pool);
+
+	/* Setting the period to 0 meanwhile stops the work here */
+	interval = READ_ONCE(compact_interval_ms);
+	if (interval)
+		queue_delayed_work(system_unbound_wq, &pool->compact_work,
+				   msecs_to_jiffies(interval));
+}
+
+static int compact_interval_set(const char *val, const struct kernel_param *kp)
+{
+	struct zs_pool *pool;
+	unsigned int interval;
+	int ret;
+
+	ret = param_set_uint(val, kp);
+	if (ret)
+		return ret;
+
+	mutex_lock(&zs_pools_lock);
+	interval = READ_ONCE(compact_interval_ms);
+	list_for_each_entry(pool, &zs_pools, pool_list) {
+		if (interval)
+			mod_delayed_work(system_unbound_wq, &pool->compact_work,
+					 msecs_to_jiffies(interval));
+		else
+			cancel_delayed_work(&pool->compact_work);
+	}
+	mutex_unlock(&zs_pools_lock);
+
+	return 0;
+}
+
+static const struct kernel_param_ops compact_interval_ops = {
+	.set = compact_interval_set,
+	.get = param_get_uint,
+};
+module_param_cb(compact_interval_ms, &compact_interval_ops,
+		&compact_interval_ms, 0644);
+MODULE_PARM_DESC(compact_interval_ms, "Background compaction period in ms, 0 to disable");
+
 void zs_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
 {
 	memcpy(stats, &pool->stats, sizeof(struct zs_pool_stats));
@@ -2509,6 +2950,8 @@ struct zs_pool *zs_create_pool(const char *name)
 		return NULL;
 
 	init_deferred_free(pool);
+	INIT_LIST_HEAD(&pool->pool_list);
+	INIT_DEFERRABLE_WORK(&pool->compact_work, zs_compact_work);
 	pool->size_class = kcalloc(zs_size_classes, sizeof(struct size_class *),
 			GFP_KERNEL);
 	if (!pool->size_class) {
@@ -2595,6 +3038,22 @@ struct zs_pool *zs_create_pool(const char *name)
 							fullness++)
 			INIT_LIST_HEAD(&class->fullness_list[fullness]);
 
+		class->stats = alloc_percpu(struct zs_size_stat);
+		if (!class->stats)
+			goto err;
+
+		/* Caching whole pages per cpu is not worth it */
+		if (objs_per_zspage > 1) {
+			int cpu;
+
+			class->magazine = alloc_percpu(struct zs_magazine);
+			if (!class->magazine)
+				goto err;
+			for_each_possible_cpu(cpu)
+				spin_lock_init(&per_cpu_ptr(class->magazine,
+							    cpu)->lock);
+		}
+
 		prev_class = class;
 	}
 
@@ -2610,6 +3069,13 @@ struct zs_pool *zs_create_pool(const char *name)
 	 */
 	if (zs_register_shrinker(pool) == 0)
 		pool->shrinker_enabled = true;
+
+	mutex_lock(&zs_pools_lock);
+	list_add(&pool->pool_list, &zs_pools);
+	if (compact_interval_ms)
+		queue_delayed_work(system_unbound_wq, &pool->compact_work,
+				   msecs_to_jiffies(compact_interval_ms));
+	mutex_unlock(&zs_pools_lock);
 	return pool;
 
 err:
@@ -2623,6 +3089,11 @@ void zs_destroy_pool(struct zs_pool *pool)
 	int i;
 
 	zs_unregister_shrinker(pool);
+	mutex_lock(&zs_pools_lock);
+	list_del(&pool->pool_list);
+	mutex_unlock(&zs_pools_lock);
+	cancel_delayed_work_sync(&pool->compact_work);
+	zs_magazine_drain_all(pool);
 	zs_unregister_migration(pool);
 	zs_pool_stat_destroy(pool);
 
@@ -2642,6 +3113,8 @@ void zs_destroy_pool(struct zs_pool *pool)
 					class->size, fg);
 			}
 		}
+		free_percpu(class->magazine);
+		free_percpu(class->stats);
 		kfree(class);
 	}
 
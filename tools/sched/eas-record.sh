@@ -0,0 +1,86 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0
+#
+# Record a scheduling trace and the energy model for eas-replay.
+#
+# usage: eas-record.sh <seconds> <outdir>
+#
+# Writes <outdir>/trace with the sched_switch, sched_wakeup,
+# sched_wakeup_new and cpu_frequency events of the run, and <outdir>/model
+# with the energy model of each cluster. The model is read back from
+# /proc/sys/kernel/sched_domain, which needs CONFIG_SCHED_DEBUG: domain0
+# group0 of the first CPU of a cluster holds the per-core costs and domain1
+# group0 the per-cluster costs.
+
+if [ $# -ne 2 ]; then
+	echo "usage: $0 <seconds> <outdir>" >&2
+	exit 1
+fi
+
+secs=$1
+out=$2
+sd=/proc/sys/kernel/sched_domain
+
+for t in /sys/kernel/tracing /sys/kernel/debug/tracing; do
+	[ -f $t/trace ] && break
+done
+if [ ! -f $t/trace ]; then
+	echo "tracefs not found" >&2
+	exit 1
+fi
+if [ ! -d $sd/cpu0/domain0 ]; then
+	echo "$sd not found, CONFIG_SCHED_DEBUG is needed" >&2
+	exit 1
+fi
+
+mkdir -p $out || exit 1
+
+# Model: one block per cluster, keyed by the physical package id
+{
+	echo "# energy model recorded on $(uname -r)"
+	seen=" "
+	for c in /sys/devices/system/cpu/cpu[0-9]*; do
+		id=$(cat $c/topology/physical_package_id)
+		case "$seen" in
+		*" $id "*) continue ;;
+		esac
+		seen="$seen$id "
+		cpu=${c##*/cpu}
+		echo "cluster $id $(cat $c/topology/core_siblings_list)"
+		e=$sd/cpu$cpu/domain0/group0/energy
+		echo "core-cap" $(cat $e/cap_states)
+		echo "core-idle" $(cat $e/idle_states)
+		e=$sd/cpu$cpu/domain1/group0/energy
+		if [ -d $e ]; then
+			echo "cluster-cap" $(cat $e/cap_states)
+			echo "cluster-idle" $(cat $e/idle_states)
+		fi
+	done
+} > $out/model
+
+echo 0 > $t/tracing_on
+echo > $t/trace
+echo 16384 > $t/buffer_size_kb
+for e in sched/sched_switch sched/sched_wakeup sched/sched_wakeup_new \
+	 power/cpu_frequency; do
+	echo 1 > $t/events/$e/enable
+done
+
+# Seed the frequency of every CPU, cpu_frequency only fires on changes
+for c in /sys/devices/system/cpu/cpu[0-9]*; do
+	f=$c/cpufreq/scaling_cur_freq
+	[ -f $f ] && echo "  <...>-0 [${c##*/cpu}] .... 0.000000: cpu_frequency: state=$(cat $f) cpu_id=${c##*/cpu}"
+done > $out/trace
+
+echo 1 > $t/tracing_on
+sleep $secs
+echo 0 > $t/tracing_on
+
+cat $t/trace >> $out/trace
+
+for e in sched/sched_switch sched/sched_wakeup sched/sched_wakeup_new \
+	 power/cpu_frequency; do
+	echo 0 > $t/events/$e/enable
+done
+
+echo "wrote $out/model and $out/trace"
@@ -0,0 +1,1429 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * eas-replay: replay a recorded scheduling trace against an energy model
+ *
+ * The trace is the text output of the sched_switch, sched_wakeup,
+ * sched_wakeup_new and cpu_frequency tracepoints, as recorded by
+ * eas-record.sh. It is turned into a list of activations per task: the
+ * work done between a wakeup and the next sleep, normalised to the
+ * capacity of the CPU and frequency it ran at, and the time the task then
+ * slept for.
+ *
+ * The activations are replayed once per placement strategy on a simple
+ * model of the system: one FIFO runqueue per CPU with round robin time
+ * slices and newidle pull, PELT style utilization signals and a schedutil
+ * style frequency choice per cluster. Energy is integrated over the run
+ * from the busy and idle costs of the energy model, the same data the
+ * kernel reads from the sched-energy-costs DT nodes.
+ *
+ * For each strategy the predicted energy, the wakeup latency (time from
+ * wakeup to first run) and the response time (time from wakeup to the end
+ * of the activation) are reported.
+ *
+ * Compile with:
+ *
+ * gcc -O2 -o eas-replay eas-replay.c -lm
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint64_t u64;
+
+#define MAX_CPUS	32
+#define MAX_CLUSTERS	8
+#define MAX_STATES	32
+#define NR_PID_HASH	4096
+
+#define CAPACITY_SCALE	1024
+#define NSEC_PER_USEC	1000ULL
+#define NSEC_PER_MSEC	1000000ULL
+#define NSEC_PER_SEC	1000000000ULL
+
+/* PELT half-life */
+#define PELT_HALFLIFE_NS	(32 * NSEC_PER_MSEC)
+
+/* Same 25% headroom schedutil and the EAS fits check use */
+#define capacity_margin(util)	((util) * 1280 / CAPACITY_SCALE)
+
+struct cap_state {
+	unsigned long cap;
+	unsigned long freq;
+	unsigned long power;
+};
+
+struct em_level {
+	int nr_cap_states;
+	struct cap_state cap_states[MAX_STATES];
+	int nr_idle_states;
+	unsigned long idle_states[MAX_STATES];
+};
+
+struct cluster {
+	int nr_cpus;
+	int cpus[MAX_CPUS];
+	struct em_level core;
+	struct em_level cluster;
+
+	/* Replay state */
+	int opp;
+	u64 idle_since;
+	double energy;
+};
+
+struct activation {
+	u64 wake;		/* trace time of the wakeup */
+	u64 sleep;		/* time slept before the next activation */
+	double work;		/* ns of running at CAPACITY_SCALE */
+	int cpu;		/* first CPU run on in the trace, or -1 */
+};
+
+enum {
+	TRACE_UNKNOWN,
+	TRACE_SLEEPING,
+	TRACE_RUNNABLE,
+	TRACE_RUNNING,
+};
+
+struct task {
+	struct task *hash_next;
+	int pid;
+	char comm[32];
+	int pinned_cpu;
+
+	struct activation *acts;
+	int nr_acts;
+	int max_acts;
+
+	/* Trace parsing state */
+	int trace_state;
+	u64 run_start;
+	u64 act_end;
+
+	/* Replay state */
+	int act;
+	int cpu;
+	int heap_idx;
+	bool started;
+	u64 wake_time;
+	u64 next_wake;
+	double remaining;
+	double util;
+	u64 util_update;
+	struct task *rq_next;
+};
+
+struct cpu {
+	int cluster;
+	struct task *curr;
+	struct task *head, *tail;
+	int nr_queued;
+	u64 slice_end;
+	u64 idle_since;
+	double util;
+	u64 util_update;
+};
+
+struct stats {
+	u64 *lat;
+	int nr_lat;
+	int max_lat;
+	double resp_sum;
+	u64 nr_resp;
+	u64 migrations;
+	u64 wakeups;
+	u64 end;
+};
+
+typedef int (*select_fn)(struct task *p);
+
+struct strategy {
+	const char *name;
+	select_fn select;
+	const char *desc;
+};
+
+static struct cluster clusters[MAX_CLUSTERS];
+static int nr_clusters;
+static struct cpu cpus[MAX_CPUS];
+static int nr_cpus;
+
+static struct task *pid_hash[NR_PID_HASH];
+static struct task **tasks;
+static int nr_tasks;
+
+static unsigned long trace_freq[MAX_CPUS];
+static u64 trace_first, trace_last;
+
+static struct task **wake_heap;
+static int heap_size;
+
+static u64 now;
+static struct stats st;
+
+static u64 slice_ns = 4 * NSEC_PER_MSEC;
+static u64 deep_idle_ns = 2 * NSEC_PER_MSEC;
+static bool idle_pull = true;
+static bool closed_loop;
+static int verbose;
+
+static void die(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	exit(1);
+}
+
+static void *xrealloc(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size);
+	if (!ptr)
+		die("out of memory\n");
+	return ptr;
+}
+
+/*
+ * Energy model
+ *
+ *	cluster <id> <cpulist>
+ *	core-cap <cap> <freq> <power> [<cap> <freq> <power> ...]
+ *	core-idle <power> [<power> ...]
+ *	cluster-cap <cap> <freq> <power> [...]
+ *	cluster-idle <power> [...]
+ *
+ * The cap and idle lines apply to the last cluster line. Idle states go
+ * from the shallowest to the deepest, as in the kernel.
+ */
+
+static int parse_cpulist(const char *s, int *out)
+{
+	int n = 0;
+
+	while (*s && !isspace((unsigned char)*s)) {
+		char *end;
+		long a, b;
+
+		a = strtol(s, &end, 10);
+		if (end == s)
+			return -1;
+		b = a;
+		if (*end == '-') {
+			s = end + 1;
+			b = strtol(s, &end, 10);
+			if (end == s)
+				return -1;
+		}
+		for (; a <= b; a++) {
+			if (a < 0 || a >= MAX_CPUS || n >= MAX_CPUS)
+				return -1;
+			out[n++] = a;
+		}
+		s = end;
+		if (*s == ',')
+			s++;
+	}
+
+	return n;
+}
+
+static void parse_cap_states(struct em_level *lvl, char *s, int line)
+{
+	char *end;
+
+	lvl->nr_cap_states = 0;
+	for (;;) {
+		struct cap_state *cs = &lvl->cap_states[lvl->nr_cap_states];
+
+		cs->cap = strtoul(s, &end, 10);
+		if (end == s)
+			break;
+		cs->freq = strtoul(end, &s, 10);
+		if (s == end)
+			die("model:%d: cap states come in cap/freq/power triplets\n",
+			    line);
+		cs->power = strtoul(s, &end, 10);
+		if (end == s)
+			die("model:%d: cap states come in cap/freq/power triplets\n",
+			    line);
+		s = end;
+		if (++lvl->nr_cap_states == MAX_STATES)
+			break;
+	}
+
+	if (!lvl->nr_cap_states)
+		die("model:%d: no cap states\n", line);
+}
+
+static void parse_idle_states(struct em_level *lvl, char *s, int line)
+{
+	char *end;
+
+	lvl->nr_idle_states = 0;
+	for (;;) {
+		lvl->idle_states[lvl->nr_idle_states] = strtoul(s, &end, 10);
+		if (end == s)
+			break;
+		s = end;
+		if (++lvl->nr_idle_states == MAX_STATES)
+			break;
+	}
+
+	if (!lvl->nr_idle_states)
+		die("model:%d: no idle states\n", line);
+}
+
+static void load_model(const char *path)
+{
+	struct cluster *cl = NULL;
+	char buf[4096];
+	int line = 0, i, cpu;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		die("%s: %s\n", path, strerror(errno));
+
+	while (fgets(buf, sizeof(buf), f)) {
+		char key[32];
+		int n;
+
+		line++;
+		if (buf[0] == '#' || sscanf(buf, "%31s%n", key, &n) != 1)
+			continue;
+
+		if (!strcmp(key, "cluster")) {
+			char list[256];
+
+			if (nr_clusters == MAX_CLUSTERS)
+				die("model:%d: too many clusters\n", line);
+			cl = &clusters[nr_clusters++];
+			if (sscanf(buf + n, "%*d %255s", list) != 1)
+				die("model:%d: cluster <id> <cpulist>\n", line);
+			cl->nr_cpus = parse_cpulist(list, cl->cpus);
+			if (cl->nr_cpus <= 0)
+				die("model:%d: bad cpu list\n", line);
+			continue;
+		}
+
+		if (!cl)
+			die("model:%d: %s before any cluster\n", line, key);
+
+		if (!strcmp(key, "core-cap"))
+			parse_cap_states(&cl->core, buf + n, line);
+		else if (!strcmp(key, "core-idle"))
+			parse_idle_states(&cl->core, buf + n, line);
+		else if (!strcmp(key, "cluster-cap"))
+			parse_cap_states(&cl->cluster, buf + n, line);
+		else if (!strcmp(key, "cluster-idle"))
+			parse_idle_states(&cl->cluster, buf + n, line);
+		else
+			die("model:%d: unknown key %s\n", line, key);
+	}
+	fclose(f);
+
+	if (!nr_clusters)
+		die("%s: no clusters\n", path);
+
+	for (i = 0; i < nr_clusters; i++) {
+		cl = &clusters[i];
+		if (!cl->core.nr_cap_states || !cl->core.nr_idle_states)
+			die("%s: cluster %d has no core costs\n", path, i);
+		if (cl->cluster.nr_cap_states &&
+		    cl->cluster.nr_cap_states != cl->core.nr_cap_states)
+			die("%s: cluster %d core and cluster cap states differ\n",
+			    path, i);
+		if (cl->cluster.nr_cap_states && !cl->cluster.nr_idle_states)
+			die("%s: cluster %d has no cluster idle costs\n",
+			    path, i);
+		for (cpu = 0; cpu < cl->core.nr_cap_states; cpu++)
+			if (!cl->core.cap_states[cpu].cap)
+				die("%s: cluster %d has a zero capacity state\n",
+				    path, i);
+		for (cpu = 0; cpu < cl->nr_cpus; cpu++) {
+			int c = cl->cpus[cpu];
+
+			cpus[c].cluster = i;
+			if (c >= nr_cpus)
+				nr_cpus = c + 1;
+		}
+	}
+}
+
+static struct cluster *cpu_cluster(int cpu)
+{
+	return &clusters[cpus[cpu].cluster];
+}
+
+static unsigned long cap_orig(int cpu)
+{
+	struct em_level *core = &cpu_cluster(cpu)->core;
+
+	return core->cap_states[core->nr_cap_states - 1].cap;
+}
+
+static unsigned long cap_curr(int cpu)
+{
+	struct cluster *cl = cpu_cluster(cpu);
+
+	return cl->core.cap_states[cl->opp].cap;
+}
+
+/* Capacity of @cpu running at @freq kHz, per the last state not above it */
+static unsigned long cap_at_freq(int cpu, unsigned long freq)
+{
+	struct em_level *core = &cpu_cluster(cpu)->core;
+	int i;
+
+	if (!freq)
+		return cap_orig(cpu);
+
+	for (i = core->nr_cap_states - 1; i > 0; i--)
+		if (core->cap_states[i].freq <= freq)
+			break;
+
+	return core->cap_states[i].cap;
+}
+
+/* Lowest state of @cl whose capacity covers @util with headroom */
+static int find_opp(struct cluster *cl, double util)
+{
+	int i;
+
+	for (i = 0; i < cl->core.nr_cap_states - 1; i++)
+		if (cl->core.cap_states[i].cap >= capacity_margin(util))
+			break;
+
+	return i;
+}
+
+/* Trace parsing */
+
+static struct task *find_task(int pid, const char *comm)
+{
+	struct task **pp = &pid_hash[pid % NR_PID_HASH], *p;
+
+	for (p = *pp; p; p = p->hash_next)
+		if (p->pid == pid)
+			return p;
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		die("out of memory\n");
+	p->pid = pid;
+	p->pinned_cpu = -1;
+	p->hash_next = *pp;
+	*pp = p;
+
+	tasks = xrealloc(tasks, (nr_tasks + 1) * sizeof(*tasks));
+	tasks[nr_tasks++] = p;
+
+	if (comm) {
+		const char *slash;
+
+		snprintf(p->comm, sizeof(p->comm), "%s", comm);
+		/* Per-cpu kthreads, e.g. ksoftirqd/2 or kworker/2:1 */
+		slash = strchr(p->comm, '/');
+		if (slash && isdigit((unsigned char)slash[1])) {
+			int cpu = atoi(slash + 1);
+
+			if (cpu < nr_cpus)
+				p->pinned_cpu = cpu;
+		}
+	}
+
+	return p;
+}
+
+static void start_activation(struct task *p, u64 ts)
+{
+	struct activation *a;
+
+	if (p->nr_acts == p->max_acts) {
+		p->max_acts = p->max_acts ? p->max_acts * 2 : 16;
+		p->acts = xrealloc(p->acts, p->max_acts * sizeof(*p->acts));
+	}
+
+	if (p->nr_acts)
+		p->acts[p->nr_acts - 1].sleep = ts > p->act_end ?
+						ts - p->act_end : 0;
+
+	a = &p->acts[p->nr_acts++];
+	a->wake = ts;
+	a->sleep = 0;
+	a->work = 0;
+	a->cpu = -1;
+	p->act_end = ts;
+	p->trace_state = TRACE_RUNNABLE;
+}
+
+static void account_run(struct task *p, int cpu, u64 ts)
+{
+	struct activation *a = &p->acts[p->nr_acts - 1];
+
+	a->work += (double)(ts - p->run_start) *
+		   cap_at_freq(cpu, trace_freq[cpu]) / CAPACITY_SCALE;
+}
+
+/* Copies the value of "key=" into @buf, stopping at @stop or a blank */
+static bool get_field(const char *s, const char *key, const char *stop,
+		      char *buf, size_t len)
+{
+	const char *v = strstr(s, key), *e;
+
+	if (!v)
+		return false;
+	v += strlen(key);
+	e = stop ? strstr(v, stop) : NULL;
+	if (!e)
+		for (e = v; *e && !isspace((unsigned char)*e); e++)
+			;
+	if ((size_t)(e - v) >= len)
+		e = v + len - 1;
+	memcpy(buf, v, e - v);
+	buf[e - v] = '\0';
+
+	return true;
+}
+
+static void trace_switch(const char *s, int cpu, u64 ts)
+{
+	char comm[32], val[32];
+	struct task *p;
+	int pid;
+
+	if (!get_field(s, "prev_comm=", " prev_pid=", comm, sizeof(comm)) ||
+	    !get_field(s, " prev_pid=", NULL, val, sizeof(val)))
+		return;
+	pid = atoi(val);
+	if (pid && get_field(s, " prev_state=", NULL, val, sizeof(val))) {
+		p = find_task(pid, comm);
+		if (p->trace_state == TRACE_RUNNING) {
+			account_run(p, cpu, ts);
+			if (val[0] == 'R') {
+				p->trace_state = TRACE_RUNNABLE;
+			} else {
+				p->trace_state = TRACE_SLEEPING;
+				p->act_end = ts;
+			}
+		} else if (val[0] != 'R') {
+			p->trace_state = TRACE_SLEEPING;
+		}
+	}
+
+	if (!get_field(s, "next_comm=", " next_pid=", comm, sizeof(comm)) ||
+	    !get_field(s, " next_pid=", NULL, val, sizeof(val)))
+		return;
+	pid = atoi(val);
+	if (!pid)
+		return;
+
+	p = find_task(pid, comm);
+	/* Running without a wakeup seen: the trace started, or lost events */
+	if (p->trace_state != TRACE_RUNNABLE)
+		start_activation(p, ts);
+	p->trace_state = TRACE_RUNNING;
+	p->run_start = ts;
+	if (p->acts[p->nr_acts - 1].cpu < 0)
+		p->acts[p->nr_acts - 1].cpu = cpu;
+}
+
+static void trace_wakeup(const char *s, u64 ts)
+{
+	char comm[32], val[32];
+	struct task *p;
+	int pid;
+
+	if (!get_field(s, "comm=", " pid=", comm, sizeof(comm)) ||
+	    !get_field(s, " pid=", NULL, val, sizeof(val)))
+		return;
+	pid = atoi(val);
+	if (!pid)
+		return;
+
+	p = find_task(pid, comm);
+	if (p->trace_state == TRACE_SLEEPING ||
+	    p->trace_state == TRACE_UNKNOWN)
+		start_activation(p, ts);
+}
+
+static void trace_frequency(const char *s)
+{
+	char freq[32], val[32];
+	int cpu;
+
+	if (!get_field(s, "state=", NULL, freq, sizeof(freq)) ||
+	    !get_field(s, "cpu_id=", NULL, val, sizeof(val)))
+		return;
+	cpu = atoi(val);
+	if (cpu >= 0 && cpu < MAX_CPUS)
+		trace_freq[cpu] = strtoul(freq, NULL, 10);
+}
+
+/*
+ * Lines look like
+ *   <comm>-<pid> [cpu] <flags> <secs>.<usecs>: <event>: <fields>
+ * where the flags column is optional.
+ */
+static void load_trace(const char *path)
+{
+	static const char *const events[] = {
+		"sched_switch", "sched_wakeup", "sched_wakeup_new",
+		"cpu_frequency",
+	};
+	char buf[1024];
+	FILE *f;
+	int i;
+
+	f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	if (!f)
+		die("%s: %s\n", path, strerror(errno));
+
+	while (fgets(buf, sizeof(buf), f)) {
+		char *br, *ev = NULL, *ts_end, *ts_start;
+		unsigned long secs, usecs;
+		int cpu, e;
+		u64 ts;
+
+		if (buf[0] == '#')
+			continue;
+		br = strstr(buf, "] ");
+		if (!br)
+			continue;
+		while (br > buf && br[-1] != '[')
+			br--;
+		cpu = atoi(br);
+		if (cpu < 0 || cpu >= nr_cpus)
+			continue;
+
+		for (e = 0; e < (int)(sizeof(events) / sizeof(events[0]));
+		     e++) {
+			char pat[40];
+
+			snprintf(pat, sizeof(pat), ": %s: ", events[e]);
+			ev = strstr(br, pat);
+			if (ev)
+				break;
+		}
+		if (!ev)
+			continue;
+
+		ts_end = ev;
+		for (ts_start = ts_end; ts_start > br &&
+		     !isspace((unsigned char)ts_start[-1]); ts_start--)
+			;
+		if (sscanf(ts_start, "%lu.%lu", &secs, &usecs) != 2)
+			continue;
+		ts = secs * NSEC_PER_SEC + usecs * NSEC_PER_USEC;
+		/* Frequencies may be seeded ahead of the trace proper */
+		if (e != 3) {
+			if (!trace_first)
+				trace_first = ts;
+			trace_last = ts;
+		}
+
+		ev += strlen(events[e]) + 4;
+		switch (e) {
+		case 0:
+			trace_switch(ev, cpu, ts);
+			break;
+		case 1:
+		case 2:
+			trace_wakeup(ev, ts);
+			break;
+		case 3:
+			trace_frequency(ev);
+			break;
+		}
+	}
+
+	if (f != stdin)
+		fclose(f);
+
+	/* Close whatever was still running when the trace stopped */
+	for (i = 0; i < nr_tasks; i++) {
+		struct task *p = tasks[i];
+
+		if (p->trace_state == TRACE_RUNNING)
+			account_run(p, p->acts[p->nr_acts - 1].cpu, trace_last);
+		p->trace_state = TRACE_UNKNOWN;
+	}
+}
+
+/* Replay: utilization */
+
+static double pelt_decay(u64 delta)
+{
+	return exp2(-(double)delta / PELT_HALFLIFE_NS);
+}
+
+static void update_task_util(struct task *p, bool running)
+{
+	double y = pelt_decay(now - p->util_update);
+
+	p->util *= y;
+	if (running)
+		p->util += cap_curr(p->cpu) * (1 - y);
+	p->util_update = now;
+}
+
+static void update_cpu_util(int cpu)
+{
+	struct cpu *c = &cpus[cpu];
+	double y = pelt_decay(now - c->util_update);
+
+	c->util *= y;
+	if (c->curr)
+		c->util += cap_curr(cpu) * (1 - y);
+	c->util_update = now;
+}
+
+/* Utilization of @cpu as seen by placement and frequency selection */
+static double cpu_util(int cpu)
+{
+	struct cpu *c = &cpus[cpu];
+	double sum = 0;
+	struct task *p;
+
+	if (c->curr)
+		sum += c->curr->util;
+	for (p = c->head; p; p = p->rq_next)
+		sum += p->util;
+
+	return sum > c->util ? sum : c->util;
+}
+
+static bool cpu_idle(int cpu)
+{
+	return !cpus[cpu].curr && !cpus[cpu].nr_queued;
+}
+
+/* Replay: energy */
+
+static unsigned long idle_cost(struct em_level *lvl, u64 idle_for)
+{
+	if (!lvl->nr_idle_states)
+		return 0;
+	if (idle_for >= deep_idle_ns)
+		return lvl->idle_states[lvl->nr_idle_states - 1];
+	return lvl->idle_states[0];
+}
+
+/* Charges the idle energy of [from, to) for an idle period begun at @since */
+static double idle_energy(struct em_level *lvl, u64 since, u64 from, u64 to)
+{
+	u64 deep = since + deep_idle_ns;
+
+	if (to <= deep)
+		return (double)idle_cost(lvl, 0) * (to - from);
+	if (from >= deep)
+		return (double)idle_cost(lvl, deep_idle_ns) * (to - from);
+	return (double)idle_cost(lvl, 0) * (deep - from) +
+	       (double)idle_cost(lvl, deep_idle_ns) * (to - deep);
+}
+
+static void account_energy(u64 to)
+{
+	int i, j;
+
+	for (i = 0; i < nr_clusters; i++) {
+		struct cluster *cl = &clusters[i];
+		bool busy = false;
+
+		for (j = 0; j < cl->nr_cpus; j++) {
+			struct cpu *c = &cpus[cl->cpus[j]];
+
+			if (c->curr) {
+				busy = true;
+				cl->energy += (double)(to - now) *
+					cl->core.cap_states[cl->opp].power;
+			} else {
+				cl->energy += idle_energy(&cl->core,
+							  c->idle_since,
+							  now, to);
+			}
+		}
+
+		if (!cl->cluster.nr_cap_states)
+			continue;
+		if (busy)
+			cl->energy += (double)(to - now) *
+				cl->cluster.cap_states[cl->opp].power;
+		else
+			cl->energy += idle_energy(&cl->cluster, cl->idle_since,
+						  now, to);
+	}
+}
+
+/*
+ * Energy the system is predicted to use per unit of time with @add of
+ * utilization placed on @dst, as compute_energy() does in fair.c: each
+ * cluster runs at the state its busiest CPU asks for and each CPU is busy
+ * for its utilization over the capacity of that state.
+ */
+static double estimate_energy(int dst, double add)
+{
+	double energy = 0;
+	int i, j;
+
+	for (i = 0; i < nr_clusters; i++) {
+		struct cluster *cl = &clusters[i];
+		double util[MAX_CPUS], max_util = 0, max_busy = 0;
+		unsigned long cap;
+		int opp;
+
+		for (j = 0; j < cl->nr_cpus; j++) {
+			util[j] = cpu_util(cl->cpus[j]);
+			if (cl->cpus[j] == dst)
+				util[j] += add;
+			if (util[j] > max_util)
+				max_util = util[j];
+		}
+
+		opp = find_opp(cl, max_util);
+		cap = cl->core.cap_states[opp].cap;
+
+		for (j = 0; j < cl->nr_cpus; j++) {
+			double busy = util[j] / cap;
+
+			if (busy > 1)
+				busy = 1;
+			if (busy > max_busy)
+				max_busy = busy;
+			energy += busy * cl->core.cap_states[opp].power +
+				  (1 - busy) * cl->core.idle_states[0];
+		}
+
+		if (cl->cluster.nr_cap_states)
+			energy += max_busy * cl->cluster.cap_states[opp].power +
+				  (1 - max_busy) *
+				  cl->cluster.idle_states[0];
+	}
+
+	return energy;
+}
+
+/* Replay: placement strategies */
+
+static bool task_fits(struct task *p, int cpu)
+{
+	return capacity_margin(cpu_util(cpu) + p->util) <= cap_orig(cpu);
+}
+
+/* Largest spare capacity, preferring idle CPUs */
+static int select_spread(struct task *p)
+{
+	double best_spare = -1e18;
+	int cpu, best = 0;
+
+	(void)p;
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		double spare = cap_orig(cpu) - cpu_util(cpu);
+
+		if (cpu_idle(cpu))
+			spare += CAPACITY_SCALE * 4;
+		if (spare > best_spare) {
+			best_spare = spare;
+			best = cpu;
+		}
+	}
+
+	return best;
+}
+
+static int select_prev(struct task *p)
+{
+	return p->cpu;
+}
+
+static int select_trace(struct task *p)
+{
+	int cpu = p->acts[p->act].cpu;
+
+	return cpu >= 0 && cpu < nr_cpus ? cpu : p->cpu;
+}
+
+/* Fullest CPU of the smallest capacity the task fits on */
+static int select_pack(struct task *p)
+{
+	double best_util = -1;
+	unsigned long best_cap = ~0UL;
+	int cpu, best = -1;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		double util = cpu_util(cpu);
+
+		if (!task_fits(p, cpu))
+			continue;
+		if (cap_orig(cpu) > best_cap)
+			continue;
+		if (cap_orig(cpu) == best_cap && util <= best_util)
+			continue;
+		best_cap = cap_orig(cpu);
+		best_util = util;
+		best = cpu;
+	}
+
+	return best >= 0 ? best : select_spread(p);
+}
+
+/* Lowest estimated energy among the CPUs the task fits on */
+static int select_eas(struct task *p)
+{
+	double best_energy = 0;
+	int cpu, best = -1;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		double energy;
+
+		if (!task_fits(p, cpu))
+			continue;
+
+		energy = estimate_energy(cpu, p->util);
+		/* Ties go to the previous CPU, then to an idle one */
+		if (best >= 0) {
+			if (energy > best_energy)
+				continue;
+			if (energy == best_energy &&
+			    (best == p->cpu ||
+			     (cpu != p->cpu && !cpu_idle(cpu))))
+				continue;
+		}
+		best_energy = energy;
+		best = cpu;
+	}
+
+	return best >= 0 ? best : select_spread(p);
+}
+
+static const struct strategy strategies[] = {
+	{ "trace",  select_trace,  "CPU the task ran on in the trace" },
+	{ "prev",   select_prev,   "always the previous CPU" },
+	{ "spread", select_spread, "largest spare capacity, idle first" },
+	{ "pack",   select_pack,   "fullest of the smallest CPUs that fit" },
+	{ "eas",    select_eas,    "lowest estimated energy among fitting CPUs" },
+};
+
+#define NR_STRATEGIES	(int)(sizeof(strategies) / sizeof(strategies[0]))
+
+/* Replay: wakeup heap, ordered by next_wake */
+
+static void heap_swap(int a, int b)
+{
+	struct task *t = wake_heap[a];
+
+	wake_heap[a] = wake_heap[b];
+	wake_heap[b] = t;
+	wake_heap[a]->heap_idx = a;
+	wake_heap[b]->heap_idx = b;
+}
+
+static void heap_push(struct task *p)
+{
+	int i = heap_size++;
+
+	wake_heap[i] = p;
+	p->heap_idx = i;
+	while (i && wake_heap[(i - 1) / 2]->next_wake > p->next_wake) {
+		heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static struct task *heap_pop(void)
+{
+	struct task *top = wake_heap[0];
+	int i = 0;
+
+	wake_heap[0] = wake_heap[--heap_size];
+	wake_heap[0]->heap_idx = 0;
+	for (;;) {
+		int l = 2 * i + 1, r = l + 1, m = i;
+
+		if (l < heap_size &&
+		    wake_heap[l]->next_wake < wake_heap[m]->next_wake)
+			m = l;
+		if (r < heap_size &&
+		    wake_heap[r]->next_wake < wake_heap[m]->next_wake)
+			m = r;
+		if (m == i)
+			break;
+		heap_swap(i, m);
+		i = m;
+	}
+
+	return top;
+}
+
+/* Replay: runqueues */
+
+static void enqueue(int cpu, struct task *p)
+{
+	struct cpu *c = &cpus[cpu];
+
+	p->rq_next = NULL;
+	if (c->tail)
+		c->tail->rq_next = p;
+	else
+		c->head = p;
+	c->tail = p;
+	c->nr_queued++;
+}
+
+static struct task *dequeue_head(int cpu)
+{
+	struct cpu *c = &cpus[cpu];
+	struct task *p = c->head;
+
+	if (!p)
+		return NULL;
+	c->head = p->rq_next;
+	if (!c->head)
+		c->tail = NULL;
+	c->nr_queued--;
+	p->rq_next = NULL;
+
+	return p;
+}
+
+/* Removes the first queued task that may run elsewhere */
+static struct task *steal(int cpu)
+{
+	struct cpu *c = &cpus[cpu];
+	struct task *p, *prev = NULL;
+
+	for (p = c->head; p; prev = p, p = p->rq_next) {
+		if (p->pinned_cpu >= 0)
+			continue;
+		if (prev)
+			prev->rq_next = p->rq_next;
+		else
+			c->head = p->rq_next;
+		if (c->tail == p)
+			c->tail = prev;
+		c->nr_queued--;
+		p->rq_next = NULL;
+		return p;
+	}
+
+	return NULL;
+}
+
+static void record_latency(u64 lat)
+{
+	if (st.nr_lat == st.max_lat) {
+		st.max_lat = st.max_lat ? st.max_lat * 2 : 4096;
+		st.lat = xrealloc(st.lat, st.max_lat * sizeof(*st.lat));
+	}
+	st.lat[st.nr_lat++] = lat;
+}
+
+static void run_task(int cpu, struct task *p)
+{
+	struct cpu *c = &cpus[cpu];
+
+	update_task_util(p, false);
+	p->cpu = cpu;
+	c->curr = p;
+	c->slice_end = now + slice_ns;
+	if (!p->started) {
+		p->started = true;
+		record_latency(now - p->wake_time);
+	}
+}
+
+static void stop_task(int cpu)
+{
+	struct cpu *c = &cpus[cpu];
+
+	update_task_util(c->curr, true);
+	c->curr = NULL;
+	c->idle_since = now;
+}
+
+static void pick_next(int cpu)
+{
+	struct task *p = dequeue_head(cpu);
+	int src, busiest = -1;
+
+	if (!p && idle_pull) {
+		for (src = 0; src < nr_cpus; src++) {
+			struct cpu *c = &cpus[src];
+
+			if (src == cpu || !c->curr || !c->nr_queued)
+				continue;
+			if (busiest < 0 || c->nr_queued > cpus[busiest].nr_queued)
+				busiest = src;
+		}
+		if (busiest >= 0) {
+			p = steal(busiest);
+			if (p)
+				st.migrations++;
+		}
+	}
+
+	if (p)
+		run_task(cpu, p);
+}
+
+static void wake_task(struct task *p, select_fn select)
+{
+	int cpu;
+
+	update_task_util(p, false);
+	p->started = false;
+	p->wake_time = now;
+	p->remaining = p->acts[p->act].work;
+	st.wakeups++;
+
+	if (p->pinned_cpu >= 0)
+		cpu = p->pinned_cpu;
+	else
+		cpu = select(p);
+	if (cpu < 0 || cpu >= nr_cpus)
+		cpu = 0;
+
+	if (p->cpu != cpu)
+		st.migrations++;
+	p->cpu = cpu;
+	enqueue(cpu, p);
+}
+
+static void finish_task(int cpu)
+{
+	struct task *p = cpus[cpu].curr;
+
+	stop_task(cpu);
+	st.resp_sum += now - p->wake_time;
+	st.nr_resp++;
+
+	if (++p->act >= p->nr_acts)
+		return;
+
+	/*
+	 * Wakeups keep their traced time unless the task is still running
+	 * by then, so that a slower placement delays but does not reshape
+	 * periodic work. In closed loop mode the traced sleep is replayed.
+	 */
+	if (closed_loop)
+		p->next_wake = now + p->acts[p->act - 1].sleep;
+	else if (p->acts[p->act].wake > now)
+		p->next_wake = p->acts[p->act].wake;
+	else
+		p->next_wake = now;
+	heap_push(p);
+}
+
+static void update_frequencies(void)
+{
+	int i, j;
+
+	for (i = 0; i < nr_clusters; i++) {
+		struct cluster *cl = &clusters[i];
+		double max_util = 0;
+		bool busy = false;
+
+		for (j = 0; j < cl->nr_cpus; j++) {
+			double util = cpu_util(cl->cpus[j]);
+
+			if (util > max_util)
+				max_util = util;
+			if (!cpu_idle(cl->cpus[j]))
+				busy = true;
+		}
+
+		cl->opp = find_opp(cl, max_util);
+		if (!busy && !cl->idle_since)
+			cl->idle_since = now;
+		else if (busy)
+			cl->idle_since = 0;
+	}
+}
+
+static u64 cpu_next_event(int cpu)
+{
+	struct cpu *c = &cpus[cpu];
+	u64 done;
+
+	if (!c->curr)
+		return ~0ULL;
+
+	done = now + (u64)ceil(c->curr->remaining * CAPACITY_SCALE /
+			       cap_curr(cpu));
+	if (done <= now)
+		done = now + 1;
+	if (c->nr_queued && c->slice_end < done)
+		return c->slice_end > now ? c->slice_end : now;
+
+	return done;
+}
+
+static void advance(u64 to)
+{
+	int cpu;
+
+	account_energy(to);
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		struct cpu *c = &cpus[cpu];
+
+		if (c->curr)
+			c->curr->remaining -= (double)(to - now) *
+					      cap_curr(cpu) / CAPACITY_SCALE;
+	}
+	now = to;
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		update_cpu_util(cpu);
+}
+
+static void reset_replay(void)
+{
+	int i;
+
+	memset(&st, 0, sizeof(st));
+	heap_size = 0;
+	now = trace_first;
+
+	for (i = 0; i < nr_clusters; i++) {
+		clusters[i].opp = 0;
+		clusters[i].idle_since = now;
+		clusters[i].energy = 0;
+	}
+
+	for (i = 0; i < nr_cpus; i++) {
+		memset(&cpus[i].curr, 0,
+		       sizeof(cpus[i]) - offsetof(struct cpu, curr));
+		cpus[i].idle_since = now;
+		cpus[i].util_update = now;
+	}
+
+	for (i = 0; i < nr_tasks; i++) {
+		struct task *p = tasks[i];
+
+		p->act = 0;
+		p->util = 0;
+		p->util_update = now;
+		p->rq_next = NULL;
+		if (!p->nr_acts)
+			continue;
+		p->cpu = p->acts[0].cpu >= 0 ? p->acts[0].cpu : 0;
+		p->next_wake = p->acts[0].wake;
+		heap_push(p);
+	}
+}
+
+static void replay(const struct strategy *s)
+{
+	int cpu;
+
+	reset_replay();
+
+	for (;;) {
+		u64 next = heap_size ? wake_heap[0]->next_wake : ~0ULL;
+
+		for (cpu = 0; cpu < nr_cpus; cpu++) {
+			u64 t = cpu_next_event(cpu);
+
+			if (t < next)
+				next = t;
+		}
+		if (next == ~0ULL)
+			break;
+		if (next < now)
+			next = now;
+
+		advance(next);
+
+		/* Completions and slice expiries */
+		for (cpu = 0; cpu < nr_cpus; cpu++) {
+			struct cpu *c = &cpus[cpu];
+
+			if (!c->curr)
+				continue;
+			if (c->curr->remaining < 1) {
+				finish_task(cpu);
+			} else if (c->nr_queued && c->slice_end <= now) {
+				struct task *p = c->curr;
+
+				stop_task(cpu);
+				enqueue(cpu, p);
+			}
+		}
+
+		while (heap_size && wake_heap[0]->next_wake <= now)
+			wake_task(heap_pop(), s->select);
+
+		update_frequencies();
+
+		for (cpu = 0; cpu < nr_cpus; cpu++)
+			if (!cpus[cpu].curr)
+				pick_next(cpu);
+
+		update_frequencies();
+	}
+
+	st.end = now;
+}
+
+/* Reporting */
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double pct(int p)
+{
+	int idx;
+
+	if (!st.nr_lat)
+		return 0;
+	idx = (int)((u64)st.nr_lat * p / 100);
+	if (idx >= st.nr_lat)
+		idx = st.nr_lat - 1;
+	return (double)st.lat[idx] / NSEC_PER_USEC;
+}
+
+static void report(const struct strategy *s)
+{
+	double energy = 0, lat_sum = 0;
+	int i;
+
+	for (i = 0; i < nr_clusters; i++)
+		energy += clusters[i].energy;
+	energy /= NSEC_PER_SEC;
+
+	qsort(st.lat, st.nr_lat, sizeof(*st.lat), cmp_u64);
+	for (i = 0; i < st.nr_lat; i++)
+		lat_sum += st.lat[i];
+
+	printf("%-8s %12.3f %8llu %8llu %9.1f %9.1f %9.1f %9.1f %11.1f\n",
+	       s->name, energy, (unsigned long long)st.wakeups,
+	       (unsigned long long)st.migrations,
+	       st.nr_lat ? lat_sum / st.nr_lat / NSEC_PER_USEC : 0,
+	       pct(50), pct(95), pct(100),
+	       st.nr_resp ? st.resp_sum / st.nr_resp / NSEC_PER_USEC : 0);
+
+	if (verbose) {
+		for (i = 0; i < nr_clusters; i++)
+			printf("         cluster%d %12.3f\n", i,
+			       clusters[i].energy / NSEC_PER_SEC);
+		printf("         replayed %.3f s of %.3f s traced\n",
+		       (double)(st.end - trace_first) / NSEC_PER_SEC,
+		       (double)(trace_last - trace_first) / NSEC_PER_SEC);
+	}
+
+	free(st.lat);
+	st.lat = NULL;
+}
+
+static void usage(void)
+{
+	int i;
+
+	printf("usage: eas-replay -m <model> [options] <trace>\n"
+	       "\n"
+	       "  -m <file>    energy model, as written by eas-record.sh\n"
+	       "  -s <list>    comma separated strategies (default: all)\n"
+	       "  -q <us>      round robin time slice (default: 4000)\n"
+	       "  -d <us>      idle time after which the deepest idle state\n"
+	       "               is charged (default: 2000)\n"
+	       "  -n           no newidle pull\n"
+	       "  -c           closed loop: replay the traced sleep after each\n"
+	       "               activation instead of the traced wakeup time\n"
+	       "  -v           per cluster energy and replay length\n"
+	       "\n"
+	       "A trace of \"-\" is read from stdin. Strategies:\n");
+	for (i = 0; i < NR_STRATEGIES; i++)
+		printf("  %-8s %s\n", strategies[i].name, strategies[i].desc);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *model = NULL, *list = NULL;
+	int i, c, nr_acts = 0;
+
+	while ((c = getopt(argc, argv, "m:s:q:d:ncvh")) != -1) {
+		switch (c) {
+		case 'm':
+			model = optarg;
+			break;
+		case 's':
+			list = optarg;
+			break;
+		case 'q':
+			slice_ns = strtoull(optarg, NULL, 0) * NSEC_PER_USEC;
+			break;
+		case 'd':
+			deep_idle_ns = strtoull(optarg, NULL, 0) *
+				       NSEC_PER_USEC;
+			break;
+		case 'n':
+			idle_pull = false;
+			break;
+		case 'c':
+			closed_loop = true;
+			break;
+		case 'v':
+			verbose++;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (!model || optind != argc - 1 || !slice_ns)
+		usage();
+
+	load_model(model);
+	load_trace(argv[optind]);
+
+	for (i = 0; i < nr_tasks; i++)
+		nr_acts += tasks[i]->nr_acts;
+	if (!nr_acts)
+		die("%s: no sched_switch/sched_wakeup events for the modelled CPUs\n",
+		    argv[optind]);
+
+	wake_heap = xrealloc(NULL, nr_tasks * sizeof(*wake_heap));
+
+	printf("%d tasks, %d activations over %.3f s, %d cpus in %d clusters\n\n",
+	       nr_tasks, nr_acts,
+	       (double)(trace_last - trace_first) / NSEC_PER_SEC,
+	       nr_cpus, nr_clusters);
+	printf("%-8s %12s %8s %8s %9s %9s %9s %9s %11s\n", "strategy",
+	       "energy", "wakeups", "migr", "lat_avg", "lat_p50", "lat_p95",
+	       "lat_max", "resp_avg");
+
+	for (i = 0; i < NR_STRATEGIES; i++) {
+		const struct strategy *s = &strategies[i];
+
+		if (list) {
+			const char *m = strstr(list, s->name);
+			size_t len = strlen(s->name);
+
+			if (!m || (m != list && m[-1] != ',') ||
+			    (m[len] && m[len] != ','))
+				continue;
+		}
+
+		replay(s);
+		report(s);
+	}
+
+	printf("\nenergy in model power units x seconds, latencies in us\n");
+
+	return 0;
+}
@@ -0,0 +1,284 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * lookup-bench: measure path lookup latency in sdcardfs package trees
+ *
+ * Builds Android/data/<package>/d0/.../d<depth-1>/file under an sdcardfs
+ * mount for a number of packages, then times stat() of every leaf. Each
+ * round first drops the dentry and inode caches, so that every component
+ * goes through sdcardfs_lookup() and the derived permission code, and
+ * then stats the same leaves again with the caches warm.
+ *
+ * Package names are read from a packages.list style file (first word of
+ * each line) when one is given, so that the package directories resolve
+ * to real appids. Otherwise made up names are used, which miss in the
+ * package list. Every other lookup uses an upper case version of the
+ * path, to go through the case insensitive name compare.
+ *
+ * Dropping caches needs root. Compile with:
+ *
+ * gcc -O2 -o lookup-bench lookup-bench.c
+ */
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef uint64_t u64;
+
+#define MAX_DEPTH	32
+#define NSEC_PER_SEC	1000000000ULL
+
+static const char *root;
+static char **packages;
+static int nr_packages = 64;
+static int depth = 8;
+static int rounds = 5;
+static int keep;
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void die(const char *what, const char *path)
+{
+	fprintf(stderr, "%s %s: %s\n", what, path, strerror(errno));
+	exit(1);
+}
+
+static void read_packages(const char *file)
+{
+	char line[1024];
+	FILE *f;
+	int n = 0;
+
+	f = fopen(file, "r");
+	if (!f)
+		die("open", file);
+	packages = calloc(nr_packages, sizeof(*packages));
+	while (n < nr_packages && fgets(line, sizeof(line), f)) {
+		char *end = line + strcspn(line, " \t\n");
+
+		if (end == line)
+			continue;
+		*end = '\0';
+		packages[n++] = strdup(line);
+	}
+	fclose(f);
+	if (!n) {
+		fprintf(stderr, "no packages in %s\n", file);
+		exit(1);
+	}
+	nr_packages = n;
+}
+
+static void make_packages(void)
+{
+	int i;
+
+	packages = calloc(nr_packages, sizeof(*packages));
+	for (i = 0; i < nr_packages; i++) {
+		if (asprintf(&packages[i], "com.example.lookupbench%d", i) < 0)
+			exit(1);
+	}
+}
+
+static int leaf_path(char *buf, size_t len, int pkg, int upper)
+{
+	int n, d;
+
+	n = snprintf(buf, len, "%s/Android/data/%s", root, packages[pkg]);
+	for (d = 0; d < depth; d++)
+		n += snprintf(buf + n, len - n, "/d%d", d);
+	n += snprintf(buf + n, len - n, "/file");
+	if (upper) {
+		char *p = buf + strlen(root);
+
+		for (; *p; p++)
+			*p = toupper(*p);
+	}
+	return n >= (int)len ? -1 : 0;
+}
+
+static void mkdir_p(char *path)
+{
+	char *p;
+
+	for (p = path + strlen(root) + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (mkdir(path, 0771) && errno != EEXIST)
+			die("mkdir", path);
+		*p = '/';
+	}
+}
+
+static void build_tree(void)
+{
+	char path[PATH_MAX];
+	int i, fd;
+
+	for (i = 0; i < nr_packages; i++) {
+		if (leaf_path(path, sizeof(path), i, 0))
+			die("path too long for", packages[i]);
+		mkdir_p(path);
+		fd = open(path, O_CREAT | O_WRONLY, 0660);
+		if (fd < 0)
+			die("create", path);
+		close(fd);
+	}
+}
+
+static void remove_tree(void)
+{
+	char path[PATH_MAX];
+	int i, d;
+
+	for (i = 0; i < nr_packages; i++) {
+		leaf_path(path, sizeof(path), i, 0);
+		unlink(path);
+		/* d<depth-1> up to and including the package directory */
+		for (d = 0; d <= depth; d++) {
+			*strrchr(path, '/') = '\0';
+			if (rmdir(path))
+				break;
+		}
+	}
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "2", 1) != 1)
+		die("write", "/proc/sys/vm/drop_caches");
+	close(fd);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char *what, u64 *lat, int n)
+{
+	u64 sum = 0;
+	int i;
+
+	qsort(lat, n, sizeof(*lat), cmp_u64);
+	for (i = 0; i < n; i++)
+		sum += lat[i];
+	printf("%-5s %6d lookups  avg %8llu ns  p50 %8llu ns  p99 %8llu ns  max %8llu ns\n",
+	       what, n, (unsigned long long)(sum / n),
+	       (unsigned long long)lat[n / 2],
+	       (unsigned long long)lat[(n * 99) / 100],
+	       (unsigned long long)lat[n - 1]);
+}
+
+static void run(u64 *lat, int *n)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	u64 t;
+	int i;
+
+	for (i = 0; i < nr_packages; i++) {
+		leaf_path(path, sizeof(path), i, i & 1);
+		t = now_ns();
+		if (stat(path, &st))
+			die("stat", path);
+		lat[(*n)++] = now_ns() - t;
+	}
+}
+
+static void usage(void)
+{
+	printf("usage: lookup-bench [options] <sdcardfs root>\n"
+	       "\n"
+	       "  -p <n>       number of package directories (default: 64)\n"
+	       "  -l <file>    take package names from a packages.list file\n"
+	       "  -d <n>       directories below each package (default: 8)\n"
+	       "  -r <n>       cold/warm rounds (default: 5)\n"
+	       "  -k           keep the tree around afterwards\n"
+	       "\n"
+	       "<sdcardfs root> is the top of a user's view, e.g.\n"
+	       "/mnt/runtime/write/emulated/0.\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *list = NULL;
+	u64 *cold, *warm;
+	int c, r, nr_cold = 0, nr_warm = 0;
+
+	while ((c = getopt(argc, argv, "p:l:d:r:kh")) != -1) {
+		switch (c) {
+		case 'p':
+			nr_packages = atoi(optarg);
+			break;
+		case 'l':
+			list = optarg;
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'k':
+			keep = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || nr_packages <= 0 || rounds <= 0 ||
+	    depth < 0 || depth > MAX_DEPTH)
+		usage();
+	root = argv[optind];
+
+	if (list)
+		read_packages(list);
+	else
+		make_packages();
+
+	cold = calloc((size_t)rounds * nr_packages, sizeof(*cold));
+	warm = calloc((size_t)rounds * nr_packages, sizeof(*warm));
+	if (!cold || !warm)
+		exit(1);
+
+	build_tree();
+	for (r = 0; r < rounds; r++) {
+		drop_caches();
+		run(cold, &nr_cold);
+		run(warm, &nr_warm);
+	}
+
+	printf("%d packages, %d components per path, %d rounds\n",
+	       nr_packages, depth + 4, rounds);
+	report("cold", cold, nr_cold);
+	report("warm", warm, nr_warm);
+
+	if (!keep)
+		remove_tree();
+	return 0;
+}